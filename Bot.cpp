@@ -0,0 +1,45 @@
+#include "Bot.hpp"
+
+#include "Odds.hpp"
+#include "Protocol.hpp"
+
+#include <algorithm>
+
+Bot::Move Bot::decide(uint8_t const *own, uint32_t own_count, uint32_t unseen, bool opening, uint8_t claim_num, uint8_t claim_point) const {
+	Odds::Claims odds;
+	Odds::evaluate(own, own_count, unseen, &odds);
+
+	//(claims stop at Protocol::MaxClaimDice, below Odds::MaxDice)
+	uint32_t total = std::min({own_count + unseen, Odds::MaxDice, uint32_t(Protocol::MaxClaimDice)});
+	Move move;
+
+	//a new claim must be higher: more dice, or as many dice showing a higher face.
+	// claims are ordered by index (num-1)*6 + (point-1), as in Protocol::claim_byte.
+	uint32_t first = 1; //(one 1 stands before the opening claim; see raises() in Game.hpp)
+	float current = 1.0f;
+	if (!opening) {
+		first = (claim_num - 1u) * Odds::Faces + (claim_point - 1u) + 1u;
+		current = odds(claim_num, claim_point);
+	}
+
+	//most likely higher claim (ties go to the lowest claim):
+	uint32_t best = first;
+	float best_odds = -1.0f;
+	for (uint32_t i = first; i < total * Odds::Faces; ++i) {
+		float p = odds.p[i % Odds::Faces][i / Odds::Faces];
+		if (p > best_odds) {
+			best_odds = p;
+			best = i;
+		}
+	}
+
+	//reveal if the claim is unlikely, or more likely false than any raise is true:
+	if (!opening && (current < reveal_below || 1.0f - current > best_odds)) {
+		move.reveal = true;
+		return move;
+	}
+
+	move.dice_num = uint8_t(best / Odds::Faces + 1);
+	move.dice_point = uint8_t(best % Odds::Faces + 1);
+	return move;
+}
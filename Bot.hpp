@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * Bot is a computer player: it decides whether to reveal or what to claim next
+ * from the exact odds of every claim (see Odds.hpp), with no allocation or I/O,
+ * so a decision costs well under a microsecond.
+ */
+
+#include <cstdint>
+
+struct Bot {
+	struct Move {
+		bool reveal = false;
+		uint8_t dice_num = 1; //claim to make (if not revealing)
+		uint8_t dice_point = 1;
+	};
+
+	//reveal when the claim on the table holds with less than this probability:
+	float reveal_below = 0.4f;
+
+	//decide a move for a player holding 'own' with 'unseen' dice hidden from them;
+	// 'opening' means there is no claim on the table yet, otherwise it is (claim_num, claim_point):
+	Move decide(uint8_t const *own, uint32_t own_count, uint32_t unseen, bool opening, uint8_t claim_num, uint8_t claim_point) const;
+};
@@ -24,6 +24,10 @@ typedef int ssize_t;
 #include <netinet/ip.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <poll.h>
+#ifdef __linux__
+#include <netinet/tcp.h> //for TCP_INFO
+#endif
 
 #define closesocket close
 
@@ -39,11 +43,23 @@ typedef int ssize_t;
 #include <cassert>
 #include <cstring>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
 
 //Also, some help and examples for getaddrinfo from: https://beej.us/guide/bgnet/html/multi/syscalls.html
 
+//poll() is WSAPoll() on windows (not a macro, which would rename Server::poll and Client::poll too):
+static int poll_sockets(pollfd *fds, size_t count, int ms) {
+	#ifdef _WIN32
+	return WSAPoll(fds, ULONG(count), ms);
+	#else
+	return ::poll(fds, nfds_t(count), ms);
+	#endif
+}
 
 void Connection::close() {
 	if (socket != InvalidSocket) {
@@ -52,6 +68,46 @@ void Connection::close() {
 	}
 }
 
+void Connection::send_shared(Payload const &payload) {
+	if (!payload || payload->empty()) return;
+	//send_buffer goes out after the queue, so move anything already in it onto the queue first:
+	if (!send_buffer.empty()) {
+		send_queue.emplace_back(std::make_shared< std::vector< char > const >(std::move(send_buffer)));
+		send_buffer.clear();
+	}
+	send_queue.emplace_back(payload);
+}
+
+size_t Connection::pending_send() const {
+	size_t total = send_buffer.size();
+	for (auto const &payload : send_queue) {
+		total += payload->size();
+	}
+	return total - send_queue_offset;
+}
+
+uint32_t Connection::rtt_ms() const {
+#ifdef __linux__
+	struct tcp_info info;
+	socklen_t size = sizeof(info);
+	if (socket != InvalidSocket && getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size) == 0) {
+		return info.tcpi_rtt / 1000; //(tcpi_rtt is in microseconds)
+	}
+#endif
+	return 0;
+}
+
+uint32_t Connection::unacknowledged_ms() const {
+#ifdef __linux__
+	struct tcp_info info;
+	socklen_t size = sizeof(info);
+	if (socket != InvalidSocket && getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size) == 0 && info.tcpi_unacked) {
+		return info.tcpi_last_ack_recv;
+	}
+#endif
+	return 0;
+}
+
 //---------------------------------
 //Polling helper used by both server and client:
 void poll_connections(
@@ -59,49 +115,56 @@ void poll_connections(
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
 	double timeout,
-	Socket listen_socket = InvalidSocket) {
-
-	fd_set read_fds, write_fds;
-	FD_ZERO(&read_fds);
-	FD_ZERO(&write_fds);
-
-	int max = 0;
-
-	//add listen_socket to fd_set if needed:
-	if (listen_socket != InvalidSocket) {
-		max = std::max(max, int(listen_socket));
-		FD_SET(listen_socket, &read_fds);
+	std::vector< Socket > const &listen_sockets = {}) {
+
+	//one pollfd per socket (select()'s fd_set can't hold more than FD_SETSIZE sockets):
+	static thread_local std::vector< pollfd > fds;
+	static thread_local std::vector< Connection * > polled; //connection for fds[first_connection + i]
+	fds.clear();
+	polled.clear();
+
+	//listen for new connections if needed:
+	for (Socket listen_socket : listen_sockets) {
+		fds.emplace_back();
+		fds.back().fd = listen_socket;
+		fds.back().events = POLLIN;
+		fds.back().revents = 0;
 	}
+	size_t const first_connection = fds.size();
 
-	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	//read from each connection (and possibly write):
+	for (auto &c : connections) {
 		if (c.socket != InvalidSocket) {
-			max = std::max(max, int(c.socket));
-			FD_SET(c.socket, &read_fds);
-			if (!c.send_buffer.empty()) {
-				FD_SET(c.socket, &write_fds);
+			fds.emplace_back();
+			fds.back().fd = c.socket;
+			fds.back().events = POLLIN;
+			if (!c.send_buffer.empty() || !c.send_queue.empty() || c.connecting) {
+				fds.back().events |= POLLOUT;
 			}
+			fds.back().revents = 0;
+			polled.emplace_back(&c);
 		}
 	}
 
 	{ //wait (until timeout) for sockets' data to become available:
-		struct timeval tv;
-		tv.tv_sec = std::lround(std::floor(timeout));
-		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
-		//NOTE: on windows nfds is ignored -- https://msdn.microsoft.com/en-us/library/windows/desktop/ms740141(v=vs.85).aspx
-		int ret = select(max + 1, &read_fds, &write_fds, NULL, &tv);
+		int ms = int(std::ceil(timeout * 1000.0));
+		int ret = poll_sockets(fds.data(), fds.size(), ms);
 
 		if (ret < 0) {
-			std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
+			std::cerr << "[" << where << "] Poll returned an error; will attempt to read/write anyway." << std::endl;
+			for (auto &fd : fds) fd.revents = fd.events;
 		} else if (ret == 0) {
 			//nothing to read or write.
 			return;
 		}
 	}
+	auto readable = [&](size_t i) { return (fds[first_connection + i].revents & (POLLIN | POLLHUP | POLLERR)) != 0; };
+	auto writable = [&](size_t i) { return (fds[first_connection + i].revents & POLLOUT) != 0; };
 
 	//add new connections as needed:
-	if (listen_socket != InvalidSocket && FD_ISSET(listen_socket, &read_fds)) {
-		Socket got = accept(listen_socket, NULL, NULL);
+	for (uint32_t l = 0; l < listen_sockets.size(); ++l) {
+		if (!(fds[l].revents & POLLIN)) continue;
+		Socket got = accept(listen_sockets[l], NULL, NULL);
 		if (got == InvalidSocket) {
 			//oh well.
 		} else {
@@ -113,19 +176,38 @@ void poll_connections(
 			#endif
 				connections.emplace_back();
 				connections.back().socket = got;
+				connections.back().listener = l;
 				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
 				if (on_event) on_event(&connections.back(), Connection::OnOpen);
 			}
 		}
 	}
 
+	//connections still connecting are done once writable (or errored); the socket says which:
+	for (size_t i = 0; i < polled.size(); ++i) {
+		Connection &c = *polled[i];
+		if (c.socket == InvalidSocket || !c.connecting) continue;
+		if (!(fds[first_connection + i].revents & (POLLOUT | POLLHUP | POLLERR))) continue;
+		int error = 0;
+		socklen_t size = sizeof(error);
+		if (getsockopt(c.socket, SOL_SOCKET, SO_ERROR, reinterpret_cast< char * >(&error), &size) != 0) error = errno;
+		if (error == 0) {
+			c.connecting = false;
+			continue;
+		}
+		std::cerr << "[" << where << "] connect failed (" << strerror(error) << "), disconnecting." << std::endl;
+		c.close();
+		if (on_event) on_event(&c, Connection::OnClose);
+	}
+
 	const uint32_t BufferSize = 20000;
 	static thread_local char *buffer = new char[BufferSize];
 
 	//process requests:
-	for (auto &c : connections) {
-		//only read from valid sockets marked readable:
-		if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
+	for (size_t i = 0; i < polled.size(); ++i) {
+		Connection &c = *polled[i];
+		//only read from valid (connected) sockets marked readable:
+		if (c.socket == InvalidSocket || c.connecting || !readable(i)) continue;
 
 		ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
 		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
@@ -148,28 +230,46 @@ void poll_connections(
 	}
 
 	//process responses:
-	for (auto &c : connections) {
-		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+	for (size_t i = 0; i < polled.size(); ++i) {
+		Connection &c = *polled[i];
+		//don't bother with connections unless they are valid (and connected) and are marked writable:
+		if (c.socket == InvalidSocket || c.connecting || !writable(i)) continue;
+
+		//send queued shared payloads, then send_buffer, until the socket stops taking data:
+		while (!c.send_queue.empty() || !c.send_buffer.empty()) {
+			bool shared = !c.send_queue.empty();
+			char const *data = shared ? c.send_queue.front()->data() + c.send_queue_offset : c.send_buffer.data();
+			size_t size = shared ? c.send_queue.front()->size() - c.send_queue_offset : c.send_buffer.size();
+
+			#ifdef _WIN32
+			ssize_t ret = send(c.socket, data, int(size), MSG_DONTWAIT);
+			#else
+			ssize_t ret = send(c.socket, data, size, MSG_DONTWAIT);
+			#endif 
+			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				//~no problem~, but don't keep trying this connection
+				break;
+			} else if (ret <= 0 || ret > (ssize_t)size) {
+				if (ret < 0) {
+					std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+				} else { assert(ret == 0 || ret > (ssize_t)size);
+					std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << size << "], disconnecting." << std::endl;
+				}
+				c.close();
+				if (on_event) on_event(&c, Connection::OnClose);
+				break;
+			} else { //ret seems reasonable
+				if (shared) {
+					c.send_queue_offset += ret;
+					if (c.send_queue_offset == c.send_queue.front()->size()) {
+						c.send_queue.pop_front();
+						c.send_queue_offset = 0;
+					}
+				} else {
+					c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+				}
+				if (size_t(ret) < size) break; //socket buffer is full
 			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
 		}
 	}
 
@@ -179,16 +279,95 @@ void poll_connections(
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+//connect to 'host' at 'port' (throws on failure):
+// (without 'wait', the socket is non-blocking and may still be connecting; addresses after one that didn't fail right away aren't tried)
+static Socket connect_to(std::string const &host, std::string const &port, bool wait = true) {
+	Socket connected = InvalidSocket;
 
-	#ifdef _WIN32
-	{ //init winsock:
-		WSADATA info;
-		if (WSAStartup((2 << 8) | 2, &info) != 0) {
-			throw std::runtime_error("WSAStartup failed.");
+	{ //use getaddrinfo to look up how to bind to host/port:
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		struct addrinfo *res = nullptr;
+		int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+		if (ret != 0) {
+			throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+		}
+
+		std::cout << "[connect_to] connecting to " << host << ":" << port << ":" << std::endl;
+		//based on example code in the 'man getaddrinfo' man page on OSX:
+		for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+			{ //DEBUG: dump info about this address:
+				std::cout << "\ttrying ";
+				char ip[INET6_ADDRSTRLEN];
+				if (info->ai_family == AF_INET) {
+					struct sockaddr_in *s = reinterpret_cast< struct sockaddr_in * >(info->ai_addr);
+					inet_ntop(res->ai_family, &s->sin_addr, ip, sizeof(ip));
+					std::cout << ip << ":" << ntohs(s->sin_port);
+				} else if (info->ai_family == AF_INET6) {
+					struct sockaddr_in6 *s = reinterpret_cast< struct sockaddr_in6 * >(info->ai_addr);
+					inet_ntop(res->ai_family, &s->sin6_addr, ip, sizeof(ip));
+					std::cout << ip << ":" << ntohs(s->sin6_port);
+				} else {
+					std::cout << "[unknown ai_family]";
+				}
+				std::cout << "... "; std::cout.flush();
+			}
+
+			Socket s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+			if (s == InvalidSocket) {
+				std::cout << "(failed to create socket: " << strerror(errno) << ")" << std::endl;
+				continue;
+			}
+			if (!wait) {
+				#ifdef _WIN32
+				unsigned long one = 1;
+				if (0 != ioctlsocket(s, FIONBIO, &one)) {
+				#else
+				if (fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) < 0) {
+				#endif
+					std::cout << "(failed to make socket non-blocking)" << std::endl;
+					closesocket(s);
+					continue;
+				}
+			}
+			int ret = connect(s, info->ai_addr, int(info->ai_addrlen));
+			#ifdef _WIN32
+			bool in_progress = (ret < 0 && WSAGetLastError() == WSAEWOULDBLOCK);
+			#else
+			bool in_progress = (ret < 0 && errno == EINPROGRESS);
+			#endif
+			if (!wait && in_progress) {
+				std::cout << "in progress." << std::endl;
+				connected = s;
+				break;
+			}
+			if (ret < 0) {
+				std::cout << "(failed to connect: " << strerror(errno) << ")" << std::endl;
+				closesocket(s);
+				continue;
+			}
+			std::cout << "success!" << std::endl;
+
+			connected = s;
+			break;
+		}
+
+		freeaddrinfo(res);
+
+		if (connected == InvalidSocket) {
+			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
-	#endif
+	return connected;
+}
+
+//bind a listening socket to 'port' (throws on failure):
+static Socket listen_on(std::string const &port) {
+	Socket listen_socket = InvalidSocket;
 
 	{ //use getaddrinfo to look up how to bind to port:
 		struct addrinfo hints;
@@ -261,16 +440,74 @@ Server::Server(std::string const &port) {
 	}
 
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		int ret = ::listen(listen_socket, SOMAXCONN);
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+	return listen_socket;
+}
+
+Server::Server(std::string const &port) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	listen_sockets.emplace_back(listen_on(port));
+}
+
+Server::Server() {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+}
+
+Connection *Server::connect(std::string const &host, std::string const &port, bool wait) {
+	Socket s = connect_to(host, port, wait);
+	#ifdef _WIN32
+	unsigned long one = 1;
+	if (wait && 0 != ioctlsocket(s, FIONBIO, &one)) {
+		closesocket(s);
+		throw std::runtime_error("Failed to make connection non-blocking.");
+	}
+	#endif
+	connections.emplace_back();
+	connections.back().socket = s;
+	connections.back().listener = Outgoing;
+	connections.back().connecting = !wait; //(poll() checks, even if it already has)
+	return &connections.back();
+}
+
+uint32_t Server::listen(std::string const &port) {
+	listen_sockets.emplace_back(listen_on(port));
+	return uint32_t(listen_sockets.size() - 1);
+}
+
+uint32_t Server::adopt_listener(Socket listen_socket) {
+	listen_sockets.emplace_back(listen_socket);
+	return uint32_t(listen_sockets.size() - 1);
+}
+
+Connection *Server::adopt(Socket socket, uint32_t listener) {
+	connections.emplace_back();
+	connections.back().socket = socket;
+	connections.back().listener = listener;
+	return &connections.back();
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	poll_connections("Server::poll", connections, on_event, timeout, listen_sockets);
 
 	//reap closed clients:
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
@@ -282,7 +519,7 @@ void Server::poll(std::function< void(Connection *, Connection::Event event) > c
 	}
 }
 
-Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+Client::Client(std::string const &host_, std::string const &port_) : connections(1), connection(connections.front()), host(host_), port(port_) {
 	#ifdef _WIN32
 	{ //init winsock:
 		WSADATA info;
@@ -292,65 +529,59 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 	}
 	#endif
 
-	{ //use getaddrinfo to look up how to bind to host/port:
-		struct addrinfo hints;
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = IPPROTO_TCP;
-
-		struct addrinfo *res = nullptr;
-		int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
-		if (ret != 0) {
-			throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
-		}
+	connection.socket = connect_to(host, port);
+}
 
-		std::cout << "[Client::Client] connecting to " << host << ":" << port << ":" << std::endl;
-		//based on example code in the 'man getaddrinfo' man page on OSX:
-		for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
-			{ //DEBUG: dump info about this address:
-				std::cout << "\ttrying ";
-				char ip[INET6_ADDRSTRLEN];
-				if (info->ai_family == AF_INET) {
-					struct sockaddr_in *s = reinterpret_cast< struct sockaddr_in * >(info->ai_addr);
-					inet_ntop(res->ai_family, &s->sin_addr, ip, sizeof(ip));
-					std::cout << ip << ":" << ntohs(s->sin_port);
-				} else if (info->ai_family == AF_INET6) {
-					struct sockaddr_in6 *s = reinterpret_cast< struct sockaddr_in6 * >(info->ai_addr);
-					inet_ntop(res->ai_family, &s->sin6_addr, ip, sizeof(ip));
-					std::cout << ip << ":" << ntohs(s->sin6_port);
-				} else {
-					std::cout << "[unknown ai_family]";
-				}
-				std::cout << "... "; std::cout.flush();
-			}
+void Client::reconnect() {
+	connection.close();
+	connection = Connection();
+	connection.socket = connect_to(host, port);
+}
 
-			Socket s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
-			if (s == InvalidSocket) {
-				std::cout << "(failed to create socket: " << strerror(errno) << ")" << std::endl;
-				continue;
-			}
-			int ret = connect(s, info->ai_addr, int(info->ai_addrlen));
-			if (ret < 0) {
-				std::cout << "(failed to connect: " << strerror(errno) << ")" << std::endl;
-				continue;
-			}
-			std::cout << "success!" << std::endl;
+void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	poll_connections("Client::poll", connections, on_event, timeout);
+}
 
-			connection.socket = s;
-			break;
-		}
 
-		freeaddrinfo(res);
+//---------------------------------
 
-		if (!connection) {
-			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
-		}
+SocketWatch::SocketWatch(std::function< void() > const &wake_) : wake(wake_), thread([this](){
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		armed_cv.wait(lock, [this](){ return quit || armed; });
+		if (quit) break;
+		pollfd fd;
+		fd.fd = socket;
+		fd.events = POLLIN | (writing ? POLLOUT : 0);
+		fd.revents = 0;
+		lock.unlock();
+		//(gives up now and then to pick up a new socket from arm(), or to quit)
+		int ret = poll_sockets(&fd, 1, 100);
+		lock.lock();
+		if (ret == 0 || !armed) continue;
+		armed = false;
+		lock.unlock();
+		wake();
+		lock.lock();
 	}
+}) {
 }
 
-
-void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+SocketWatch::~SocketWatch() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	armed_cv.notify_one();
+	thread.join();
 }
 
+void SocketWatch::arm(Socket socket_, bool writing_) {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		socket = socket_;
+		writing = writing_;
+		armed = (socket_ != InvalidSocket);
+	}
+	armed_cv.notify_one();
+}
@@ -62,8 +62,13 @@ int main(int argc, char **argv) {
 
 #include <vector>
 #include <list>
+#include <deque>
+#include <memory>
 #include <string>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 //Thin wrapper around a (polling-based) TCP socket connection:
 struct Connection {
@@ -77,6 +82,21 @@ struct Connection {
 		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
 	}
 
+	//Immutable bytes that can be queued on many connections at once (serialize once, send to all):
+	using Payload = std::shared_ptr< std::vector< char > const >;
+	//Queue a shared payload to be sent after anything already in send_buffer:
+	void send_shared(Payload const &payload);
+
+	//Bytes waiting to be sent (send_buffer plus queued payloads):
+	size_t pending_send() const;
+
+	//Smoothed round-trip time in milliseconds as measured by the OS (0 where unavailable):
+	uint32_t rtt_ms() const;
+
+	//Milliseconds since the peer last acknowledged anything, if something sent is still unacknowledged
+	// (0 if everything sent has been acknowledged, or where the OS doesn't say):
+	uint32_t unacknowledged_ms() const;
+
 	//Call 'close' to mark a connection for discard:
 	void close();
 
@@ -88,8 +108,14 @@ struct Connection {
 	//When the connection receives data, it is appended to recv_buffer:
 	std::vector< char > recv_buffer;
 
+	//Shared payloads, sent before send_buffer (see send_shared):
+	std::deque< Payload > send_queue;
+	size_t send_queue_offset = 0; //bytes of send_queue.front() already sent
+
 	//internals:
 	Socket socket = InvalidSocket;
+	uint32_t listener = 0; //which of the Server's listen_sockets accepted this connection (Server::Outgoing if made by Server::connect)
+	bool connecting = false; //made by Server::connect without waiting, and not connected yet (still set in an OnClose if it never was)
 
 	enum Event {
 		OnOpen,
@@ -100,6 +126,15 @@ struct Connection {
 
 struct Server {
 	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	Server(); //listen on nothing (yet); useful for managing many outgoing connections
+
+	//open a connection to host:port (throws on failure); it is polled along with accepted connections:
+	// (no OnOpen event is sent for it; OnRecv and OnClose are)
+	//without 'wait', only starts connecting (to the first address that doesn't fail right away): what is sent
+	// waits in send_buffer until poll() finds the connect done, and a connect that fails is reported as
+	// an OnClose with 'connecting' still set. (The lookup itself may still block unless 'host' is numeric.)
+	Connection *connect(std::string const &host, std::string const &port, bool wait = true);
+	static constexpr uint32_t Outgoing = ~0u; //Connection::listener of connections made with connect()
 
 	//poll() updates the list of active connections and provides information to your callbacks:
 	void poll(
@@ -107,14 +142,25 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//listen on an additional port (e.g., for an admin endpoint); returns the index reported in Connection::listener:
+	uint32_t listen(std::string const &port);
+
+	//take over sockets opened elsewhere (e.g., handed over by a previous server process; see Handoff.hpp):
+	// (a listening socket gets the next Connection::listener index; no OnOpen event is sent for a connection)
+	uint32_t adopt_listener(Socket listen_socket);
+	Connection *adopt(Socket socket, uint32_t listener);
+
 	std::list< Connection > connections;
-	Socket listen_socket = InvalidSocket;
+	std::vector< Socket > listen_sockets; //[0] is the port passed to the constructor
 };
 
 
 struct Client {
 	Client(std::string const &host, std::string const &port);
 
+	//drop the connection (if still open) and its buffers, and connect to the same host and port again (throws on failure):
+	void reconnect();
+
 	//poll() checks the status of the active connection and provides information to your callbacks:
 	void poll(
 		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
@@ -123,4 +169,27 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+	std::string host, port;
+};
+
+//Watches a socket on a thread of its own, so that a loop waiting on something else (e.g., window events) can be woken by the network:
+// (it never reads or writes the socket; whoever is woken polls the connection as usual)
+struct SocketWatch {
+	//'wake' is called on the watching thread, once per arm(), when the socket is ready:
+	explicit SocketWatch(std::function< void() > const &wake);
+	~SocketWatch();
+
+	//watch 'socket' until there is something to read (or, if 'writing', room to write):
+	// (call again after each wake, and after reconnecting; an InvalidSocket stops watching)
+	void arm(Socket socket, bool writing);
+
+private:
+	std::function< void() > wake;
+	std::mutex mutex;
+	std::condition_variable armed_cv;
+	Socket socket = InvalidSocket;
+	bool writing = false;
+	bool armed = false;
+	bool quit = false;
+	std::thread thread; //(last, so it starts after the fields above are set)
 };
@@ -0,0 +1,126 @@
+#include "Delta.hpp"
+
+#include <zlib.h>
+
+#include <cstring>
+
+namespace Delta {
+
+constexpr size_t Overhead = 3; //type, mode and size bytes of a short 'U'
+
+static void put_varint(std::vector< char > &to, size_t v) {
+	while (v >= 0x80) {
+		to.push_back(char((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	to.push_back(char(v));
+}
+
+//append 'body' as a 'U' in 'mode', deflated if it's long enough for that to pay:
+static void send(std::vector< char > &to, uint8_t mode, char const *body, size_t size) {
+	if (size >= DeflateMin) {
+		static thread_local std::vector< char > deflated;
+		deflated.clear();
+		put_varint(deflated, size);
+		size_t at = deflated.size();
+		uLongf used = compressBound(uLong(size));
+		deflated.resize(at + used);
+		if (compress2(reinterpret_cast< Bytef * >(deflated.data() + at), &used, reinterpret_cast< Bytef const * >(body), uLong(size), Z_BEST_SPEED) == Z_OK
+		 && at + used < size) {
+			Protocol::send_delta(to, uint8_t(mode | Deflated), deflated.data(), at + used);
+			return;
+		}
+	}
+	Protocol::send_delta(to, mode, body, size);
+}
+
+bool encode(std::vector< char > &to, Baseline &baseline, char const *update, size_t size) {
+	if (size == 0) return false;
+	bool repeated = (size == baseline.previous.size() && std::memcmp(update, baseline.previous.data(), size) == 0);
+	if (!repeated) baseline.previous.assign(update, update + size);
+	std::vector< char > &old = baseline.bytes;
+	if (baseline.known && size == old.size() && std::memcmp(update, old.data(), size) == 0) {
+		Protocol::send_repeat(to);
+		return true;
+	}
+
+	//length, a bit per byte, then the changed bytes XOR'd with the baseline:
+	static thread_local std::vector< char > body;
+	body.clear();
+	if (baseline.known) {
+		put_varint(body, size);
+		size_t mask = body.size();
+		body.resize(mask + (size + 7) / 8, 0);
+		for (size_t i = 0; i < size; ++i) {
+			char x = char(update[i] ^ (i < old.size() ? old[i] : 0));
+			if (x == 0) continue;
+			body[mask + i / 8] |= char(1 << (i % 8));
+			body.push_back(x);
+		}
+	}
+	bool masked = (baseline.known && body.size() < size);
+	//(a 'U' costs a few bytes more than the update itself unless masking saves them: worth it only if this
+	// update is likely to be repeated, as one that was just sent twice is)
+	if (!repeated && Overhead + (masked ? body.size() : size) >= size) {
+		to.insert(to.end(), update, update + size);
+		return false;
+	}
+	if (masked) {
+		send(to, Masked, body.data(), body.size());
+	} else {
+		send(to, Full, update, size);
+	}
+	old.assign(update, update + size);
+	baseline.known = true;
+	return true;
+}
+
+void encode_full(std::vector< char > &to, char const *update, size_t size) {
+	if (size == 0) return;
+	send(to, Full, update, size);
+}
+
+bool decode(Protocol::Frame const &m, Baseline &baseline) {
+	if (m.data[0] == Protocol::ToClient::messages[Protocol::ToClient::Repeat].type) return true;
+
+	uint8_t mode = m.field(0);
+	char const *body = m.payload();
+	size_t size = m.payload_size();
+	if (mode & Deflated) {
+		static thread_local std::vector< char > inflated;
+		uint32_t unpacked = 0;
+		int32_t used = Protocol::read_varint(body, size, &unpacked);
+		//(a masked body is at most a varint, a mask and every byte)
+		if (used <= 0 || unpacked > 4 + MaxUpdate + MaxUpdate / 8) return false;
+		inflated.resize(unpacked);
+		uLongf out = unpacked;
+		if (uncompress(reinterpret_cast< Bytef * >(inflated.data()), &out, reinterpret_cast< Bytef const * >(body + used), uLong(size - used)) != Z_OK
+		 || out != unpacked) return false;
+		body = inflated.data();
+		size = unpacked;
+		mode &= ~Deflated;
+	}
+
+	std::vector< char > &bytes = baseline.bytes;
+	if (mode == Full) {
+		if (size > MaxUpdate) return false;
+		bytes.assign(body, body + size);
+		return true;
+	}
+	if (mode != Masked) return false;
+	uint32_t length = 0;
+	int32_t used = Protocol::read_varint(body, size, &length);
+	if (used <= 0 || length > MaxUpdate) return false;
+	size_t mask = size_t(used);
+	size_t at = mask + (length + 7) / 8;
+	if (at > size) return false;
+	bytes.resize(length, 0);
+	for (size_t i = 0; i < length; ++i) {
+		if (!((body[mask + i / 8] >> (i % 8)) & 1)) continue;
+		if (at >= size) return false;
+		bytes[i] ^= body[at++];
+	}
+	return at == size;
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Delta encodes the state updates sent to clients granted Protocol::CapCompression.
+ *
+ * The server sends every seat its whole view of the table each tick, and from one tick to the
+ * next that view rarely changes. So each update is sent against the last one the client was sent
+ * this way (its baseline): as 'u' if nothing changed, or as 'U' carrying either the whole update
+ * or, when fewer bytes changed than that, a bitmask of the changed bytes and their XOR with the
+ * baseline. Large bodies (8-seat spectator feeds) are also deflated when that helps.
+ *
+ * A 'U' is a few bytes longer than the update it carries, which only pays off if the update is
+ * then repeated. So an update that changed is sent as it is (leaving the baseline alone) unless
+ * masking makes it shorter, and only once it has been sent twice does it become the baseline.
+ *
+ * There are no acknowledgements: the connection delivers bytes in order, so a client decoding an
+ * update has always decoded the one it was encoded against. Whenever the sender can't be sure of
+ * that (a new connection, a session resumed from after what its replay buffer holds, a spectator
+ * shown a new table) it forgets the baseline, and the next 'U' carries a whole update.
+ *
+ * Messages ('u' and 'U' are Protocol::ToClient::Repeat and ::Delta):
+ *   |u |                      the update is the baseline again
+ *   |U |mode|size|body...|    the update is 'body' (mode Full), or (mode Masked):
+ *                             | length (varint) | mask: a bit per byte, 1 if changed | XOR of each changed byte |
+ *                             with mode | Deflated, the body is | unpacked size (varint) | zlib stream |
+ * Bytes past the end of the baseline count as 0. Empty updates are not sent at all.
+ */
+
+#include "Protocol.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Delta {
+
+enum Mode : uint8_t {
+	Full = 0,
+	Masked = 1,
+	Deflated = 0x80, //(or'd with the above)
+};
+constexpr size_t DeflateMin = 128; //bodies shorter than this are never worth deflating
+constexpr size_t MaxUpdate = size_t(1) << 20; //largest update a receiver will rebuild
+
+//the last update one side sent (or received) as a delta:
+struct Baseline {
+	std::vector< char > bytes;
+	bool known = false; //(sender) the receiver is known to hold 'bytes'
+	std::vector< char > previous; //(sender) the last update, however it was sent
+};
+
+//append 'update' to 'to' as a 'u' or 'U' against 'baseline', or as it is:
+// returns true if the receiver's baseline is now 'update' (it was sent as 'u' or 'U')
+bool encode(std::vector< char > &to, Baseline &baseline, char const *update, size_t size);
+
+//append 'update' to 'to' as a whole 'U' (for a receiver whose baseline isn't known):
+void encode_full(std::vector< char > &to, char const *update, size_t size);
+
+//rebuild the update a 'u' or 'U' carries into 'baseline.bytes':
+// returns false if the message is malformed (the baseline is then unusable)
+bool decode(Protocol::Frame const &m, Baseline &baseline);
+
+}
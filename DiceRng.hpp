@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * DiceRng is a small, fast, seedable generator for rolling dice (xoshiro256**).
+ *
+ * Each table owns one, seeded from a recorded 64-bit seed, so a game can be replayed
+ * exactly and tables never contend for a shared generator. Bounded values use
+ * Lemire's multiply-and-reject method, so every face is exactly equally likely.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+struct DiceRng {
+	using result_type = uint64_t;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	explicit DiceRng(uint64_t seed_ = 0) { seed(seed_); }
+
+	//expand 'seed' into the full state with splitmix64 (any seed, including 0, is fine):
+	void seed(uint64_t seed) {
+		for (auto &s : state) {
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			s = z ^ (z >> 31);
+		}
+	}
+
+	uint64_t operator()() {
+		uint64_t result = rotl(state[1] * 5, 7) * 9;
+		uint64_t t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 45);
+		return result;
+	}
+
+	//uniform in [0, range), range > 0:
+	uint32_t bounded(uint32_t range) {
+		uint64_t m = uint64_t(uint32_t((*this)() >> 32)) * range;
+		if (uint32_t(m) < range) {
+			//reject the few low values that would make some results more likely:
+			uint32_t threshold = uint32_t(-range) % range;
+			while (uint32_t(m) < threshold) {
+				m = uint64_t(uint32_t((*this)() >> 32)) * range;
+			}
+		}
+		return uint32_t(m >> 32);
+	}
+
+	//true with probability p:
+	bool chance(float p) {
+		return float((*this)() >> 40) < p * float(1u << 24);
+	}
+
+	//roll 'count' six-sided dice (values 1-6) into 'dices':
+	// each draw is two 32-bit halves of ten dice apiece, by Lemire's method with range 6^10. That
+	// range fits 2^32 71.03 times, so a half is rejected (and the next one used) 0.04% of the time.
+	// (6^12 would have fit only 1.97 times, rejecting 49% of halves.) A two-player table is one draw.
+	void roll(uint8_t *dices, uint32_t count) {
+		constexpr uint32_t PerHalf = 10;
+		constexpr uint32_t Range = 60466176u; //6^10
+		constexpr uint32_t Threshold = uint32_t(-Range) % Range; //(2^32 mod 6^10)
+		while (count > 0) {
+			uint64_t bits = (*this)();
+			for (uint32_t half = 0; half < 2 && count > 0; ++half, bits <<= 32) {
+				uint64_t m = uint64_t(uint32_t(bits >> 32)) * Range;
+				if (uint32_t(m) < Threshold) continue;
+				uint32_t draw = uint32_t(m >> 32);
+				uint32_t n = (count < PerHalf ? count : PerHalf);
+				for (uint32_t i = 0; i < n; ++i) {
+					*dices++ = uint8_t(draw % 6 + 1);
+					draw /= 6;
+				}
+				count -= n;
+			}
+		}
+	}
+
+	uint64_t state[4];
+
+private:
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+};
+
+//roll 'per_table' dice for each of 'tables' tables (stored back to back), each table from its own generator:
+inline void roll_tables(DiceRng *rngs, uint8_t *dices, uint32_t tables, uint32_t per_table) {
+	for (uint32_t t = 0; t < tables; ++t) {
+		rngs[t].roll(dices + size_t(t) * per_table, per_table);
+	}
+}
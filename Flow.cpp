@@ -0,0 +1,74 @@
+#include "Flow.hpp"
+
+#ifdef GAME_COROUTINES
+
+#include <atomic>
+#include <new>
+
+//frames are rounded up to a multiple of Granule and served from per-thread free lists up to MaxPooled:
+static constexpr size_t Granule = 64;
+static constexpr size_t MaxPooled = 1024;
+static constexpr size_t Classes = MaxPooled / Granule;
+static constexpr size_t SlabSize = 64 * 1024;
+
+static std::atomic< size_t > reserved_bytes{0};
+static std::atomic< size_t > live_frames{0};
+
+namespace {
+	struct FreeFrame {
+		FreeFrame *next;
+	};
+	struct ThreadFrames {
+		FreeFrame *free[Classes] = {};
+		char *slab = nullptr; //unused tail of the current slab
+		size_t slab_left = 0;
+	};
+}
+//(slabs are never handed back: a frame may be freed on another thread, or outlive the thread that made it)
+static thread_local ThreadFrames pool;
+
+void *FramePool::allocate(size_t size) {
+	live_frames += 1;
+	if (size > MaxPooled) {
+		reserved_bytes += size;
+		return ::operator new(size);
+	}
+	size_t c = (size + Granule - 1) / Granule - 1;
+	if (FreeFrame *frame = pool.free[c]) {
+		pool.free[c] = frame->next;
+		return frame;
+	}
+	size_t bytes = (c + 1) * Granule;
+	if (pool.slab_left < bytes) {
+		pool.slab = static_cast< char * >(::operator new(SlabSize));
+		pool.slab_left = SlabSize;
+		reserved_bytes += SlabSize;
+	}
+	void *frame = pool.slab;
+	pool.slab += bytes;
+	pool.slab_left -= bytes;
+	return frame;
+}
+
+void FramePool::release(void *frame, size_t size) {
+	live_frames -= 1;
+	if (size > MaxPooled) {
+		reserved_bytes -= size;
+		::operator delete(frame);
+		return;
+	}
+	size_t c = (size + Granule - 1) / Granule - 1;
+	FreeFrame *free = static_cast< FreeFrame * >(frame);
+	free->next = pool.free[c];
+	pool.free[c] = free;
+}
+
+size_t FramePool::reserved() {
+	return reserved_bytes;
+}
+
+size_t FramePool::live() {
+	return live_frames;
+}
+
+#endif //GAME_COROUTINES
@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * Flow is a minimal C++20 coroutine type for code that waits on events, so a sequence like
+ * "wait until everyone is ready, roll, wait a tick, play turns until someone calls" can be
+ * written top to bottom instead of as a state byte checked from several places.
+ *
+ * Only built in the opt-in C++20 mode (jam -sCOROUTINES=1, which defines GAME_COROUTINES).
+ *
+ * A Flow starts running as soon as it is called, until its first co_await. Whoever owns
+ * it delivers events by storing them where the flow can see them and calling resume();
+ * the flow picks them up with co_await next(slot). Flows never run on their own, so they
+ * fit into whatever loop drives their owner (server.cpp's poll loop and tick timer, or
+ * replay.cpp's session log), and resuming one is an ordinary function call.
+ *
+ * Frames come from FramePool, a per-thread free list of fixed size classes carved from
+ * large slabs, so a hundred thousand suspended flows cost their frames and nothing else
+ * (no per-frame malloc header, no fragmentation).
+ */
+
+#ifdef GAME_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+namespace FramePool {
+	void *allocate(size_t size);
+	void release(void *frame, size_t size);
+
+	//----- stats (all threads, since startup) -----
+	//bytes taken from the system for frames (slabs, plus frames too big for a size class):
+	size_t reserved();
+	//frames currently allocated:
+	size_t live();
+}
+
+struct Flow {
+	struct promise_type {
+		Flow get_return_object() { return Flow(std::coroutine_handle< promise_type >::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; } //(the Flow destroys the frame)
+		void return_void() { }
+		void unhandled_exception() { throw; } //(propagates out of resume())
+
+		static void *operator new(size_t size) { return FramePool::allocate(size); }
+		static void operator delete(void *frame, size_t size) { FramePool::release(frame, size); }
+	};
+
+	Flow() = default;
+	explicit Flow(std::coroutine_handle< promise_type > handle_) : handle(handle_) { }
+	Flow(Flow &&from) : handle(std::exchange(from.handle, nullptr)) { }
+	Flow &operator=(Flow &&from) {
+		if (this != &from) {
+			if (handle) handle.destroy();
+			handle = std::exchange(from.handle, nullptr);
+		}
+		return *this;
+	}
+	Flow(Flow const &) = delete;
+	Flow &operator=(Flow const &) = delete;
+	~Flow() {
+		if (handle) handle.destroy();
+	}
+
+	explicit operator bool() const { return bool(handle); }
+	bool done() const { return handle.done(); }
+
+	//run the flow until its next co_await (or its end):
+	void resume() { handle.resume(); }
+
+	std::coroutine_handle< promise_type > handle;
+};
+
+//co_await next(slot): suspend until the owner resumes the flow, then read what it left in 'slot':
+template< typename T >
+struct Next {
+	T const &slot;
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<>) const noexcept { }
+	T await_resume() const { return slot; }
+};
+template< typename T >
+Next< T > next(T const &slot) { return Next< T >{slot}; }
+
+#endif //GAME_COROUTINES
@@ -0,0 +1,411 @@
+#include "Game.hpp"
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+void game_start(uint8_t *dices, uint32_t count, DiceRng &rng) {
+	rng.roll(dices, count);
+}
+
+bool check_result(uint8_t const *dices, uint32_t count, uint8_t dice_num, uint8_t dice_point) {
+	for (uint32_t i = 0; i < count; i++) {
+		if (dices[i] == dice_point) {
+			dice_num -= 1;
+			if (dice_num == 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static uint8_t lowest_free_id(std::list< Game::Player > const &players) {
+	uint8_t player_id = 0;
+	while (std::any_of(players.begin(), players.end(), [&](Game::Player const &p) { return p.player_id == player_id; })) {
+		player_id += 1;
+	}
+	return player_id;
+}
+
+Game::Game(uint32_t seed_, uint32_t seats_) : seed(seed_), seats(seats_), rng(seed_) {
+	assert(seats >= DefaultSeats && seats <= MaxSeats);
+	dices.fill(1);
+	revealed.fill(0);
+}
+
+Game::Player *Game::add_player() {
+	uint8_t player_id = lowest_free_id(players);
+	players.emplace_back();
+	players.back().player_id = player_id;
+	return &players.back();
+}
+
+static Game::Player &seat_bot(Game &game, uint8_t player_id) {
+	Game::Player &player = game.players.emplace_back();
+	player.player_id = player_id;
+	player.bot = true;
+	player.name = "Bot " + std::to_string(player_id + 1);
+	game.player_name.push_back(player.name);
+	return player;
+}
+
+void Game::remove_player(Player *player) {
+	auto f = std::find_if(players.begin(), players.end(), [&](Player const &p) { return &p == player; });
+	assert(f != players.end());
+	auto name = std::find(player_name.begin(), player_name.end(), f->name);
+	if (name != player_name.end()) player_name.erase(name);
+	//a seat left mid-game is played out by a bot (with the same dice), so the game doesn't wait on it:
+	bool stand_in = !f->spectator && (state == 1 || state == 2);
+	uint8_t player_id = f->player_id;
+	players.erase(f);
+	if (stand_in) {
+		seat_bot(*this, player_id);
+		run_bots(); //(in case it was the bot's turn)
+	}
+}
+
+Game::Player *Game::add_bot() {
+	Player &player = seat_bot(*this, lowest_free_id(players));
+	start_if_ready(); //(bots are always ready)
+	return &player;
+}
+
+uint32_t Game::seated() const {
+	return uint32_t(std::count_if(players.begin(), players.end(), [](Player const &p) { return !p.spectator; }));
+}
+
+void Game::start_if_ready() {
+#ifdef GAME_COROUTINES
+	wake(Event::Start);
+#else
+	if (ready_to_start()) roll();
+#endif
+}
+
+bool Game::ready_to_start() const {
+	//a new game starts from the waiting room or after a reveal:
+	if (state != 0 && state != 3) return false;
+	if (seated() != seats) return false;
+	for (Player const &p : players) {
+		if (!p.spectator && !p.bot && !p.ready) return false;
+	}
+	return true;
+}
+
+void Game::roll() {
+	for (Player &p : players) {
+		p.ready = false;
+	}
+	state = 1;
+	opening = true;
+	//(the claim standing until the opening one, which must raise it; see raises())
+	dice_num = 1;
+	dice_point = 1;
+	game_start(dices.data(), dice_count(), rng);
+}
+
+void Game::run_bots() {
+	//bots act immediately, so a game between bots plays out within one call:
+	while (state == 2) {
+		auto turn = std::find_if(players.begin(), players.end(), [this](Player const &p) { return p.player_id == cur_player; });
+		if (turn == players.end() || !turn->bot) break;
+		Bot::Move move = bot.decide(dice_of(turn->player_id), DicePerSeat, dice_count() - DicePerSeat, opening, dice_num, dice_point);
+		if (move.reveal) {
+			reveal(*turn);
+		} else {
+			claim(move.dice_num, move.dice_point);
+		}
+	}
+}
+
+bool Game::handle_messages(Player &player, std::vector< char > &recv_buffer, uint32_t limit) {
+	struct Context {
+		Game &game;
+		Player &player;
+	} context{*this, player};
+
+	using namespace Protocol;
+	static constexpr Handlers< Context, ToServer > handlers = {
+		//Join:
+		[](Context &ctx, Frame const &m) {
+			if (ctx.player.spectator) return false;
+			return ctx.game.join(ctx.player, std::string(m.payload(), m.payload_size()));
+		},
+		//Start: this player is ready
+		[](Context &ctx, Frame const &) {
+			if (ctx.player.spectator) return false;
+			ctx.player.ready = true;
+			ctx.game.start_if_ready();
+			return true;
+		},
+		//Claim: (out of turn, e.g. sent against an update that was already stale, it changes nothing)
+		[](Context &ctx, Frame const &m) {
+			if (ctx.player.spectator) return false;
+			if (!ctx.game.acting(ctx.player)) return true;
+			return ctx.game.claim(m.field(0), m.field(1));
+		},
+		//Reveal: (likewise out of turn, or before there is a claim to call)
+		[](Context &ctx, Frame const &) {
+			if (ctx.player.spectator) return false;
+			if (!ctx.game.acting(ctx.player) || ctx.game.opening) return true;
+			ctx.game.reveal(ctx.player);
+			return true;
+		},
+		//Hello: versioned join
+		[](Context &ctx, Frame const &m) {
+			if (ctx.player.spectator) return false;
+			//speak the older of the two versions and grant only capabilities this server has:
+			ctx.player.version = std::min(m.field(0), Version);
+			ctx.player.capabilities = m.field16(1) & ServerCapabilities;
+			ctx.player.send_welcome = true;
+			return ctx.game.join(ctx.player, std::string(m.payload(), m.payload_size()));
+		},
+		//PackedClaim:
+		[](Context &ctx, Frame const &m) {
+			if (ctx.player.spectator) return false;
+			if (!ctx.game.acting(ctx.player)) return true;
+			return ctx.game.claim(claim_num(m.field(0)), claim_point(m.field(0)));
+		},
+		//Watch: give up the seat taken on connect and spectate instead
+		[](Context &ctx, Frame const &m) {
+			if (ctx.player.spectator || !ctx.player.name.empty()) return false;
+			ctx.player.version = std::min(m.field(0), Version);
+			ctx.player.capabilities = m.field16(1) & ServerCapabilities;
+			ctx.player.send_welcome = true;
+			ctx.player.spectator = true;
+			ctx.player.player_id = NoSeat;
+			return true;
+		},
+		//Resume: only a new connection can resume a session (see server.cpp)
+		[](Context &, Frame const &) { return false; },
+	};
+
+	bool ok = dispatch< ToServer >(handlers, context, recv_buffer, &messages_handled, limit);
+#ifdef GAME_COROUTINES
+	wake(Event::Input);
+#else
+	run_bots();
+#endif
+	return ok;
+}
+
+bool Game::join(Player &player, std::string const &name) {
+	if (!player.name.empty()) return player.name == name;
+	player.name = name;
+	player_name.push_back(name);
+	return true;
+}
+
+bool Game::claim(uint8_t num, uint8_t point) {
+	if (!valid_claim(dice_count(), num, point)) return false;
+	if (!raises(num, point, dice_num, dice_point)) return false;
+	dice_num = num;
+	dice_point = point;
+	opening = false;
+	cur_player = next_player(uint8_t(cur_player), seats);
+	return true;
+}
+
+void Game::reveal(Player const &player) {
+	//(a game ends once: only a call made while playing decides it, or is rated)
+	if (state != 2) return;
+	bool holds = check_result(dices.data(), dice_count(), dice_num, dice_point);
+	winner = reveal_winner(player.player_id, seats, holds);
+	state = 3;
+	if (rated) {
+		//the call was between the revealer and the claimer, one seat back:
+		uint8_t loser = (winner == player.player_id ? previous_player(player.player_id, seats) : player.player_id);
+		auto seated_at = [this](uint8_t seat) -> Player const * {
+			for (Player const &p : players) {
+				if (!p.spectator && p.player_id == seat) return &p;
+			}
+			return nullptr;
+		};
+		Player const *won = seated_at(winner), *lost = seated_at(loser);
+		if (won && lost && !won->bot && !lost->bot) outcomes.emplace_back(Outcome{won->name, lost->name});
+	}
+	//pack once; every seat is sent the same bytes:
+	Protocol::pack_dice(dices.data(), dice_count(), revealed.data());
+}
+
+uint8_t const *Game::dice_of(uint8_t player_id) const {
+	//each player owns a six-die slice of 'dices', indexed by player_id:
+	return dices.data() + std::min(seats - 1, uint32_t(player_id)) * DicePerSeat;
+}
+
+void Game::send_handshake(Player &player, std::vector< char > &send_buffer) {
+	if (player.send_welcome) {
+		Protocol::send_welcome(send_buffer, player.version, player.capabilities);
+		player.send_welcome = false;
+	}
+}
+
+void Game::send_spectator_update(bool packed, std::vector< char > &send_buffer) const {
+	if (state == 0) {
+		//names of everyone seated, each tagged with that player's id:
+		for (Player const &p : players) {
+			if (!p.spectator && !p.name.empty()) {
+				Protocol::send_name(send_buffer, packed, p.player_id, p.name);
+			}
+		}
+	} else if (state == 2) {
+		//the claim standing on the table (a spectator is never the one to act):
+		Protocol::send_action(send_buffer, packed, false, dice_num, dice_point);
+	} else if (state == 3) {
+		//everyone's dice, one reveal per seat:
+		for (uint8_t seat = 0; seat < seats; ++seat) {
+			Protocol::send_result(send_buffer, packed, winner, dice_of(seat));
+		}
+	}
+	//(state 1: dice are private until the reveal)
+}
+
+void Game::send_update(Player &player, std::vector< char > &send_buffer) {
+	bool packed = (player.capabilities & Protocol::CapPacked);
+	send_handshake(player, send_buffer);
+	if (player.spectator) {
+		send_spectator_update(packed, send_buffer);
+		return;
+	}
+
+	bool tables = (player.capabilities & Protocol::CapTables);
+
+	if (state == 0 && tables) {
+		//the player's seat, then everyone's names, each tagged with that player's seat:
+		Protocol::send_seat(send_buffer, player.player_id, uint8_t(seats));
+		for (Player const &p : players) {
+			if (!p.spectator && !p.name.empty()) {
+				Protocol::send_name(send_buffer, packed, p.player_id, p.name);
+			}
+		}
+	} else if (state == 0) {
+		//tell the player the names of everyone else in the waiting room:
+		for (std::string const &name : player_name) {
+			if (name != player.name) {
+				Protocol::send_name(send_buffer, packed, player.player_id, name);
+			}
+		}
+	} else if (state == 1) {
+		//send inital dice states
+		Protocol::send_dice(send_buffer, packed, dice_of(player.player_id));
+	} else if (state == 3 && tables) {
+		//every seat's dice, packed once at the reveal:
+		Protocol::send_table_result(send_buffer, winner, uint8_t(seats), revealed.data());
+	} else if (state == 3) {
+		//send reveal states: the other player's dice, which a client without CapTables shows under their
+		// name (its own it has had since the roll; at a larger table, the next seat's)
+		Protocol::send_result(send_buffer, packed, winner, dice_of(next_player(player.player_id, seats)));
+	} else if (state == 2) {
+		//send action requirements
+		Protocol::send_action(send_buffer, packed, player.player_id == cur_player, dice_num, dice_point);
+	}
+}
+
+void Game::end_tick() {
+#ifdef GAME_COROUTINES
+	wake(Event::Tick);
+#else
+	if (state == 1) {
+		state = 2;
+		run_bots();
+	}
+#endif
+}
+
+#ifdef GAME_COROUTINES
+Flow Game::run_round() {
+	Event const &event = round.event;
+	while (true) {
+		if (state == 0 || state == 3) {
+			//waiting room (or the last reveal): a game starts once every seat is taken and ready
+			// (the Start that ended the last game early may be the one that begins the next)
+			while (event != Event::Start || !ready_to_start()) co_await next(event);
+			roll();
+		}
+		if (state == 1) {
+			//everyone is sent their dice this tick, and play starts after it:
+			while (state == 1 && co_await next(event) != Event::Tick) { }
+			if (state != 1) continue;
+			state = 2;
+			run_bots();
+		}
+		//turns go around the table until someone calls; bots move as soon as the players before them have:
+		while (state == 2) {
+			if (co_await next(event) == Event::Input) run_bots();
+		}
+	}
+}
+
+void Game::wake(Event event) {
+	if (!round.flow) {
+		round.event = Event::None;
+		round.flow = run_round();
+	}
+	round.event = event;
+	round.flow.resume();
+}
+#endif
+
+void Game::save(SnapshotWriter &out) const {
+	out.put(seed);
+	out.put(seats);
+	out.put(rng);
+	out.put(uint32_t(players.size()));
+	for (Player const &p : players) {
+		out.put_string(p.name);
+		out.put(p.player_id);
+		out.put(p.version);
+		out.put(p.capabilities);
+		out.put(uint8_t(p.send_welcome | (p.bot << 1) | (p.spectator << 2) | (p.ready << 3)));
+	}
+	out.put(uint32_t(player_name.size()));
+	for (std::string const &name : player_name) {
+		out.put_string(name);
+	}
+	out.put(dices);
+	out.put(cur_player);
+	out.put(dice_num);
+	out.put(dice_point);
+	out.put(winner);
+	out.put(uint8_t(opening));
+	out.put(state);
+	out.put(messages_handled);
+}
+
+void Game::load(SnapshotReader &in) {
+	seed = in.get< uint32_t >();
+	seats = in.get< uint32_t >();
+	if (seats < DefaultSeats || seats > MaxSeats) throw std::runtime_error("Snapshot has a table of an unsupported size.");
+	rng = in.get< DiceRng >();
+	players.clear();
+	for (uint32_t count = in.get< uint32_t >(); count > 0; --count) {
+		Player &p = players.emplace_back();
+		p.name = in.get_string();
+		p.player_id = in.get< uint8_t >();
+		p.version = in.get< uint8_t >();
+		p.capabilities = in.get< uint16_t >();
+		uint8_t flags = in.get< uint8_t >();
+		p.send_welcome = (flags & 1);
+		p.bot = (flags & 2);
+		p.spectator = (flags & 4);
+		p.ready = (flags & 8);
+	}
+	player_name.clear();
+	for (uint32_t count = in.get< uint32_t >(); count > 0; --count) {
+		player_name.emplace_back(in.get_string());
+	}
+	dices = in.get< decltype(dices) >();
+	cur_player = in.get< uint32_t >();
+	dice_num = in.get< uint8_t >();
+	dice_point = in.get< uint8_t >();
+	winner = in.get< uint8_t >();
+	opening = (in.get< uint8_t >() != 0);
+	state = in.get< uint8_t >();
+	messages_handled = in.get< uint64_t >();
+	revealed.fill(0);
+	if (state == 3) Protocol::pack_dice(dices.data(), dice_count(), revealed.data());
+#ifdef GAME_COROUTINES
+	round.flow = Flow(); //(restarted from the loaded state when next woken)
+#endif
+}
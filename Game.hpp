@@ -0,0 +1,213 @@
+#pragma once
+
+/*
+ * Game holds the server-side state of one table and applies client messages to it.
+ *
+ * It never touches sockets: server.cpp feeds it the bytes from each Connection's
+ * recv_buffer and asks it for each player's per-tick update, and replay.cpp does
+ * the same from a recorded SessionLog. Given the same seed and the same inbound
+ * bytes, a Game always produces the same outbound bytes.
+ */
+
+#include <array>
+#include <vector>
+#include <list>
+#include <string>
+#include <cstdint>
+
+#include "Protocol.hpp"
+#include "Bot.hpp"
+#include "DiceRng.hpp"
+
+#ifdef GAME_COROUTINES
+#include "Flow.hpp"
+#endif
+
+struct SnapshotWriter;
+struct SnapshotReader;
+
+//Protocol capabilities this server can grant:
+// (CapResume and CapCompression are granted here, but sessions and deltas are kept by server.cpp, not the Game)
+constexpr uint16_t ServerCapabilities = Protocol::CapPacked | Protocol::CapTables | Protocol::CapResume | Protocol::CapCompression;
+
+//----- rules -----
+//Plain functions over compact state, shared by Game and the headless tools (simulate.cpp):
+
+//roll the 'count' dice in 'dices':
+void game_start(uint8_t *dices, uint32_t count, DiceRng &rng);
+
+//returns true if at least dice_num of the 'count' dices show dice_point:
+bool check_result(uint8_t const *dices, uint32_t count, uint8_t dice_num, uint8_t dice_point);
+
+//claims must fit the table (and Protocol::claim_byte):
+inline bool valid_claim(uint32_t count, uint8_t num, uint8_t point) {
+	return num >= 1 && num <= count && num <= Protocol::MaxClaimDice && point >= 1 && point <= 6;
+}
+
+//a claim must raise the standing one: more dice, or as many dice showing a higher face
+// (claims are ordered by (num-1)*6 + (point-1), as in Protocol::claim_byte; each game starts with
+//  one 1 standing, so the opening claim raises that too, and no client needs to know it is the opening)
+inline bool raises(uint8_t num, uint8_t point, uint8_t standing_num, uint8_t standing_point) {
+	return num > standing_num || (num == standing_num && point > standing_point);
+}
+
+//turns go around the table's 'seats' seats in order:
+inline uint8_t next_player(uint8_t player_id, uint32_t seats) {
+	return uint8_t((player_id + 1) % seats);
+}
+inline uint8_t previous_player(uint8_t player_id, uint32_t seats) {
+	return uint8_t((player_id + seats - 1) % seats);
+}
+
+//the winner when 'revealer' calls a claim (the claimer, one seat back, wins if it holds):
+inline uint8_t reveal_winner(uint8_t revealer, uint32_t seats, bool holds) {
+	return holds ? previous_player(revealer, seats) : revealer;
+}
+
+struct Game {
+	//seats at a table:
+	static constexpr uint32_t DefaultSeats = 2;
+	static constexpr uint32_t MaxSeats = 8;
+	static constexpr uint32_t DicePerSeat = 6;
+
+	Game(uint32_t seed, uint32_t seats = DefaultSeats);
+
+	//per-player state:
+	struct Player {
+		std::string name;
+		uint8_t player_id = 0;
+		uint8_t version = 0; //Protocol version agreed at join
+		uint16_t capabilities = 0; //Protocol capabilities granted at join
+		bool send_welcome = false; //handshake still needs to be answered
+		bool bot = false; //played by the server (no connection)
+		bool spectator = false; //watches without a seat (player_id is NoSeat) and may not act
+		bool ready = false; //asked to start (bots are always ready)
+	};
+	static constexpr uint8_t NoSeat = 0xff;
+
+	//players are kept in join order; pointers remain valid until remove_player:
+	// (each player takes the lowest free player_id)
+	Player *add_player();
+	//(a seat left while rolling or playing is taken over by a bot for the rest of the table)
+	void remove_player(Player *player);
+
+	//seat a bot player:
+	Player *add_bot();
+
+	//consume complete messages (at most 'limit' of them) from the front of recv_buffer:
+	// returns false if the client sent something invalid (and should be disconnected)
+	bool handle_messages(Player &player, std::vector< char > &recv_buffer, uint32_t limit = ~0u);
+
+	//append this tick's update for 'player' to send_buffer:
+	// (for spectators: send_handshake followed by send_spectator_update)
+	void send_update(Player &player, std::vector< char > &send_buffer);
+
+	//append the answer to the player's join, if it is still owed:
+	void send_handshake(Player &player, std::vector< char > &send_buffer);
+
+	//append this tick's update as every spectator sees it, so it can be serialized once per format:
+	void send_spectator_update(bool packed, std::vector< char > &send_buffer) const;
+
+	//the current player makes a claim (returns false if it doesn't fit the table or doesn't raise the standing one):
+	bool claim(uint8_t num, uint8_t point);
+	//'player' calls the standing claim (ends the game only while playing; see 'outcomes'):
+	void reveal(Player const &player);
+	//it is 'player''s turn to claim or call:
+	bool acting(Player const &player) const {
+		return state == 2 && !player.spectator && player.player_id == cur_player;
+	}
+
+	//the six dice belonging to player_id:
+	uint8_t const *dice_of(uint8_t player_id) const;
+	//dice on the table (six per seat):
+	uint32_t dice_count() const { return DicePerSeat * seats; }
+
+	//call once per tick, after every player has been sent their update:
+	void end_tick();
+
+	//roll and start playing if every seat is taken and ready:
+	void start_if_ready();
+	//(the two halves of start_if_ready)
+	bool ready_to_start() const;
+	void roll();
+
+	//players with a seat (bots and humans, not spectators):
+	uint32_t seated() const;
+
+	//a seat's name is set by its first join; joining again with the same name (to resume the seat)
+	// only repeats the handshake. Returns false for a different name:
+	bool join(Player &player, std::string const &name);
+
+	//----- snapshots -----
+	//append the table's complete state (see Journal.hpp):
+	void save(SnapshotWriter &out) const;
+	//replace the table's state with one written by save() (throws on malformed data):
+	void load(SnapshotReader &in);
+
+	//----- bots -----
+	Bot bot;
+	//let bots make their moves (called whenever the turn may have passed to a bot):
+	void run_bots();
+
+#ifdef GAME_COROUTINES
+	//----- the round as a coroutine (opt-in C++20 mode, see Flow.hpp) -----
+	//what wakes the round up:
+	enum class Event : uint8_t {
+		None, //(before the first)
+		Start, //a player may have become ready (start_if_ready)
+		Input, //a batch of messages was handled (handle_messages)
+		Tick, //end_tick
+	};
+	//waiting room -> roll -> a tick of rolling -> turns until someone calls, as straight-line code:
+	// (it starts from whatever 'state' says, so it can be restarted at any point, which is
+	//  how copies and loaded snapshots get theirs: a suspended frame can't be saved)
+	Flow run_round();
+	//hand 'event' to the round (starting it first if need be):
+	void wake(Event event);
+	struct Round {
+		Flow flow;
+		Event event = Event::None;
+		Round() = default;
+		Round(Round const &) { } //(a copy starts its own round)
+		Round &operator=(Round const &) {
+			flow = Flow();
+			return *this;
+		}
+	} round;
+#endif
+
+	//----- state -----
+	uint32_t seed;
+	uint32_t seats; //players needed to start (DefaultSeats to MaxSeats)
+	DiceRng rng; //this table's own generator, seeded from 'seed'
+
+	std::list< Player > players;
+	std::vector< std::string > player_name;
+
+	//every seat's dice, contiguous and indexed by seat (the first dice_count() are in use):
+	std::array< uint8_t, DicePerSeat * MaxSeats > dices;
+	//the same dice packed for the reveal, which every seat is sent as-is (valid in state 3):
+	std::array< uint8_t, Protocol::packed_dice_bytes(DicePerSeat * MaxSeats) > revealed;
+	uint32_t cur_player = 0;
+	uint8_t dice_num = 1;
+	uint8_t dice_point = 1;
+	uint8_t winner = 0;
+	bool opening = true; //no claim has been made yet this game
+	uint8_t state = 0;
+	//0: waiting room
+	//1: rolling dices
+	//2: playing
+	//3: revealed
+
+	//total client messages consumed (for throughput reporting):
+	uint64_t messages_handled = 0;
+
+	//----- results -----
+	//with 'rated' set, each game ended by a call between two human players is appended to 'outcomes',
+	// for the server to rate and clear (see Ratings.hpp); neither is part of a snapshot:
+	struct Outcome {
+		std::string winner, loser;
+	};
+	bool rated = false;
+	std::vector< Outcome > outcomes;
+};
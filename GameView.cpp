@@ -1,6 +1,8 @@
 #include "GameView.hpp"
+#include "Protocol.hpp"
 #include <cassert>
 #include <sstream>
+#include <cmath>
 
 namespace view {
 
@@ -36,6 +38,7 @@ int InGamePanel::get_panel_state() {
 void InGamePanel::set_state_respond_claim(int claim_replica, int claim_digit) {
 	dialog_ = std::make_shared<RespondClaimDialog>();
 	auto respond_claim_dialog = std::get<std::shared_ptr<RespondClaimDialog>>(dialog_);
+	respond_claim_dialog->set_odds(odds_);
 	respond_claim_dialog->set_claim_content(claim_replica, claim_digit);
 	respond_claim_dialog->set_listener_on_submit([this](int respond_type) {
 		assert(respond_type == 0 || respond_type == 1);
@@ -46,9 +49,12 @@ void InGamePanel::set_listener_respond_claim(std::function<void(int)> listener)
 	respond_claim_listener_ = std::move(listener);
 }
 
-void InGamePanel::set_state_make_claim() {
+void InGamePanel::set_state_make_claim(int claim_replica, int claim_digit) {
 	dialog_ = std::make_shared<MakeClaimDialog>();
 	auto make_claim_dialog = std::get<std::shared_ptr<MakeClaimDialog>>(dialog_);
+	make_claim_dialog->set_odds(odds_);
+	make_claim_dialog->set_max_replica(std::min(table_dice_, int(Protocol::MaxClaimDice)));
+	make_claim_dialog->set_claim_to_raise(claim_replica, claim_digit);
 	make_claim_dialog->set_listener_on_submit([this](int claim_replica, int claim_digit) {
 		make_claim_listener_(claim_replica, claim_digit);
 	});
@@ -72,6 +78,21 @@ void InGamePanel::set_listener_done_reveal(std::function<void()> listener) {
 	done_reveal_listener_ = std::move(listener);
 }
 
+void InGamePanel::set_hint_odds(std::function<float(int, int)> odds) {
+	odds_ = std::move(odds);
+	if (dialog_.index() == 1) {
+		std::get<1>(dialog_)->set_odds(odds_);
+	} else if (dialog_.index() == 2) {
+		std::get<2>(dialog_)->set_odds(odds_);
+	}
+}
+
+static std::string odds_text(const std::function<float(int, int)> &odds, int claim_replica, int claim_digit) {
+	if (!odds) return "";
+	int percent = (int) std::lround(odds(claim_replica, claim_digit) * 100.0f);
+	return "(chance this claim holds: " + std::to_string(percent) + "%)";
+}
+
 //void InGamePanel::set_players(std::vector<std::pair<std::string, int>> &players) {
 //	players_.resize(players.size());
 //	for (size_t i = 0; i < players.size(); i++) {
@@ -116,7 +137,7 @@ MakeClaimDialog::MakeClaimDialog() {
 	int title_width = title_->get_width();
 	title_->set_position(((int)ViewContext::get().logical_size_.x - title_width) / 2, 200);
 
-	help_msg_->set_text("[Press arrow keys to change claim. Press enter to submit]")
+	help_msg_->set_text("[Press arrow keys to change claim. Press enter to submit. H toggles odds]")
 		.set_font_size(24);
 	int help_msg_width = help_msg_->get_width();
 	help_msg_->set_position(((int)ViewContext::get().logical_size_.x - help_msg_width) / 2, 600);
@@ -154,6 +175,24 @@ void MakeClaimDialog::set_listener_on_submit(std::function<void(int, int)> liste
 	listener_ = std::move(listener);
 }
 
+void MakeClaimDialog::set_odds(std::function<float(int, int)> odds) {
+	odds_ = std::move(odds);
+	update_content();
+}
+
+void MakeClaimDialog::set_claim_to_raise(int claim_replica, int claim_digit) {
+	raise_replica_ = claim_replica;
+	raise_digit_ = claim_digit;
+	if (claim_digit < 6) {
+		claim_replica_ = claim_replica;
+		claim_digit_ = claim_digit + 1;
+	} else {
+		claim_replica_ = claim_replica + 1;
+		claim_digit_ = 1;
+	}
+	update_content();
+}
+
 std::pair<int, int> MakeClaimDialog::get_claim_number() {
 	return std::make_pair(claim_replica_, claim_digit_);
 }
@@ -170,7 +209,7 @@ bool MakeClaimDialog::handle_keypress(SDL_Keycode key) {
 			return true;
 		case SDLK_UP:
 			if (element_focus_position_ == 0) {
-				claim_replica_ = std::min(12, claim_replica_ + 1);
+				claim_replica_ = std::min(max_replica_, claim_replica_ + 1);
 			} else {
 				claim_digit_ = std::min(6, claim_digit_ + 1);
 			}
@@ -185,6 +224,11 @@ bool MakeClaimDialog::handle_keypress(SDL_Keycode key) {
 			update_content();
 			return true;
 		case SDLK_RETURN:
+			// (the server won't take a claim that doesn't raise the standing one, or can't be sent)
+			if (claim_replica_ < raise_replica_ || (claim_replica_ == raise_replica_ && claim_digit_ <= raise_digit_)
+			 || claim_replica_ > max_replica_) {
+				return true;
+			}
 			listener_(claim_replica_, claim_digit_);
 			return true;
 		default:
@@ -199,6 +243,7 @@ void MakeClaimDialog::draw() {
 	prompt3_->draw();
 	replica_view_->draw();
 	digit_view_->draw();
+	if (odds_) hint_->draw();
 	help_msg_->draw();
 }
 
@@ -209,6 +254,8 @@ void MakeClaimDialog::update_content() {
 	replica_view_->set_color(element_focus_position_ == 0 ? glm::u8vec4(255, 0, 0, 255) : glm::u8vec4(255));
 	digit_view_->set_text(std::to_string(claim_digit_));
 	digit_view_->set_color(element_focus_position_ == 1 ? glm::u8vec4(255, 0, 0, 255) : glm::u8vec4(255));
+	hint_->set_text(odds_text(odds_, claim_replica_, claim_digit_)).set_font_size(24);
+	TextSpanCenter(hint_.get(), 500);
 }
 
 /************** RespondClaimDialog **********/
@@ -230,9 +277,14 @@ void RespondClaimDialog::draw() {
 	prompt2_->draw();
 	reveal_->draw();
 	continue_->draw();
+	if (odds_) hint_->draw();
 	help_msg_->draw();
 }
 void RespondClaimDialog::set_listener_on_submit(std::function<void(int)> listener) { listener_ = std::move(listener); }
+void RespondClaimDialog::set_odds(std::function<float(int, int)> odds) {
+	odds_ = std::move(odds);
+	update_content();
+}
 bool RespondClaimDialog::handle_keypress(SDL_Keycode key) {
 	switch (key) {
 		case SDLK_LEFT:
@@ -255,6 +307,8 @@ void RespondClaimDialog::update_content() {
 		"There're at least " + std::to_string(claim_replica_) + " of " + std::to_string(claim_digit_) + " on board");
 	reveal_->set_text(element_focus_position_ == 0 ? "[reveal]" : " reveal ");
 	continue_->set_text(element_focus_position_ == 1 ? "[continue]" : " continue ");
+	hint_->set_text(odds_text(odds_, claim_replica_, claim_digit_)).set_font_size(24);
+	TextSpanCenter(hint_.get(), 350);
 
 }
 
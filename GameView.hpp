@@ -30,12 +30,20 @@ public:
 	MakeClaimDialog();
 	void set_listener_on_submit(std::function<void(int, int)> listener);
 	std::pair<int,int> get_claim_number();
+	// claims go up to every die on the table:
+	void set_max_replica(int max_replica) { max_replica_ = max_replica; }
+	// claims must raise the one standing: more dice, or as many showing a higher face (starts at the lowest raise):
+	void set_claim_to_raise(int claim_replica, int claim_digit);
+	// odds: probability that a (replica, digit) claim holds; nullptr hides the hint
+	void set_odds(std::function<float(int, int)> odds);
 	bool handle_keypress(SDL_Keycode key);
 	void draw();
 
 private:
 	void update_content();
 	TextSpanPtr title_ = std::make_shared<TextSpan>();
+	TextSpanPtr hint_ = std::make_shared<TextSpan>();
+	std::function<float(int, int)> odds_;
 	TextSpanPtr prompt1_ = std::make_shared<TextSpan>();
 	TextSpanPtr prompt2_ = std::make_shared<TextSpan>();
 	TextSpanPtr prompt3_ = std::make_shared<TextSpan>();
@@ -45,6 +53,8 @@ private:
 	std::function<void(int, int)> listener_;
 	int claim_replica_ = 1;
 	int claim_digit_ = 1;
+	int max_replica_ = 12;
+	int raise_replica_ = 0, raise_digit_ = 0;
 	int element_focus_position_ = 0;
 };
 
@@ -58,11 +68,14 @@ public:
 		update_content();
 	}
 	void set_listener_on_submit(std::function<void(int)> listener);
+	void set_odds(std::function<float(int, int)> odds);
 	void draw();
 	bool handle_keypress(SDL_Keycode key);
 
 private:
 	void update_content();
+	TextSpanPtr hint_ = std::make_shared<TextSpan>();
+	std::function<float(int, int)> odds_;
 	TextSpanPtr prompt1_ = std::make_shared<TextSpan>();
 	TextSpanPtr prompt2_ = std::make_shared<TextSpan>();
 	TextSpanPtr reveal_ = std::make_shared<TextSpan>();
@@ -121,18 +134,26 @@ public:
 	void set_state_respond_claim(int claim_replica, int claim_digit);
 	void set_listener_respond_claim(std::function<void(int)> listener);
 
-	void set_state_make_claim();
+	// claim_replica, claim_digit: the claim standing, which the new one must raise
+	void set_state_make_claim(int claim_replica, int claim_digit);
 	void set_listener_make_claim(std::function<void(int, int)> listener);
+	// dice on the table (six per seat), the most a claim can count:
+	void set_table_dice(int count) { table_dice_ = count; }
 
 	void set_state_waiting_others();
 
 	void set_state_reveal(const std::vector<std::pair<std::string, std::vector<uint8_t>>> &dices, bool win);
 	void set_listener_done_reveal(std::function<void()> listener);
 
+	// optional hint overlay: odds(replica, digit) is the probability a claim holds, nullptr to hide
+	void set_hint_odds(std::function<float(int, int)> odds);
+
 private:
+	std::function<float(int, int)> odds_;
 	std::function<void(int)> respond_claim_listener_;
 	std::function<void(int, int)> make_claim_listener_;
 	std::function<void()> done_reveal_listener_;
+	int table_dice_ = 12;
 
 	TextSpanPtr dice_view_ = std::make_shared<TextSpan>();
 
@@ -0,0 +1,187 @@
+#include "Handoff.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+
+Socket Handoff::listen(std::string const &) {
+	throw std::runtime_error("Handoff is not supported on Windows.");
+}
+Socket Handoff::connect(std::string const &) {
+	throw std::runtime_error("Handoff is not supported on Windows.");
+}
+bool Handoff::send(Socket, std::vector< char > const &, std::vector< Socket > const &) {
+	throw std::runtime_error("Handoff is not supported on Windows.");
+}
+void Handoff::receive(Socket, std::vector< char > *, std::vector< Socket > *) {
+	throw std::runtime_error("Handoff is not supported on Windows.");
+}
+
+#else
+
+static constexpr char const Magic[4] = {'b','h','o','3'};
+static constexpr uint32_t BatchSize = 250; //descriptors per message (Linux takes at most 253)
+static constexpr int ReceiveTimeout = 5; //seconds the new server waits on a silent sender
+
+static sockaddr_un address(std::string const &path) {
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Handoff path '" + path + "' is too long.");
+	std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+	return addr;
+}
+
+//blocking helpers (return false if the other end went away):
+static bool send_all(Socket s, void const *data_, size_t size) {
+	char const *data = reinterpret_cast< char const * >(data_);
+	while (size > 0) {
+		ssize_t ret = ::send(s, data, size, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) return false;
+		data += ret;
+		size -= size_t(ret);
+	}
+	return true;
+}
+
+static bool recv_all(Socket s, void *data_, size_t size) {
+	char *data = reinterpret_cast< char * >(data_);
+	while (size > 0) {
+		ssize_t ret = ::recv(s, data, size, 0);
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) return false;
+		data += ret;
+		size -= size_t(ret);
+	}
+	return true;
+}
+
+Socket Handoff::listen(std::string const &path) {
+	sockaddr_un addr = address(path);
+	Socket s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == InvalidSocket) throw std::system_error(errno, std::system_category(), "failed to create handoff socket");
+	::unlink(path.c_str()); //(a previous server's; callers check with connect() first that nobody is using it)
+	if (::bind(s, reinterpret_cast< sockaddr * >(&addr), sizeof(addr)) != 0 || ::listen(s, 4) != 0) {
+		int err = errno;
+		::close(s);
+		throw std::system_error(err, std::system_category(), "failed to listen at '" + path + "'");
+	}
+	return s;
+}
+
+Socket Handoff::connect(std::string const &path) {
+	sockaddr_un addr = address(path);
+	Socket s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == InvalidSocket) throw std::system_error(errno, std::system_category(), "failed to create handoff socket");
+	if (::connect(s, reinterpret_cast< sockaddr * >(&addr), sizeof(addr)) != 0) {
+		::close(s);
+		return InvalidSocket; //(no file, or nobody listening any more)
+	}
+	return s;
+}
+
+bool Handoff::send(Socket to, std::vector< char > const &state, std::vector< Socket > const &sockets) {
+	uint64_t size = state.size();
+	uint32_t count = uint32_t(sockets.size());
+	if (!send_all(to, Magic, 4)) return false;
+	if (!send_all(to, &size, sizeof(size))) return false;
+	if (!send_all(to, &count, sizeof(count))) return false;
+	if (!send_all(to, state.data(), state.size())) return false;
+
+	//descriptors ride along with a small count, a batch at a time:
+	alignas(cmsghdr) char control[CMSG_SPACE(BatchSize * sizeof(int))];
+	for (uint32_t begin = 0; begin < count; begin += BatchSize) {
+		uint32_t batch = std::min(BatchSize, count - begin);
+		iovec iov;
+		iov.iov_base = &batch;
+		iov.iov_len = sizeof(batch);
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(batch * sizeof(int));
+		cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(batch * sizeof(int));
+		std::memcpy(CMSG_DATA(cmsg), sockets.data() + begin, batch * sizeof(int));
+		ssize_t ret;
+		do {
+			ret = ::sendmsg(to, &msg, MSG_NOSIGNAL);
+		} while (ret < 0 && errno == EINTR);
+		if (ret != ssize_t(sizeof(batch))) return false;
+	}
+
+	char ack = 0;
+	return recv_all(to, &ack, 1) && ack == 'k';
+}
+
+void Handoff::receive(Socket from, std::vector< char > *state, std::vector< Socket > *sockets) {
+	timeval timeout;
+	timeout.tv_sec = ReceiveTimeout;
+	timeout.tv_usec = 0;
+	setsockopt(from, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	if (!send_all(from, Request, std::strlen(Request))) throw std::runtime_error("The running server went away before the handoff started.");
+
+	char magic[4];
+	uint64_t size = 0;
+	uint32_t count = 0;
+	if (!recv_all(from, magic, 4) || std::memcmp(magic, Magic, 4) != 0) {
+		throw std::runtime_error("The running server didn't start a handoff.");
+	}
+	if (!recv_all(from, &size, sizeof(size)) || !recv_all(from, &count, sizeof(count))) {
+		throw std::runtime_error("Handoff header was cut short.");
+	}
+	state->resize(size_t(size));
+	if (!recv_all(from, state->data(), state->size())) throw std::runtime_error("Handoff state was cut short.");
+
+	sockets->clear();
+	sockets->reserve(count);
+	alignas(cmsghdr) char control[CMSG_SPACE(BatchSize * sizeof(int))];
+	while (sockets->size() < count) {
+		uint32_t batch = 0;
+		iovec iov;
+		iov.iov_base = &batch;
+		iov.iov_len = sizeof(batch);
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		ssize_t ret;
+		do {
+			ret = ::recvmsg(from, &msg, 0);
+		} while (ret < 0 && errno == EINTR);
+		if (ret != ssize_t(sizeof(batch)) || (msg.msg_flags & MSG_CTRUNC)) {
+			throw std::runtime_error("Handoff sockets were cut short.");
+		}
+		cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+		 || cmsg->cmsg_len != CMSG_LEN(batch * sizeof(int))) {
+			throw std::runtime_error("Handoff message didn't carry the expected sockets.");
+		}
+		size_t at = sockets->size();
+		sockets->resize(at + batch);
+		std::memcpy(sockets->data() + at, CMSG_DATA(cmsg), batch * sizeof(int));
+	}
+
+	if (!send_all(from, "k", 1)) throw std::runtime_error("The running server went away before the handoff finished.");
+	::close(from);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Handoff passes a running server's sockets and state to a new server process, so a new
+ * binary can be deployed without dropping anyone (./server <port> --handoff <path>).
+ *
+ * The running server listens on a Unix domain socket at <path>. A new server started with
+ * the same --handoff path connects there and sends "handoff\n"; the running server then
+ * stops polling, sends its serialized state followed by every socket it holds (listening
+ * sockets first) as SCM_RIGHTS messages, waits for the new server to acknowledge, and exits.
+ * The new server carries on polling the same sockets, so clients never see a reconnect.
+ *
+ * Wire format (native endian; both ends are the same machine):
+ *  |b |h |o |2 | state size (64-bit) | socket count (32-bit) | state...
+ *  then one message per batch of sockets: | count (32-bit) | + that many descriptors
+ *  then the new server's acknowledgement: |k |
+ *
+ * Unix only; on Windows every function throws.
+ */
+
+#include "Connection.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Handoff {
+	//the line a new server sends to ask for a handoff:
+	constexpr char const Request[] = "handoff\n";
+
+	//listen for a successor at 'path' (replacing whatever stale socket file is there):
+	Socket listen(std::string const &path);
+
+	//connect to the server listening at 'path', or return InvalidSocket if none is:
+	// (connecting doesn't disturb it; receive() asks for the handoff)
+	Socket connect(std::string const &path);
+
+	//(running server) send 'state' and 'sockets' to a successor, then wait for it to take them:
+	// returns false if the successor went away first, in which case the sender still owns everything
+	bool send(Socket to, std::vector< char > const &state, std::vector< Socket > const &sockets);
+
+	//(new server) send the Request over a connect()'ed socket, receive what send() sent (throws on
+	// failure or after a few seconds of silence), tell the sender it can exit, and close 'from':
+	void receive(Socket from, std::vector< char > *state, std::vector< Socket > *sockets);
+}
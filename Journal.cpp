@@ -0,0 +1,202 @@
+#include "Journal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static constexpr char const JournalMagic[4] = {'b','j','n','3'};
+static constexpr char const SnapshotMagic[4] = {'b','s','n','3'};
+static constexpr size_t HeaderSize = 4 + sizeof(uint64_t);
+
+//----- small file helpers -----
+
+static std::vector< char > read_file(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) return std::vector< char >();
+	return std::vector< char >(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+}
+
+//returns the epoch in a file's header, or false if the header is missing or has the wrong magic:
+static bool read_header(std::vector< char > const &file, char const (&magic)[4], uint64_t *epoch) {
+	if (file.size() < HeaderSize || std::memcmp(file.data(), magic, 4) != 0) return false;
+	std::memcpy(epoch, file.data() + 4, sizeof(uint64_t));
+	return true;
+}
+
+static int open_file(std::string const &filename, bool truncate) {
+#ifdef _WIN32
+	int fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND), 0644);
+#else
+	int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND), 0644);
+#endif
+	if (fd < 0) throw std::system_error(errno, std::system_category(), "failed to open '" + filename + "'");
+	return fd;
+}
+
+static void write_all(int fd, char const *data, size_t size) {
+	while (size > 0) {
+#ifdef _WIN32
+		int ret = _write(fd, data, unsigned(std::min< size_t >(size, 1 << 30)));
+#else
+		ssize_t ret = ::write(fd, data, size);
+		if (ret < 0 && errno == EINTR) continue;
+#endif
+		if (ret <= 0) throw std::system_error(errno, std::system_category(), "journal write failed");
+		data += ret;
+		size -= size_t(ret);
+	}
+}
+
+//wait until everything written to 'fd' is on disk:
+static void sync_file(int fd) {
+#if defined(_WIN32)
+	int ret = _commit(fd);
+#elif defined(__linux__)
+	int ret = fdatasync(fd);
+#else
+	int ret = fsync(fd);
+#endif
+	if (ret != 0) throw std::system_error(errno, std::system_category(), "journal sync failed");
+}
+
+static void close_file(int fd) {
+#ifdef _WIN32
+	_close(fd);
+#else
+	::close(fd);
+#endif
+}
+
+//replace 'to' with 'from' in one step (so readers see the old file or the new one, never a mix):
+static void replace_file(std::string const &from, std::string const &to) {
+#ifdef _WIN32
+	if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		throw std::runtime_error("failed to replace '" + to + "'");
+	}
+#else
+	if (std::rename(from.c_str(), to.c_str()) != 0) {
+		throw std::system_error(errno, std::system_category(), "failed to replace '" + to + "'");
+	}
+	//make the rename itself durable:
+	std::string dir = ".";
+	size_t slash = to.rfind('/');
+	if (slash != std::string::npos) dir = to.substr(0, slash + 1);
+	int dir_fd = ::open(dir.c_str(), O_RDONLY);
+	if (dir_fd >= 0) {
+		fsync(dir_fd);
+		::close(dir_fd);
+	}
+#endif
+}
+
+//----- Journal -----
+
+Journal::Journal(std::string const &path_) : path(path_) {
+	std::vector< char > snapshot = read_file(path + ".snap");
+	if (!read_header(snapshot, SnapshotMagic, &epoch)) {
+		//(an older server's tables would be recovered with different rolls and rules than its players saw)
+		if (snapshot.size() >= 4 && std::memcmp(snapshot.data(), SnapshotMagic, 3) == 0) {
+			throw std::runtime_error("'" + path + ".snap' was written by another version of the server ('" + std::string(snapshot.data(), 4) + "'; this one reads '" + std::string(SnapshotMagic, 4) + "'). Move it and '" + path + "' aside to start with no tables.");
+		}
+		if (!snapshot.empty()) throw std::runtime_error("'" + path + ".snap' is not a snapshot.");
+		return; //nothing to recover (a journal without a snapshot can't hold anything either)
+	}
+	recovered_snapshot.assign(snapshot.begin() + HeaderSize, snapshot.end());
+
+	std::vector< char > journal = read_file(path);
+	uint64_t journal_epoch = 0;
+	if (!read_header(journal, JournalMagic, &journal_epoch) || journal_epoch != epoch) {
+		return; //(older than the snapshot, or cut short while being started)
+	}
+	char const *at = journal.data() + HeaderSize;
+	char const *end = journal.data() + journal.size();
+	constexpr size_t EventHeader = 1 + sizeof(uint32_t) + sizeof(uint32_t);
+	while (size_t(end - at) >= EventHeader) {
+		SessionLog::Event event;
+		event.type = SessionLog::Type(uint8_t(at[0]));
+		uint32_t size;
+		std::memcpy(&event.connection, at + 1, sizeof(uint32_t));
+		std::memcpy(&size, at + 1 + sizeof(uint32_t), sizeof(uint32_t));
+		if (size_t(end - at) - EventHeader < size) break; //cut short by a crash
+		event.data.assign(at + EventHeader, at + EventHeader + size);
+		recovered_events.emplace_back(std::move(event));
+		at += EventHeader + size;
+	}
+}
+
+Journal::~Journal() {
+	if (fd >= 0) close_file(fd);
+}
+
+void Journal::record(SessionLog::Type type, uint32_t id, char const *data, size_t size) {
+	uint8_t t = type;
+	uint32_t sz = uint32_t(size);
+	batch.insert(batch.end(), reinterpret_cast< char const * >(&t), reinterpret_cast< char const * >(&t) + 1);
+	batch.insert(batch.end(), reinterpret_cast< char const * >(&id), reinterpret_cast< char const * >(&id) + sizeof(id));
+	batch.insert(batch.end(), reinterpret_cast< char const * >(&sz), reinterpret_cast< char const * >(&sz) + sizeof(sz));
+	if (size) batch.insert(batch.end(), data, data + size);
+	events += 1;
+}
+
+void Journal::record(SessionLog::Type type, uint32_t id, uint32_t value) {
+	record(type, id, reinterpret_cast< char const * >(&value), sizeof(value));
+}
+
+void Journal::commit() {
+	if (batch.empty()) return;
+	if (fd < 0) throw std::runtime_error("Journal::commit() called before the first snapshot().");
+	auto before = std::chrono::steady_clock::now();
+	write_all(fd, batch.data(), batch.size());
+	sync_file(fd);
+	double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+
+	commits += 1;
+	bytes += batch.size();
+	commit_seconds += seconds;
+	commit_seconds_max = std::max(commit_seconds_max, seconds);
+	batch.clear();
+}
+
+void Journal::snapshot(std::vector< char > const &state) {
+	auto before = std::chrono::steady_clock::now();
+	uint64_t next_epoch = epoch + 1;
+
+	{ //write the new snapshot next to the old one, then swap it in:
+		std::string temp = path + ".snap.tmp";
+		int snap_fd = open_file(temp, true);
+		write_all(snap_fd, SnapshotMagic, 4);
+		write_all(snap_fd, reinterpret_cast< char const * >(&next_epoch), sizeof(next_epoch));
+		write_all(snap_fd, state.data(), state.size());
+		sync_file(snap_fd);
+		close_file(snap_fd);
+		replace_file(temp, path + ".snap");
+	}
+	epoch = next_epoch;
+
+	//start the journal over (a crash in here leaves a journal that doesn't match the snapshot, which is ignored):
+	if (fd >= 0) close_file(fd);
+	fd = open_file(path, true);
+	write_all(fd, JournalMagic, 4);
+	write_all(fd, reinterpret_cast< char const * >(&epoch), sizeof(epoch));
+	sync_file(fd);
+	batch.clear();
+
+	snapshots += 1;
+	snapshot_seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+}
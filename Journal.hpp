@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+ * Journal lets the server's tables survive a restart (./server <port> --journal <path>).
+ *
+ * Every state-changing event (the events SessionLog records, minus outbound bytes) is
+ * queued in memory; commit() appends the whole batch with one write and one fsync at the
+ * end of each tick (group commit), so a crash loses at most the tick in progress. Every
+ * so often the server writes a compact snapshot of all its tables instead, and the
+ * journal starts over empty.
+ *
+ * On startup the server rebuilds its tables from the last snapshot plus the events
+ * journaled after it, then immediately writes a fresh snapshot.
+ *
+ * Files (native endian, like the session log):
+ *  <path>.snap: |b |s |n |3 | epoch (64-bit) | state written by the server...
+ *  <path>:      |b |j |n |3 | epoch (64-bit) | events (same layout as SessionLog)...
+ * (both magics are bumped along with the session log's, since old events would be recovered differently)
+ * A journal is only replayed on top of the snapshot with the same epoch, so a crash between
+ * writing a snapshot and restarting the journal can't apply events twice. An event cut
+ * short by a crash ends the journal.
+ */
+
+#include "SessionLog.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Journal {
+	//open the journal at 'path' and read back whatever a previous run left there:
+	explicit Journal(std::string const &path);
+	~Journal();
+	Journal(Journal const &) = delete;
+	Journal &operator=(Journal const &) = delete;
+
+	//what the previous run left (both empty if nothing):
+	std::vector< char > recovered_snapshot;
+	std::vector< SessionLog::Event > recovered_events;
+
+	//queue an event for the next commit:
+	void record(SessionLog::Type type, uint32_t id, char const *data = nullptr, size_t size = 0);
+	//an event whose data is one 32-bit value:
+	void record(SessionLog::Type type, uint32_t id, uint32_t value);
+
+	//write and fsync everything queued since the last commit (throws if the disk refuses):
+	void commit();
+
+	//atomically replace the snapshot with 'state' and start an empty journal after it:
+	// (anything queued but not committed is dropped, so 'state' must already include it)
+	void snapshot(std::vector< char > const &state);
+
+	//----- stats (since startup) -----
+	uint64_t events = 0;
+	uint64_t commits = 0;
+	uint64_t bytes = 0; //journal bytes committed
+	double commit_seconds = 0.0; //total time spent in commit()
+	double commit_seconds_max = 0.0;
+	uint64_t snapshots = 0;
+	double snapshot_seconds = 0.0; //time the last snapshot() took
+
+	//----- internals -----
+	std::string path;
+	uint64_t epoch = 0; //of the current snapshot (and journal)
+	int fd = -1; //journal file, open for appending once the first snapshot is written
+	std::vector< char > batch; //events queued since the last commit
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * Mailbox turns anything whose messages must be handled one at a time (e.g. a table's
+ * Game) into an actor that runs on a shared ThreadPool.
+ *
+ * post() may be called from any thread. The first message posted to an idle mailbox
+ * submits a drain task to the pool; the drain handles messages in the order they were
+ * posted until the mailbox is empty. Only one drain per mailbox is ever scheduled, so
+ * the handler never runs concurrently with itself and the state it touches needs no
+ * locks. Different mailboxes drain in parallel, and idle workers steal waiting drains.
+ *
+ * The mutex only guards the queue (it is held for a push or a swap, never while handling).
+ * A mailbox must outlive its drains: call ThreadPool::wait() before destroying one that
+ * may have messages in flight.
+ */
+
+#include "ThreadPool.hpp"
+
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+template< typename Message >
+struct Mailbox {
+	using Handler = std::function< void(Message &) >;
+
+	Mailbox(ThreadPool &pool_, Handler handler_) : pool(pool_), handler(std::move(handler_)) { }
+	Mailbox(Mailbox const &) = delete;
+	Mailbox &operator=(Mailbox const &) = delete;
+
+	//queue a message, scheduling a drain if none is pending:
+	void post(Message message) {
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			inbox.emplace_back(std::move(message));
+			if (scheduled) return;
+			scheduled = true;
+		}
+		pool.submit([this](uint32_t) { drain(); });
+	}
+
+	//messages handled so far (written by drains; read it once the pool is idle):
+	uint64_t handled = 0;
+
+private:
+	void drain() {
+		while (true) {
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				if (inbox.empty()) {
+					scheduled = false;
+					return;
+				}
+				std::swap(inbox, draining);
+			}
+			for (Message &message : draining) {
+				handler(message);
+			}
+			handled += draining.size();
+			draining.clear();
+		}
+	}
+
+	ThreadPool &pool;
+	Handler handler;
+	std::mutex mutex;
+	std::vector< Message > inbox; //posted, waiting for a drain
+	std::vector< Message > draining; //being handled (touched only by the drain)
+	bool scheduled = false; //a drain is queued or running
+};
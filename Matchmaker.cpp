@@ -0,0 +1,129 @@
+#include "Matchmaker.hpp"
+
+#include <algorithm>
+#include <limits>
+
+Matchmaker::Matchmaker() : Matchmaker(Options()) {
+}
+
+Matchmaker::Matchmaker(Options const &options_) : options(options_), by_skill(std::max(1u, options_.latency_buckets)) {
+}
+
+void Matchmaker::enqueue(uint64_t id, int32_t skill, uint32_t rtt_ms, Clock::time_point now) {
+	Ticket ticket;
+	ticket.skill = skill;
+	ticket.bucket = std::min(rtt_ms / std::max(1u, options.latency_bucket_ms), uint32_t(by_skill.size() - 1));
+	ticket.enqueued = now;
+	ticket.next_check = now;
+	if (!tickets.emplace(id, ticket).second) return; //already waiting
+	by_skill[ticket.bucket].emplace(skill, id);
+	arrivals.emplace_back(id);
+}
+
+bool Matchmaker::cancel(uint64_t id) {
+	if (!tickets.count(id)) return false;
+	remove(id, nullptr);
+	return true;
+}
+
+void Matchmaker::remove(uint64_t id, Clock::time_point const *now) {
+	auto f = tickets.find(id);
+	if (f == tickets.end()) return;
+	Ticket const &ticket = f->second;
+	if (now) {
+		match_seconds[matched % History] = std::chrono::duration< float >(*now - ticket.enqueued).count();
+		matched += 1;
+	}
+	by_skill[ticket.bucket].erase(SkillKey(ticket.skill, id));
+	checks.erase(CheckKey(ticket.next_check, id)); //(no-op for arrivals not yet looked at)
+	tickets.erase(f);
+}
+
+void Matchmaker::schedule(uint64_t id, Clock::time_point when) {
+	Ticket &ticket = tickets.at(id);
+	checks.erase(CheckKey(ticket.next_check, id));
+	//look again after recheck_seconds, or right when bots are due if that is sooner:
+	auto bots_due = ticket.enqueued + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(options.bot_after));
+	if (options.bot_after >= 0.0 && bots_due < when) when = bots_due;
+	ticket.next_check = when;
+	checks.emplace(when, id);
+}
+
+bool Matchmaker::try_group(uint64_t id, Clock::time_point now, Match *match) {
+	Ticket const &ticket = tickets.at(id);
+	double waited = std::chrono::duration< double >(now - ticket.enqueued).count();
+	int64_t window = int64_t(options.skill_window) + int64_t(options.widen_per_second * waited);
+
+	//walk outward from this player in skill order, always taking the nearer neighbor:
+	std::set< SkillKey > const &bucket = by_skill[ticket.bucket];
+	auto self = bucket.find(SkillKey(ticket.skill, id));
+	auto lo = self;
+	auto hi = std::next(self);
+	match->ids.assign(1, id);
+	match->bots = 0;
+	while (match->ids.size() < options.table_size) {
+		constexpr int64_t Far = std::numeric_limits< int64_t >::max();
+		int64_t below = (lo != bucket.begin() ? int64_t(ticket.skill) - std::prev(lo)->first : Far);
+		int64_t above = (hi != bucket.end() ? int64_t(hi->first) - ticket.skill : Far);
+		if (std::min(below, above) > window) return false;
+		if (below <= above) {
+			--lo;
+			match->ids.emplace_back(lo->second);
+		} else {
+			match->ids.emplace_back(hi->second);
+			++hi;
+		}
+	}
+
+	for (uint64_t member : match->ids) {
+		remove(member, &now);
+	}
+	return true;
+}
+
+void Matchmaker::match(Clock::time_point now, std::vector< Match > *matches) {
+	auto recheck = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(options.recheck_seconds));
+	Match match;
+
+	//new arrivals first (in arrival order):
+	for (uint64_t id : arrivals) {
+		if (!tickets.count(id)) continue; //grouped or cancelled since arriving
+		if (try_group(id, now, &match)) {
+			matches->emplace_back(std::move(match));
+		} else {
+			schedule(id, now + recheck);
+		}
+	}
+	arrivals.clear();
+
+	//then everyone due for another look (oldest check first):
+	while (!checks.empty() && checks.begin()->first <= now) {
+		uint64_t id = checks.begin()->second;
+		checks.erase(checks.begin());
+		Ticket &ticket = tickets.at(id);
+		ticket.next_check = Clock::time_point(); //(no longer in 'checks')
+
+		if (try_group(id, now, &match)) {
+			matches->emplace_back(std::move(match));
+			continue;
+		}
+		double waited = std::chrono::duration< double >(now - ticket.enqueued).count();
+		if (options.bot_after >= 0.0 && waited >= options.bot_after) {
+			match.ids.assign(1, id);
+			match.bots = options.table_size - 1;
+			remove(id, &now);
+			matches->emplace_back(std::move(match));
+			continue;
+		}
+		schedule(id, now + recheck);
+	}
+}
+
+double Matchmaker::time_to_match(float p) const {
+	size_t kept = size_t(std::min< uint64_t >(matched, History));
+	if (kept == 0) return 0.0;
+	std::vector< float > sorted(match_seconds.begin(), match_seconds.begin() + kept);
+	size_t at = std::min(kept - 1, size_t(p * kept));
+	std::nth_element(sorted.begin(), sorted.begin() + at, sorted.end());
+	return sorted[at];
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/*
+ * Matchmaker groups waiting players into tables.
+ *
+ * Players are queued with a skill rating and a round-trip time. Every few milliseconds the
+ * server calls match(), which handles everyone who arrived since the last batch and everyone
+ * whose wait has grown enough to be worth another look:
+ *  - players are only grouped with players in the same latency bucket;
+ *  - a player is grouped with the nearest skills in that bucket, as long as they are within a
+ *    window that widens the longer the player has waited;
+ *  - a player who waits longer than bot_after is seated with bots instead.
+ *
+ * Each bucket keeps its players ordered by skill and the queue keeps them ordered by the time
+ * of their next look, so every operation is O(log n) and large queues are never scanned.
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct Matchmaker {
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		uint32_t table_size = 2; //players per table
+		int32_t skill_window = 100; //allowed skill difference on arrival
+		int32_t widen_per_second = 100; //how fast the window grows while waiting
+		double recheck_seconds = 0.5; //how often a waiting player is looked at again
+		double bot_after = 10.0; //seat with bots after waiting this long (negative: never)
+		uint32_t latency_bucket_ms = 50; //round-trip times are bucketed in steps of this size
+		uint32_t latency_buckets = 4; //(the last bucket takes everything slower)
+	};
+
+	Matchmaker();
+	explicit Matchmaker(Options const &options);
+
+	//queue a player (ids must be unique among waiting players):
+	void enqueue(uint64_t id, int32_t skill, uint32_t rtt_ms, Clock::time_point now);
+	//remove a waiting player (e.g., on disconnect); returns false if they weren't waiting:
+	bool cancel(uint64_t id);
+
+	struct Match {
+		std::vector< uint64_t > ids;
+		uint32_t bots = 0; //seats left for bots
+	};
+	//form every table that can be formed at 'now' (appends to 'matches'):
+	void match(Clock::time_point now, std::vector< Match > *matches);
+
+	size_t waiting() const { return tickets.size(); }
+
+	//time from enqueue to match over recent matches (p in [0,1]; 0 if none yet):
+	double time_to_match(float p) const;
+
+	Options options;
+
+private:
+	struct Ticket {
+		int32_t skill;
+		uint32_t bucket;
+		Clock::time_point enqueued;
+		Clock::time_point next_check;
+	};
+	using SkillKey = std::pair< int32_t, uint64_t >; //skill, id
+	using CheckKey = std::pair< Clock::time_point, uint64_t >; //next check, id
+
+	std::unordered_map< uint64_t, Ticket > tickets;
+	std::vector< std::set< SkillKey > > by_skill; //per latency bucket
+	std::set< CheckKey > checks;
+	std::vector< uint64_t > arrivals; //enqueued since the last match()
+
+	//try to seat 'id' with its nearest neighbors; returns true (and fills 'match') on success:
+	bool try_group(uint64_t id, Clock::time_point now, Match *match);
+	//look at 'id' again at 'when':
+	void schedule(uint64_t id, Clock::time_point when);
+	//drop a waiting player; 'now' (if given) records how long they waited for a table:
+	void remove(uint64_t id, Clock::time_point const *now);
+
+	static constexpr uint32_t History = 4096; //matches kept for time_to_match
+	std::array< float, History > match_seconds{};
+	uint64_t matched = 0;
+};
@@ -0,0 +1,106 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+Metrics::Metrics() : started(Clock::now()) {
+}
+
+void Metrics::tick(double seconds, uint64_t messages_total) {
+	uint32_t slot = uint32_t(ticks % History);
+	tick_seconds[slot] = float(seconds);
+	tick_end[slot] = Clock::now();
+	tick_messages[slot] = messages_total;
+	ticks += 1;
+}
+
+uint64_t Metrics::resident_bytes() {
+#ifdef _WIN32
+	return 0;
+#else
+	//statm: total program size, resident set size, ... (in pages):
+	std::ifstream statm("/proc/self/statm");
+	uint64_t size = 0, resident = 0;
+	if (!(statm >> size >> resident)) return 0;
+	return resident * uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+std::string Metrics::report(Load const &load, bool json) const {
+	//tick duration percentiles over the kept history:
+	uint32_t kept = uint32_t(std::min< uint64_t >(ticks, History));
+	std::vector< float > sorted(tick_seconds.begin(), tick_seconds.begin() + kept);
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](float p) -> double {
+		if (sorted.empty()) return 0.0;
+		return sorted[std::min< size_t >(sorted.size() - 1, size_t(p * sorted.size()))];
+	};
+
+	//messages/sec over the last few ticks:
+	double rate = 0.0;
+	uint64_t messages = 0;
+	if (ticks > 0) {
+		uint32_t last = uint32_t((ticks - 1) % History);
+		messages = tick_messages[last];
+		uint32_t span = uint32_t(std::min< uint64_t >(ticks - 1, RateTicks));
+		if (span > 0) {
+			uint32_t first = uint32_t((ticks - 1 - span) % History);
+			double seconds = std::chrono::duration< double >(tick_end[last] - tick_end[first]).count();
+			if (seconds > 0.0) rate = (tick_messages[last] - tick_messages[first]) / seconds;
+		}
+	}
+
+	std::ostringstream out;
+	bool first_field = true;
+	auto field = [&](char const *name, auto value) {
+		if (json) {
+			out << (first_field ? "{" : ",") << '"' << name << "\":" << value;
+		} else {
+			out << name << ' ' << value << '\n';
+		}
+		first_field = false;
+	};
+	field("uptime_seconds", std::chrono::duration< double >(Clock::now() - started).count());
+	field("tables", load.tables);
+	field("connections", load.connections);
+	field("players", load.players);
+	field("bots", load.bots);
+	field("spectators", load.spectators);
+	field("waiting", load.waiting);
+	field("match_ms_p50", load.match_seconds_p50 * 1000.0);
+	field("match_ms_p90", load.match_seconds_p90 * 1000.0);
+	field("match_ms_p99", load.match_seconds_p99 * 1000.0);
+	field("messages", messages);
+	field("messages_per_second", rate);
+	field("ticks", ticks);
+	field("tick_ms_p50", percentile(0.50f) * 1000.0);
+	field("tick_ms_p90", percentile(0.90f) * 1000.0);
+	field("tick_ms_p99", percentile(0.99f) * 1000.0);
+	field("tick_ms_max", (sorted.empty() ? 0.0 : sorted.back() * 1000.0));
+	field("queued_send_bytes", load.queued_send);
+	field("queued_recv_bytes", load.queued_recv);
+	field("throttled", load.throttled);
+	field("deferred_polls", load.deferred);
+	field("flood_drops", load.flood_drops);
+	field("detached_seats", load.detached);
+	field("sessions", load.sessions);
+	field("session_bytes", load.session_bytes);
+	field("resumes", load.resumes);
+	field("resyncs", load.resyncs);
+	field("rated_players", load.rated);
+	field("rating_updates", load.rating_updates);
+	field("update_bytes", load.update_bytes);
+	field("delta_bytes", load.delta_bytes);
+	field("journal_bytes", load.journal_bytes);
+	field("journal_commit_ms_max", load.journal_commit_seconds_max * 1000.0);
+	field("snapshot_ms", load.snapshot_seconds * 1000.0);
+	field("resident_bytes", resident_bytes());
+	out << (json ? "}\n" : "\n");
+	return out.str();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Metrics keeps the load figures served on the server's admin port (--admin <port>).
+ *
+ * The game loop reports each tick's duration and the running message count; everything
+ * else is sampled only when an admin connection asks for a report, so an unused admin
+ * port costs nothing.
+ *
+ * An admin connection sends one command per line and gets one report back per line:
+ *   stats -- 'name value' lines, ending with an empty line
+ *   json  -- a single-line JSON object
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+struct Metrics {
+	Metrics();
+
+	//call once per tick with the time the tick's work took and the total messages handled so far:
+	void tick(double seconds, uint64_t messages_total);
+
+	//figures the server samples when a report is requested:
+	struct Load {
+		uint32_t tables = 0;
+		uint32_t connections = 0; //game connections (not admin connections)
+		uint32_t players = 0; //seated humans
+		uint32_t bots = 0;
+		uint32_t spectators = 0;
+		uint64_t queued_send = 0; //bytes waiting to go out
+		uint64_t queued_recv = 0; //bytes received but not yet handled
+		uint32_t waiting = 0; //players in the matchmaking queue
+		double match_seconds_p50 = 0.0; //time from joining to being seated
+		double match_seconds_p90 = 0.0;
+		double match_seconds_p99 = 0.0;
+		uint64_t throttled = 0; //times a connection's input was held back by its rate limit
+		uint64_t deferred = 0; //polls whose message budget ran out with input left over
+		uint64_t flood_drops = 0; //connections dropped for letting too much input pile up
+		uint32_t detached = 0; //seats waiting for their players (recovered, or dropped with a session)
+		uint32_t sessions = 0; //resumable sessions (Protocol::CapResume)
+		uint64_t session_bytes = 0; //held by their replay buffers
+		uint64_t resumes = 0; //sessions resumed since startup
+		uint64_t resyncs = 0; //...of which had to skip bytes the replay buffer no longer held
+		uint32_t rated = 0; //players with a rating
+		uint64_t rating_updates = 0; //games rated since startup
+		uint64_t update_bytes = 0; //state updates sent as deltas since startup, before encoding (Protocol::CapCompression)
+		uint64_t delta_bytes = 0; //...and after
+		uint64_t journal_bytes = 0; //committed to the journal since startup (0 without --journal)
+		double journal_commit_seconds_max = 0.0; //slowest group commit
+		double snapshot_seconds = 0.0; //time the last snapshot took
+	};
+	std::string report(Load const &load, bool json) const;
+
+	//resident set size in bytes (from /proc/self/statm; 0 where that isn't available):
+	static uint64_t resident_bytes();
+
+	//----- internals -----
+	static constexpr uint32_t History = 1024; //ticks kept for percentiles and rates
+	static constexpr uint32_t RateTicks = 10; //messages/sec is averaged over this many ticks
+
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point started;
+
+	uint64_t ticks = 0;
+	std::array< float, History > tick_seconds{}; //duration of each tick's work
+	std::array< Clock::time_point, History > tick_end{}; //when each tick finished
+	std::array< uint64_t, History > tick_messages{}; //messages_total at the end of each tick
+};
@@ -20,6 +20,10 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//set whenever what draw would show has changed; a main loop that idles only draws (and clears it) when it is set:
+	// (so a mode with nothing new to show costs no frames at all)
+	bool redraw = true;
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
@@ -0,0 +1,34 @@
+#include "Odds.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Odds {
+
+void evaluate(uint8_t const *own, uint32_t own_count, uint32_t unseen, Claims *out) {
+	assert(out);
+	assert(unseen <= MaxDice && own_count <= MaxDice);
+
+	uint32_t counts[Faces + 1] = {};
+	for (uint32_t i = 0; i < own_count; ++i) {
+		counts[own[i] <= Faces ? own[i] : 0] += 1;
+	}
+
+	//claim (count, face) needs count - counts[face] hidden matches, so each face's row
+	// is a contiguous slice of the tail table starting counts[face] entries earlier:
+	for (uint32_t f = 0; f < Faces; ++f) {
+		float const *row = Tail[unseen].data() + MaxDice - counts[f + 1];
+		std::copy(row + 1, row + 1 + MaxDice, out->p[f].begin());
+	}
+}
+
+float claim_probability(uint8_t const *own, uint32_t own_count, uint32_t unseen, uint32_t count, uint32_t face) {
+	assert(unseen <= MaxDice);
+	int32_t have = 0;
+	for (uint32_t i = 0; i < own_count; ++i) {
+		have += (own[i] == face);
+	}
+	return at_least(unseen, int32_t(count) - have);
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * Odds gives the exact probability that a claim "at least 'count' dice show 'face'"
+ * holds, from the point of view of a player who can see their own dice and knows
+ * how many other dice are hidden.
+ *
+ * Each hidden die shows a given face with probability 1/6, so the claim holds with
+ * probability P(Binomial(unseen, 1/6) >= count - own[face]). Those binomial tails are
+ * computed at compile time; evaluating every claim for a hand is then six contiguous
+ * row copies out of the table.
+ */
+
+#include <array>
+#include <cstdint>
+
+namespace Odds {
+
+constexpr uint32_t Faces = 6;
+constexpr uint32_t MaxDice = 48; //enough for eight players with six dice each
+
+//Tail[n][MaxDice + k] = probability that at least k of n hidden dice show a given face.
+// (entries for k <= 0 are 1.0, so rows can be indexed with k = count - own without clamping)
+constexpr uint32_t TailRow = 2 * MaxDice + 1;
+using TailTable = std::array< std::array< float, TailRow >, MaxDice + 1 >;
+
+constexpr TailTable make_tail_table() {
+	TailTable table{};
+	for (uint32_t n = 0; n <= MaxDice; ++n) {
+		//binomial pmf by recurrence: pmf[i+1] = pmf[i] * (n-i)/(i+1) * (1/6)/(5/6)
+		double pmf[MaxDice + 1] = {};
+		pmf[0] = 1.0;
+		for (uint32_t i = 0; i < n; ++i) pmf[0] *= 5.0 / 6.0;
+		for (uint32_t i = 0; i < n; ++i) pmf[i + 1] = pmf[i] * double(n - i) / double(i + 1) / 5.0;
+		//suffix sums give the tail:
+		double tail = 0.0;
+		for (uint32_t k = MaxDice; k <= MaxDice; --k) {
+			if (k <= n) tail += pmf[k];
+			table[n][MaxDice + k] = float(k == 0 ? 1.0 : tail);
+		}
+		for (uint32_t k = 0; k < MaxDice; ++k) table[n][k] = 1.0f;
+	}
+	return table;
+}
+inline constexpr TailTable Tail = make_tail_table();
+
+//probability that at least 'k' of 'unseen' hidden dice show a given face:
+inline float at_least(uint32_t unseen, int32_t k) {
+	return Tail[unseen][uint32_t(int32_t(MaxDice) + (k < 0 ? 0 : k))];
+}
+
+//Probabilities for every claim, indexed [face-1][count-1]:
+struct Claims {
+	std::array< std::array< float, MaxDice >, Faces > p;
+	float operator()(uint32_t count, uint32_t face) const { return p[face - 1][count - 1]; }
+};
+
+//Evaluate all claims (count 1..MaxDice, face 1..6) for a hand of 'own_count' dice with 'unseen' hidden dice:
+void evaluate(uint8_t const *own, uint32_t own_count, uint32_t unseen, Claims *out);
+
+//Probability of a single claim:
+float claim_probability(uint8_t const *own, uint32_t own_count, uint32_t unseen, uint32_t count, uint32_t face);
+
+}
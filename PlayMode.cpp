@@ -3,26 +3,26 @@
 #include "DrawLines.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
-#include "hex_dump.hpp"
+#include "Protocol.hpp"
+#include "Profile.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <random>
 
-PlayMode::PlayMode(Client &client_, std::string name_) : client(client_) {
+//Protocol capabilities this client can use:
+static constexpr uint16_t ClientCapabilities = Protocol::CapPacked | Protocol::CapTables | Protocol::CapResume | Protocol::CapCompression;
+
+PlayMode::PlayMode(Client &client_, std::string name_) : table(name_), client(client_) {
 	name = name_;
-	client.connections.back().send('j');
-	client.connections.back().send(uint8_t(name.size() >> 16));
-	client.connections.back().send(uint8_t((name.size() >> 8) % 256));
-	client.connections.back().send(uint8_t(name.size() % 256));
-	std::vector<char>* send_buf = &client.connections.back().send_buffer;
-	send_buf->insert(send_buf->end(), name.begin(), name.end());
+	//offer this client's version and capabilities (the server answers with what it accepted):
+	Protocol::send_hello(client.connections.back().send_buffer, Protocol::Version, ClientCapabilities, name);
 	players.push_back(std::make_pair(name, true));
 	game_state = 0;
 	waiting_room_panel = std::make_shared<view::WaitingRoomPanel>();
 	waiting_room_panel->set_players(players);
 	waiting_room_panel->set_listener_on_start([this]() {
-		client.connections.back().send('s');
+		Protocol::send_start(client.connections.back().send_buffer);
 	});
 }
 
@@ -32,11 +32,16 @@ PlayMode::~PlayMode() {
 bool PlayMode::
 handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
 	if (evt.type == SDL_KEYDOWN) {
+		redraw = true; //(the panels answer every key)
 		if (state == State::WAITING){
 			if (evt.key.keysym.sym == SDLK_RETURN){
 				action = 1;
 			}
 		}
+		if (evt.key.keysym.sym == SDLK_h) {
+			show_hints = !show_hints;
+			update_hints();
+		}
 		if (panel_state == 0) {
 			waiting_room_panel->handle_keypress(evt.key.keysym.sym);
 		} else {
@@ -47,103 +52,134 @@ handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
 	return false;
 }
 
+//----- server message handling -----
+//(TableState decodes the messages; these react to what changed)
+
+//the waiting room lists everyone seated so far, in seat order:
+static void update_players(PlayMode &pm) {
+	pm.players.clear();
+	for (uint8_t seat = 0; seat < pm.table.seats; ++seat) {
+		if (!pm.table.seat_names[seat].empty()) pm.players.push_back(std::make_pair(pm.table.seat_names[seat], seat == pm.table.seat));
+	}
+	if (pm.panel_state == 0) {
+		pm.waiting_room_panel->set_players(pm.players);
+	}
+}
+
+//our seat and the size of the table (CapTables):
+static void on_seat(PlayMode &pm) {
+	if (pm.in_game_panel) pm.in_game_panel->set_table_dice(6 * pm.table.seats);
+}
+
+//server tells you the state of your dice:
+static void on_dice(PlayMode &pm) {
+	if (pm.to_be_update) {
+		pm.dices.assign(pm.table.dice, pm.table.dice + 6);
+		if (pm.panel_state == 0) {
+			pm.switch_to_in_game();
+		}
+		pm.in_game_panel->set_self_dices(pm.dices);
+		Odds::evaluate(pm.dices.data(), uint32_t(pm.dices.size()), 6u * (pm.table.seats - 1u), &pm.claim_odds);
+		pm.update_hints();
+	}
+}
+
+//whose turn it is and the current claim:
+static void on_action(PlayMode &pm) {
+	if (pm.to_be_update) {
+		if (pm.table.active) {
+			//about to make claim
+			pm.state = PlayMode::State::CLAIM;
+			if (pm.first_round) {
+				//go to makeclaim dialog directly
+				if (pm.panel_state == 1) {
+					pm.in_game_panel->set_state_make_claim(pm.table.dice_num, pm.table.dice_point);
+				}
+			} else {
+				//go to respond dialog
+				if (pm.panel_state == 1) {
+					pm.in_game_panel->set_state_respond_claim(pm.table.dice_num, pm.table.dice_point);
+				}
+			}
+			pm.to_be_update = false;
+		} else {
+			//waiting others
+			std::cout << "wating response" << std::endl;
+			pm.in_game_panel->set_state_waiting_others();
+		}
+		pm.first_round = false;
+	}
+}
+
+//winner and every seat's dice, in seat order:
+// (the list is kept between games, so showing it again reuses its strings and vectors)
+static void on_result(PlayMode &pm) {
+	TableState const &table = pm.table;
+	std::cout << "winner " << (int) table.winner << std::endl;
+	pm.reveal.resize(table.revealed_seats);
+	for (uint8_t seat = 0; seat < table.revealed_seats; ++seat) {
+		std::string const &seat_name = table.seat_names[seat];
+		if (seat_name.empty()) {
+			pm.reveal[seat].first = "Seat " + std::to_string(seat + 1);
+		} else {
+			pm.reveal[seat].first = seat_name;
+		}
+		pm.reveal[seat].second.assign(table.revealed_dice + 6 * seat, table.revealed_dice + 6 * seat + 6);
+	}
+	pm.in_game_panel->set_state_reveal(pm.reveal, table.winner == table.seat);
+}
+
+static void on_session(PlayMode &pm) {
+	if (pm.resuming && pm.table.session == 0) {
+		throw std::runtime_error("Lost connection to server (and the seat with it)!");
+	}
+	pm.resuming = false;
+}
+
 void PlayMode::update(float elapsed) {
+	Profile::Zone zone("PlayMode::update");
 
 	//send/receive data:
-	client.poll([this](Connection *c, Connection::Event event){
+	bool lost = false;
+	client.poll([this, &lost](Connection *c, Connection::Event event){
 		if (event == Connection::OnOpen) {
 			std::cout << "[" << c->socket << "] opened" << std::endl;
 		} else if (event == Connection::OnClose) {
 			std::cout << "[" << c->socket << "] closed (!)" << std::endl;
-			throw std::runtime_error("Lost connection to server!");
+			if (!table.session) throw std::runtime_error("Lost connection to server!");
+			lost = true;
 		} else { assert(event == Connection::OnRecv);
-			std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-			//expecting message(s) like 'm' + 3-byte length + length bytes of text:
-			while (c->recv_buffer.size() >= 1) {
-				std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-				char type = c->recv_buffer[0];
-				switch (type)
-				{
-				case 'n':{ //< in waiting room, tells name of other players an self id.
-					id = c->recv_buffer[1];
-					uint32_t size = (
-						(uint32_t(c->recv_buffer[2]) << 16) | (uint32_t(c->recv_buffer[3]) << 8) | (uint32_t(c->recv_buffer[4]))
-					);
-					if (c->recv_buffer.size() < 5 + size) break; //if whole message isn't here, can't process
-					//whole message *is* here, so set current server message:
-					other_name = std::string(c->recv_buffer.begin() + 5, c->recv_buffer.begin() + 5 + size);
-					if (!other_player_present){
-						players.push_back(std::make_pair(other_name, false));
-						other_player_present = true;
-					}
-					if (panel_state == 0) {
-						waiting_room_panel->set_players(players);
-					}
-					//and consume this part of the buffer:
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5 + size);
-					break;
-				}
-				case 'd':{ /// server tells you the state of my dice
-					if (c->recv_buffer.size() < 7) break;
-					if(to_be_update){
-						dices.clear();
-						dices.insert(dices.begin(), c->recv_buffer.begin() + 1, c->recv_buffer.begin() + 7);
-						if (panel_state == 0) {
-							switch_to_in_game();
-						}
-						in_game_panel->set_self_dices(dices);
-					}
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 7);
-					break;
-				}
-				case 'c':{ ///
-					if(to_be_update){
-						if (c->recv_buffer[1] == 'a'){
-							//about to make claim
-							state = State::CLAIM;
-							dice_num = c->recv_buffer[2];
-							dice_point = c->recv_buffer[3];
-							if (first_round){
-								//go to makeclaim dialog directly
-								if (panel_state == 1) {
-									in_game_panel->set_state_make_claim();
-								}
-							}else{
-								//go to respond dialog
-								if (panel_state == 1) {
-									in_game_panel->set_state_respond_claim(dice_num, dice_point);
-								}
-							}
-							to_be_update = false;
-						}else{
-							//waiting others
-							std::cout<<"wating response" << std::endl;
-							in_game_panel->set_state_waiting_others();
-						}
-						first_round = false;
-					}
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4);
-					break;
-				}
-				case 'r':{
-					winner = c->recv_buffer[1];
-					bool win = (winner == id) ? true:false;
-					std::cout<<"winner "<<(int) winner<<std::endl;
-					std::vector<std::pair<std::string, std::vector<uint8_t>>> res;
-					other_dices.clear();
-					other_dices.insert(other_dices.begin(), c->recv_buffer.begin() + 2, c->recv_buffer.begin() + 8);
-					res.push_back(std::make_pair(other_name, other_dices));
-					res.push_back(std::make_pair(name, dices));
-					in_game_panel->set_state_reveal(res,win);
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 8);
-					break;
-				}
-				default:
-					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
-				}
-			}
+			//(handled below, once the poll is done)
 		}
 	}, 0.0);
+
+	//decode every complete message from the server, reacting to each change in order, then consume them all at once:
+	// (most ticks repeat what the server said last time, and change nothing on screen)
+	std::vector< char > &recv_buffer = client.connection.recv_buffer;
+	size_t at = 0;
+	while (TableState::Change change = table.next(recv_buffer, &at)) {
+		redraw = true;
+		switch (change) {
+			case TableState::Seat: on_seat(*this); break;
+			case TableState::Names: update_players(*this); break;
+			case TableState::Dice: on_dice(*this); break;
+			case TableState::Action: on_action(*this); break;
+			case TableState::Result: on_result(*this); break;
+			case TableState::Session: on_session(*this); break;
+			case TableState::Invalid:
+				throw std::runtime_error("Server sent an unknown or malformed message!");
+			default: break;
+		}
+	}
+	recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + at);
+
+	//a dropped connection: get our seat back on a new one, and whatever we missed with it:
+	// (anything we sent that hadn't gone out yet is lost, but the server keeps asking for our move)
+	if (lost) {
+		client.reconnect();
+		resuming = true;
+		Protocol::send_resume(client.connection.send_buffer, table.session, table.received);
+	}
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
@@ -161,22 +197,32 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	GL_ERRORS();
 }
 
+void PlayMode::update_hints() {
+	if (!in_game_panel) return;
+	if (show_hints) {
+		in_game_panel->set_hint_odds([this](int claim_replica, int claim_digit) {
+			return claim_odds(uint32_t(claim_replica), uint32_t(claim_digit));
+		});
+	} else {
+		in_game_panel->set_hint_odds(nullptr);
+	}
+}
+
 void PlayMode::switch_to_in_game() {
 	panel_state = 1;
 	waiting_room_panel.reset();
 	in_game_panel = std::make_shared<view::InGamePanel>();
+	in_game_panel->set_table_dice(6 * table.seats);
 	in_game_panel->set_listener_make_claim([this](int claim_replica_, int claim_digit_) {
-		client.connections.back().send('c');
-		client.connections.back().send((uint8_t) claim_replica_);
-		client.connections.back().send((uint8_t) claim_digit_);
+		Protocol::send_claim(client.connections.back().send_buffer, (table.capabilities & Protocol::CapPacked), (uint8_t) claim_replica_, (uint8_t) claim_digit_);
 		to_be_update = true;
 	});
 	in_game_panel->set_listener_respond_claim([this](int respond){
 		if (respond == 0) {
-			client.connections.back().send('r');
+			Protocol::send_reveal(client.connections.back().send_buffer);
 			to_be_update = true;
 		} else {
-			in_game_panel->set_state_make_claim();
+			in_game_panel->set_state_make_claim(table.dice_num, table.dice_point);
 		}
 	});
 	in_game_panel->set_listener_done_reveal([](){ std::exit(0); });
@@ -2,6 +2,8 @@
 
 #include "Connection.hpp"
 #include "GameView.hpp"
+#include "Odds.hpp"
+#include "TableState.hpp"
 
 #include <glm/glm.hpp>
 
@@ -23,13 +25,12 @@ struct PlayMode : Mode {
 	//----- game state -----
 	std::string name;
 	std::vector<std::pair<std::string, bool>> players;
-	uint8_t id = 0;
-	bool other_player_present = false;
-	std::string other_name;
+	//what the server has said about our table (and session):
+	TableState table;
 	bool first_round = true;
-	uint8_t dice_num = 1;
-	uint8_t dice_point = 2;
-	uint8_t winner = 2;
+	bool resuming = false; //sent a resume on a new connection, waiting for the answer
+	//the last reveal, as shown (kept so that showing the next reuses it):
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> reveal;
 	enum class State{
 		WAITING,
 		PLAYING,
@@ -41,7 +42,11 @@ struct PlayMode : Mode {
 
 	int action = 0;
 	std::vector<uint8_t> dices;
-	std::vector<uint8_t> other_dices;
+
+	//optional odds overlay (toggled with 'H'):
+	bool show_hints = false;
+	Odds::Claims claim_odds; //for own dices against the other player's hidden dices
+	void update_hints();
 
 	//last message from server:
 	std::string server_message;
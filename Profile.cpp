@@ -0,0 +1,136 @@
+#include "Profile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace Profile {
+
+std::atomic< bool > enabled{false};
+
+void enable(bool on) {
+	enabled.store(on, std::memory_order_relaxed);
+}
+
+uint64_t now() {
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//one thread's zones:
+// (only the thread writes; 'head' counts every zone it has recorded, and is stored after the zone)
+// (a slot's fields are atomic only so that a reader racing the thread for the oldest slots isn't
+//  undefined behavior; relaxed, they cost what plain stores do)
+struct Buffer {
+	struct Slot {
+		std::atomic< char const * > name{nullptr};
+		std::atomic< uint64_t > begin{0}, end{0};
+	};
+	std::unique_ptr< Slot[] > slots{new Slot[Capacity]};
+	std::atomic< uint64_t > head{0};
+};
+
+//every thread that has recorded a zone, in the order they started:
+// (kept until exit, so a finished thread's zones are still exported)
+static std::mutex buffers_mutex;
+static std::vector< std::unique_ptr< Buffer > > &buffers() {
+	static std::vector< std::unique_ptr< Buffer > > all;
+	return all;
+}
+
+static Buffer &local_buffer() {
+	static thread_local Buffer *local = nullptr;
+	if (!local) {
+		std::lock_guard< std::mutex > lock(buffers_mutex);
+		buffers().emplace_back(std::make_unique< Buffer >());
+		local = buffers().back().get();
+	}
+	return *local;
+}
+
+void record(char const *name, uint64_t begin, uint64_t end) {
+	Buffer &buffer = local_buffer();
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	Buffer::Slot &slot = buffer.slots[head % Capacity];
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(begin, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void collect(std::vector< Event > *events, std::vector< uint32_t > *threads) {
+	std::lock_guard< std::mutex > lock(buffers_mutex);
+	for (uint32_t t = 0; t < buffers().size(); ++t) {
+		Buffer const &buffer = *buffers()[t];
+		uint64_t head = buffer.head.load(std::memory_order_acquire);
+		uint64_t first = (head > Capacity ? head - Capacity : 0);
+		size_t start = events->size();
+		for (uint64_t i = first; i < head; ++i) {
+			Buffer::Slot const &slot = buffer.slots[i % Capacity];
+			events->emplace_back(Event{slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed)});
+		}
+		//(the thread kept recording while these were copied: drop the ones it may have written over,
+		// including the one it may be writing now)
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = buffer.head.load(std::memory_order_relaxed);
+		if (after + 1 - first > Capacity) {
+			uint64_t lost = std::min(after + 1 - first - Capacity, head - first);
+			events->erase(events->begin() + start, events->begin() + start + size_t(lost));
+		}
+		threads->resize(events->size(), t);
+	}
+}
+
+bool write_trace(std::string const &filename) {
+	std::vector< Event > events;
+	std::vector< uint32_t > threads;
+	collect(&events, &threads);
+	uint64_t origin = ~uint64_t(0);
+	for (Event const &event : events) origin = std::min(origin, event.begin);
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	char const *comma = "\n";
+	for (size_t i = 0; i < events.size(); ++i) {
+		Event const &event = events[i];
+		out << comma << "{\"name\":\"";
+		for (char const *c = event.name; *c; ++c) {
+			if (*c == '"' || *c == '\\') out << '\\';
+			out << *c;
+		}
+		//(timestamps are in microseconds, with the nanoseconds as a fraction)
+		uint64_t ts = event.begin - origin, dur = event.end - event.begin;
+		out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threads[i]
+			<< ",\"ts\":" << ts / 1000 << '.' << char('0' + ts / 100 % 10) << char('0' + ts / 10 % 10) << char('0' + ts % 10)
+			<< ",\"dur\":" << dur / 1000 << '.' << char('0' + dur / 100 % 10) << char('0' + dur / 10 % 10) << char('0' + dur % 10)
+			<< "}";
+		comma = ",\n";
+	}
+	out << "\n]}\n";
+	return bool(out);
+}
+
+std::vector< Total > summary(double seconds) {
+	std::vector< Event > events;
+	std::vector< uint32_t > threads;
+	collect(&events, &threads);
+	uint64_t since = now() - uint64_t(seconds * 1e9);
+
+	std::vector< Total > totals;
+	for (Event const &event : events) {
+		if (event.end < since) continue;
+		auto total = std::find_if(totals.begin(), totals.end(), [&](Total const &t){ return t.name == event.name; });
+		if (total == totals.end()) {
+			totals.emplace_back(Total{event.name, 0, 0.0});
+			total = totals.end() - 1;
+		}
+		total->count += 1;
+		total->ms += double(event.end - event.begin) * 1e-6;
+	}
+	std::sort(totals.begin(), totals.end(), [](Total const &a, Total const &b){ return a.ms > b.ms; });
+	return totals;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * Profile records where a program's time goes, as named zones on each thread:
+ *
+ *   void PlayMode::update(float elapsed) {
+ *       Profile::Zone zone("PlayMode::update");
+ *       ...
+ *
+ * A zone covers the time from its construction to the end of its scope, in nanoseconds. Zones
+ * nest by time (Chrome's trace viewer stacks them that way). Names are kept by pointer, so they
+ * must be string literals (or otherwise outlive the program).
+ *
+ * Nothing is recorded until enable(true). A zone then costs two clock reads and a store into
+ * its thread's buffer: a ring of the last Capacity zones, written only by that thread, so
+ * recording takes no locks. Disabled, a zone is a load and a branch (see ./bench profile).
+ *
+ * write_trace() saves what the buffers hold as Chrome trace JSON (open it in chrome://tracing
+ * or ui.perfetto.dev). summary() totals each zone over the last moments, for an overlay.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Profile {
+
+constexpr uint32_t Capacity = 1 << 16; //zones kept per thread (the oldest are overwritten)
+
+//a finished zone:
+struct Event {
+	char const *name;
+	uint64_t begin, end; //ns (see now())
+};
+
+//on/off for every thread (off to start with):
+extern std::atomic< bool > enabled;
+void enable(bool on);
+
+//nanoseconds on a monotonic clock:
+uint64_t now();
+
+//add a zone to the calling thread's buffer:
+void record(char const *name, uint64_t begin, uint64_t end);
+
+struct Zone {
+	explicit Zone(char const *name_) : name(name_), on(enabled.load(std::memory_order_relaxed)) {
+		if (on) begin = now();
+	}
+	~Zone() {
+		if (on) record(name, begin, now());
+	}
+	Zone(Zone const &) = delete;
+	Zone &operator=(Zone const &) = delete;
+
+	char const *name;
+	bool on;
+	uint64_t begin = 0;
+};
+
+//every thread's zones, oldest first per thread (the number of the thread each came from in 'threads'):
+// (safe to call while other threads record; zones they overwrite during the copy are left out)
+void collect(std::vector< Event > *events, std::vector< uint32_t > *threads);
+
+//write every thread's zones to 'filename' as Chrome trace JSON (returns false if it can't be written):
+bool write_trace(std::string const &filename);
+
+//each zone's count and total time over the 'seconds' up to now, most time first:
+struct Total {
+	char const *name;
+	uint32_t count;
+	double ms;
+};
+std::vector< Total > summary(double seconds = 1.0);
+
+}
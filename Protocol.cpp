@@ -0,0 +1,174 @@
+#include "Protocol.hpp"
+
+#include <cassert>
+#include <type_traits>
+
+namespace Protocol {
+
+//append the type byte and fixed fields of 'message':
+template< typename... Fields >
+static void begin(std::vector< char > &to, Message const &message, Fields... fields) {
+	static_assert((std::is_same_v< Fields, uint8_t > && ...), "fixed fields are single bytes");
+	assert(sizeof...(fields) == message.fixed);
+	to.push_back(message.type);
+	(to.push_back(char(fields)), ...);
+}
+
+//append the type byte and two 64-bit little-endian fixed fields:
+static void begin64(std::vector< char > &to, Message const &message, uint64_t a, uint64_t b) {
+	assert(message.fixed == 16);
+	to.push_back(message.type);
+	for (uint64_t v : {a, b}) {
+		for (uint32_t i = 0; i < 8; ++i) to.push_back(char(v >> (8 * i)));
+	}
+}
+
+//append a 24-bit size and payload:
+static void sized(std::vector< char > &to, char const *begin, size_t size) {
+	assert(size < (1 << 24));
+	to.push_back(char(size >> 16));
+	to.push_back(char((size >> 8) % 256));
+	to.push_back(char(size % 256));
+	to.insert(to.end(), begin, begin + size);
+}
+
+//append a varint size and payload:
+static void varint_sized(std::vector< char > &to, char const *begin, size_t size) {
+	assert(size < (1 << (7 * MaxVarintBytes)));
+	size_t v = size;
+	while (v >= 0x80) {
+		to.push_back(char((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	to.push_back(char(v));
+	to.insert(to.end(), begin, begin + size);
+}
+
+void pack_dice(uint8_t const *dice, uint32_t count, uint8_t *out) {
+	uint32_t bits = 0;
+	uint32_t filled = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		bits |= uint32_t(dice[i] & 0x7) << filled;
+		filled += 3;
+		if (filled >= 8) {
+			*(out++) = uint8_t(bits);
+			bits >>= 8;
+			filled -= 8;
+		}
+	}
+	if (filled) *out = uint8_t(bits);
+}
+
+void unpack_dice(uint8_t const *packed, uint32_t count, uint8_t *dice) {
+	uint32_t bits = 0;
+	uint32_t filled = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (filled < 3) {
+			bits |= uint32_t(*(packed++)) << filled;
+			filled += 8;
+		}
+		dice[i] = uint8_t(bits & 0x7);
+		bits >>= 3;
+		filled -= 3;
+	}
+}
+
+void send_join(std::vector< char > &to, std::string const &name) {
+	begin(to, ToServer::messages[ToServer::Join]);
+	sized(to, name.data(), name.size());
+}
+
+void send_hello(std::vector< char > &to, uint8_t version, uint16_t capabilities, std::string const &name) {
+	begin(to, ToServer::messages[ToServer::Hello], version, uint8_t(capabilities & 0xff), uint8_t(capabilities >> 8));
+	varint_sized(to, name.data(), name.size());
+}
+
+void send_start(std::vector< char > &to) {
+	begin(to, ToServer::messages[ToServer::Start]);
+}
+
+void send_claim(std::vector< char > &to, bool packed, uint8_t dice_num, uint8_t dice_point) {
+	if (packed) {
+		begin(to, ToServer::messages[ToServer::PackedClaim], claim_byte(dice_num, dice_point));
+	} else {
+		begin(to, ToServer::messages[ToServer::Claim], dice_num, dice_point);
+	}
+}
+
+void send_reveal(std::vector< char > &to) {
+	begin(to, ToServer::messages[ToServer::Reveal]);
+}
+
+void send_watch(std::vector< char > &to, uint8_t version, uint16_t capabilities) {
+	begin(to, ToServer::messages[ToServer::Watch], version, uint8_t(capabilities & 0xff), uint8_t(capabilities >> 8));
+}
+
+void send_resume(std::vector< char > &to, uint64_t token, uint64_t received) {
+	begin64(to, ToServer::messages[ToServer::Resume], token, received);
+}
+
+void send_welcome(std::vector< char > &to, uint8_t version, uint16_t capabilities) {
+	begin(to, ToClient::messages[ToClient::Hello], version, uint8_t(capabilities & 0xff), uint8_t(capabilities >> 8));
+}
+
+void send_name(std::vector< char > &to, bool packed, uint8_t player_id, std::string const &name) {
+	if (packed) {
+		begin(to, ToClient::messages[ToClient::PackedName], player_id);
+		varint_sized(to, name.data(), name.size());
+	} else {
+		begin(to, ToClient::messages[ToClient::Name], player_id);
+		sized(to, name.data(), name.size());
+	}
+}
+
+void send_dice(std::vector< char > &to, bool packed, uint8_t const *dice) {
+	if (packed) {
+		uint8_t p[packed_dice_bytes(6)];
+		pack_dice(dice, 6, p);
+		begin(to, ToClient::messages[ToClient::PackedDice], p[0], p[1], p[2]);
+	} else {
+		begin(to, ToClient::messages[ToClient::Dice], dice[0], dice[1], dice[2], dice[3], dice[4], dice[5]);
+	}
+}
+
+void send_action(std::vector< char > &to, bool packed, bool active, uint8_t dice_num, uint8_t dice_point) {
+	if (packed) {
+		begin(to, ToClient::messages[active ? ToClient::PackedActive : ToClient::PackedWait], claim_byte(dice_num, dice_point));
+	} else {
+		begin(to, ToClient::messages[ToClient::Action], uint8_t(active ? 'a' : 'w'), dice_num, dice_point);
+	}
+}
+
+void send_result(std::vector< char > &to, bool packed, uint8_t winner, uint8_t const *dice) {
+	if (packed) {
+		uint8_t p[packed_dice_bytes(6)];
+		pack_dice(dice, 6, p);
+		begin(to, ToClient::messages[ToClient::PackedResult], winner, p[0], p[1], p[2]);
+	} else {
+		begin(to, ToClient::messages[ToClient::Result], winner, dice[0], dice[1], dice[2], dice[3], dice[4], dice[5]);
+	}
+}
+
+void send_seat(std::vector< char > &to, uint8_t seat, uint8_t seats) {
+	begin(to, ToClient::messages[ToClient::Seat], seat, seats);
+}
+
+void send_table_result(std::vector< char > &to, uint8_t winner, uint8_t seats, uint8_t const *packed_dice) {
+	begin(to, ToClient::messages[ToClient::TableResult], winner, seats);
+	varint_sized(to, reinterpret_cast< char const * >(packed_dice), packed_dice_bytes(6 * seats));
+}
+
+void send_session(std::vector< char > &to, uint64_t token, uint64_t position) {
+	begin64(to, ToClient::messages[ToClient::Session], token, position);
+}
+
+void send_repeat(std::vector< char > &to) {
+	begin(to, ToClient::messages[ToClient::Repeat]);
+}
+
+void send_delta(std::vector< char > &to, uint8_t mode, char const *body, size_t size) {
+	begin(to, ToClient::messages[ToClient::Delta], mode);
+	varint_sized(to, body, size);
+}
+
+}
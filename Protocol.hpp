@@ -0,0 +1,282 @@
+#pragma once
+
+/*
+ * Protocol is the single description of every message the client and server exchange.
+ *
+ * Every message is a one-byte type, 'fixed' bytes of fixed-size fields, and optionally
+ * a size followed by that many bytes of payload:
+ * |T |ff|ff|..|sz|sz|sz|payload...|
+ * The size is either 24-bit big-endian (the original format) or a LEB128 varint (packed format).
+ *
+ * The descriptors below drive both the encoders (Protocol.cpp) and dispatch(), which looks
+ * each message's handler up in a compile-time jump table, checks once that the whole message
+ * has arrived, and hands the handler a Frame whose fields can then be read without further checks.
+ *
+ * Handshake: the original client joins with 'j' <name> (protocol version 0, no capabilities).
+ * Newer clients join with 'J' <version> <capabilities> <name>; the server answers 'J' with the
+ * version both sides speak and the subset of capabilities it grants. Optional wire formats are
+ * only used once granted, so old and new clients and servers can share a fleet.
+ *
+ * Packed format (CapPacked): dice are packed three bits per die, name sizes are varints, and
+ * claims are a single combined byte (see claim_byte).
+ *
+ * Spectators join with 'w' <version> <capabilities> instead, get the same 'J' answer, and then
+ * receive the table as seen from no seat: everyone's names (tagged with that player's id), every
+ * claim as a 'wait', and one reveal per seat in seat order. Spectators may not act.
+ *
+ * Tables (CapTables): a table may seat 2-8 players. Clients granted CapTables are told their seat
+ * and the table size ('S'), get everyone's names tagged with that player's seat (as spectators
+ * do), and see the reveal as one 'T' message carrying every seat's dice, packed, in seat order.
+ * Other clients see only the next seat's dice at the reveal.
+ *
+ * Sessions (CapResume): a seated player granted CapResume is sent 'K' <token> <position>, where
+ * <position> is the number of the byte that follows in the session's stream of server bytes (0
+ * when the session starts). If the connection drops, the player has a while to reconnect and send
+ * 'k' <token> <received> as its first message, <received> being the position after the last byte
+ * it got; the server answers 'K' again and resends what was missed from a bounded buffer (or, if
+ * that has been overwritten, carries on from its current position and the next tick brings the
+ * table back up to date). A 'K' with token 0 means the session is gone: join again. Nothing else
+ * may be sent between 'k' and the answer. Both values are 64-bit little-endian.
+ *
+ * Deltas (CapCompression): each tick's update is sent as 'u' (the same as the last) or 'U' (what
+ * changed since the last, or all of it); see Delta.hpp. Other messages are sent as they are.
+ */
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace Protocol {
+
+enum class Size : uint8_t {
+	None, //no payload
+	U24, //24-bit big-endian size
+	Varint, //LEB128 size (at most MaxVarintBytes bytes)
+};
+constexpr uint32_t MaxVarintBytes = 3;
+
+struct Message {
+	char type;
+	uint8_t fixed; //bytes of fixed-size fields after the type byte
+	Size size; //how the (optional) payload size is encoded
+	//bytes needed before the payload size is known:
+	constexpr uint32_t min_header_size() const { return 1 + fixed + (size == Size::U24 ? 3 : size == Size::Varint ? 1 : 0); }
+};
+
+//protocol version spoken by this build (clients that join with 'j' are version 0):
+constexpr uint8_t Version = 1;
+
+//capability bits exchanged in the 'J' handshake:
+enum Capability : uint16_t {
+	CapPacked = 1 << 0, //packed dice, varint sizes, one-byte claims
+	CapCompression = 1 << 1, //state updates sent as deltas against the last one (see Delta.hpp)
+	CapUdp = 1 << 2, //unreliable side channel for state updates
+	CapBatching = 1 << 3, //several updates per message
+	CapTables = 1 << 4, //tables of more than two: seat messages and whole-table reveals
+	CapResume = 1 << 5, //session tokens, to get the seat back after reconnecting
+};
+
+//messages sent by clients; the enum value is the message's handler slot:
+struct ToServer {
+	enum Slot : uint8_t { Join, Start, Claim, Reveal, Hello, PackedClaim, Watch, Resume, Count };
+	static constexpr Message messages[Count] = {
+		{'j', 0, Size::U24}, //join: name
+		{'s', 0, Size::None}, //start the game
+		{'c', 2, Size::None}, //claim: dice_num, dice_point
+		{'r', 0, Size::None}, //reveal
+		{'J', 3, Size::Varint}, //join: version, capabilities (16-bit little-endian), name
+		{'C', 1, Size::None}, //claim: claim_byte
+		{'w', 3, Size::None}, //spectate: version, capabilities (16-bit little-endian)
+		{'k', 16, Size::None}, //resume a session: token, stream position received (64-bit each)
+	};
+};
+
+//messages sent by the server:
+struct ToClient {
+	enum Slot : uint8_t { Name, Dice, Action, Result, Hello, PackedName, PackedDice, PackedActive, PackedWait, PackedResult, Seat, TableResult, Session, Repeat, Delta, Count };
+	static constexpr Message messages[Count] = {
+		{'n', 1, Size::U24}, //other player's name: your id, name
+		{'d', 6, Size::None}, //your dice
+		{'c', 3, Size::None}, //claim state: 'a' (your turn) or 'w' (wait), dice_num, dice_point
+		{'r', 7, Size::None}, //reveal: winner, other player's dice
+		{'J', 3, Size::None}, //join accepted: version, granted capabilities (16-bit little-endian)
+		{'N', 1, Size::Varint}, //other player's name: your id, name
+		{'D', 3, Size::None}, //your dice, packed
+		{'A', 1, Size::None}, //your turn: claim_byte
+		{'W', 1, Size::None}, //other player's turn: claim_byte
+		{'R', 4, Size::None}, //reveal: winner, other player's dice, packed
+		{'S', 2, Size::None}, //your seat, seats at the table
+		{'T', 2, Size::Varint}, //reveal: winner, seats at the table, every seat's dice (packed, in seat order)
+		{'K', 16, Size::None}, //your session: token, stream position of the next byte (64-bit each)
+		{'u', 0, Size::None}, //this tick's update is the same as the last delta's
+		{'U', 1, Size::Varint}, //this tick's update: Delta::Mode, body
+	};
+};
+
+//----- packed fields -----
+
+//a claim of 'dice_num' dice showing 'dice_point' in one byte (valid for dice_num <= MaxClaimDice):
+// (so eight seats' 48 dice can't all be claimed; claims stop at 42)
+constexpr uint8_t MaxClaimDice = 42;
+constexpr uint8_t claim_byte(uint8_t dice_num, uint8_t dice_point) {
+	return uint8_t((dice_num - 1) * 6 + (dice_point - 1));
+}
+constexpr uint8_t claim_num(uint8_t byte) { return uint8_t(byte / 6 + 1); }
+constexpr uint8_t claim_point(uint8_t byte) { return uint8_t(byte % 6 + 1); }
+
+//dice values (0-7) packed three bits each, least significant bits first:
+constexpr uint32_t packed_dice_bytes(uint32_t count) { return (count * 3 + 7) / 8; }
+void pack_dice(uint8_t const *dice, uint32_t count, uint8_t *out);
+void unpack_dice(uint8_t const *packed, uint32_t count, uint8_t *dice);
+
+//read a LEB128 value of at most MaxVarintBytes bytes:
+// returns bytes used, 0 if incomplete, -1 if too long
+inline int32_t read_varint(char const *data, size_t available, uint32_t *value) {
+	uint32_t v = 0;
+	for (uint32_t i = 0; i < MaxVarintBytes; ++i) {
+		if (i >= available) return 0;
+		uint8_t byte = uint8_t(data[i]);
+		v |= uint32_t(byte & 0x7f) << (7 * i);
+		if (!(byte & 0x80)) {
+			*value = v;
+			return int32_t(i + 1);
+		}
+	}
+	return -1;
+}
+
+//type byte -> handler slot (Invalid for unknown types), built at compile time:
+constexpr uint8_t Invalid = 0xff;
+template< typename Direction >
+constexpr std::array< uint8_t, 256 > make_slots() {
+	std::array< uint8_t, 256 > slots{};
+	for (auto &s : slots) s = Invalid;
+	for (uint8_t i = 0; i < Direction::Count; ++i) {
+		slots[uint8_t(Direction::messages[i].type)] = i;
+	}
+	return slots;
+}
+template< typename Direction >
+constexpr std::array< uint8_t, 256 > Slots = make_slots< Direction >();
+
+//A complete message (already bounds-checked by dispatch):
+struct Frame {
+	char const *data; //points at the type byte
+	uint32_t header; //offset of the payload
+	uint32_t size; //total size in bytes, including type and header
+	//fixed field 'i' (0-based, after the type byte):
+	uint8_t field(uint32_t i) const { return uint8_t(data[1 + i]); }
+	//16-bit little-endian fixed field starting at 'i':
+	uint16_t field16(uint32_t i) const { return uint16_t(field(i) | (field(i + 1) << 8)); }
+	//64-bit little-endian fixed field starting at 'i':
+	uint64_t field64(uint32_t i) const {
+		uint64_t v = 0;
+		for (uint32_t b = 0; b < 8; ++b) v |= uint64_t(field(i + b)) << (8 * b);
+		return v;
+	}
+	char const *payload() const { return data + header; }
+	uint32_t payload_size() const { return size - header; }
+};
+
+template< typename Context, typename Direction >
+using Handlers = std::array< bool (*)(Context &, Frame const &), Direction::Count >;
+
+//Measure the message at the front of 'data' (which must not be empty):
+// returns its total size and sets *slot and *header; returns 0 if it hasn't fully arrived,
+// or -1 if it has an unknown type or an overlong size.
+template< typename Direction >
+int64_t frame(char const *data, size_t available, uint8_t *slot_, uint32_t *header_) {
+	constexpr auto const &slots = Slots< Direction >;
+	uint8_t slot = slots[uint8_t(data[0])];
+	if (slot == Invalid) return -1;
+	Message const &message = Direction::messages[slot];
+	uint32_t header = message.min_header_size();
+	if (available < header) return 0;
+	uint32_t size = header;
+	if (message.size == Size::U24) {
+		size += (uint32_t(uint8_t(data[header-3])) << 16) | (uint32_t(uint8_t(data[header-2])) << 8) | uint32_t(uint8_t(data[header-1]));
+	} else if (message.size == Size::Varint) {
+		uint32_t payload = 0;
+		int32_t used = read_varint(data + header - 1, available - (header - 1), &payload);
+		if (used <= 0) return used; //(incomplete or overlong)
+		header += used - 1;
+		size = header + payload;
+	}
+	if (available < size) return 0;
+	*slot_ = slot;
+	*header_ = header;
+	return int64_t(size);
+}
+
+//Decode every complete message at the front of 'buffer', call its handler, then erase all of them at once.
+// Stops at the first incomplete message (which stays in the buffer), or after 'limit' messages.
+// Returns false if a message has an unknown type or a handler rejects it.
+template< typename Direction, typename Context >
+bool dispatch(Handlers< Context, Direction > const &handlers, Context &context, std::vector< char > &buffer, uint64_t *handled = nullptr, uint32_t limit = ~0u) {
+	size_t at = 0;
+	bool ok = true;
+	for (uint32_t count = 0; at < buffer.size() && count < limit; ++count) {
+		uint8_t slot = 0;
+		uint32_t header = 0;
+		int64_t size = frame< Direction >(buffer.data() + at, buffer.size() - at, &slot, &header);
+		if (size < 0) {
+			ok = false;
+			break;
+		}
+		if (size == 0) break;
+		if (!handlers[slot](context, Frame{buffer.data() + at, header, uint32_t(size)})) {
+			ok = false;
+			break;
+		}
+		at += size_t(size);
+		if (handled) *handled += 1;
+	}
+	buffer.erase(buffer.begin(), buffer.begin() + at);
+	return ok;
+}
+
+//Find the complete messages at the front of 'buffer' (at most 'limit') without handling them, so
+// they can be handed to whoever will dispatch() them: returns their size in bytes and adds their
+// number to *count. Sets *invalid if the message after them has an unknown type or an overlong size.
+template< typename Direction >
+size_t split(std::vector< char > const &buffer, uint32_t limit, uint32_t *count, bool *invalid) {
+	size_t at = 0;
+	for (uint32_t n = 0; at < buffer.size() && n < limit; ++n) {
+		uint8_t slot = 0;
+		uint32_t header = 0;
+		int64_t size = frame< Direction >(buffer.data() + at, buffer.size() - at, &slot, &header);
+		if (size < 0) *invalid = true;
+		if (size <= 0) break;
+		at += size_t(size);
+		*count += 1;
+	}
+	return at;
+}
+
+//----- encoders (append one message to 'to') -----
+
+//client -> server:
+void send_join(std::vector< char > &to, std::string const &name);
+void send_hello(std::vector< char > &to, uint8_t version, uint16_t capabilities, std::string const &name);
+void send_start(std::vector< char > &to);
+void send_claim(std::vector< char > &to, bool packed, uint8_t dice_num, uint8_t dice_point);
+void send_reveal(std::vector< char > &to);
+void send_watch(std::vector< char > &to, uint8_t version, uint16_t capabilities);
+void send_resume(std::vector< char > &to, uint64_t token, uint64_t received);
+
+//server -> client ('packed' selects the packed format):
+void send_welcome(std::vector< char > &to, uint8_t version, uint16_t capabilities);
+void send_name(std::vector< char > &to, bool packed, uint8_t player_id, std::string const &name);
+void send_dice(std::vector< char > &to, bool packed, uint8_t const *dice);
+void send_action(std::vector< char > &to, bool packed, bool active, uint8_t dice_num, uint8_t dice_point);
+void send_result(std::vector< char > &to, bool packed, uint8_t winner, uint8_t const *dice);
+//(CapTables; always packed)
+void send_seat(std::vector< char > &to, uint8_t seat, uint8_t seats);
+void send_table_result(std::vector< char > &to, uint8_t winner, uint8_t seats, uint8_t const *packed_dice);
+void send_session(std::vector< char > &to, uint64_t token, uint64_t position);
+//(CapCompression; see Delta::encode)
+void send_repeat(std::vector< char > &to);
+void send_delta(std::vector< char > &to, uint8_t mode, char const *body, size_t size);
+
+}
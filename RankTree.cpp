@@ -0,0 +1,378 @@
+#include "RankTree.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//deep enough for 2^40 keys with every node at its smallest (a quarter full):
+static constexpr uint32_t MaxHeight = 16;
+
+uint32_t RankTree::Inner::child_for(uint64_t key) const {
+	return uint32_t(std::upper_bound(separator, separator + n - 1, key) - separator);
+}
+
+uint32_t RankTree::new_leaf() {
+	if (!free_leaves.empty()) {
+		uint32_t leaf = free_leaves.back();
+		free_leaves.pop_back();
+		leaves[leaf] = Leaf();
+		return leaf;
+	}
+	leaves.emplace_back();
+	return uint32_t(leaves.size() - 1);
+}
+
+uint32_t RankTree::new_inner() {
+	if (!free_inners.empty()) {
+		uint32_t inner = free_inners.back();
+		free_inners.pop_back();
+		inners[inner] = Inner();
+		return inner;
+	}
+	inners.emplace_back();
+	return uint32_t(inners.size() - 1);
+}
+
+static uint32_t sum(RankTree::Inner const &inner) {
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < inner.n; ++i) total += inner.count[i];
+	return total;
+}
+
+uint32_t RankTree::add_child(uint32_t parent, uint32_t at, uint64_t sep, uint32_t node, uint32_t count, uint64_t *split_separator) {
+	{
+		Inner &p = inners[parent];
+		if (p.n < Fanout) {
+			for (uint32_t i = p.n; i > at + 1; --i) {
+				p.child[i] = p.child[i - 1];
+				p.count[i] = p.count[i - 1];
+			}
+			for (uint32_t i = p.n - 1; i > at; --i) {
+				p.separator[i] = p.separator[i - 1];
+			}
+			p.child[at + 1] = node;
+			p.count[at + 1] = count;
+			p.separator[at] = sep;
+			p.n += 1;
+			return None;
+		}
+	}
+	//full: line up all Fanout + 1 children, then give the right half to a new node:
+	uint32_t children[Fanout + 1], counts[Fanout + 1];
+	uint64_t separators[Fanout];
+	{
+		Inner const &p = inners[parent];
+		for (uint32_t i = 0, o = 0; i < Fanout; ++i, ++o) {
+			children[o] = p.child[i];
+			counts[o] = p.count[i];
+			if (i == at) {
+				++o;
+				children[o] = node;
+				counts[o] = count;
+			}
+		}
+		for (uint32_t i = 0, o = 0; i + 1 < Fanout; ++i, ++o) {
+			if (i == at) separators[o++] = sep;
+			separators[o] = p.separator[i];
+		}
+		if (at == Fanout - 1) separators[Fanout - 1] = sep;
+	}
+	uint32_t right = new_inner();
+	Inner &l = inners[parent], &r = inners[right];
+	constexpr uint32_t Half = (Fanout + 1) / 2;
+	l.n = Half;
+	std::copy(children, children + Half, l.child);
+	std::copy(counts, counts + Half, l.count);
+	std::copy(separators, separators + Half - 1, l.separator);
+	r.n = Fanout + 1 - Half;
+	std::copy(children + Half, children + Fanout + 1, r.child);
+	std::copy(counts + Half, counts + Fanout + 1, r.count);
+	std::copy(separators + Half, separators + Fanout, r.separator);
+	*split_separator = separators[Half - 1];
+	return right;
+}
+
+void RankTree::insert(uint64_t key) {
+	if (root == None) root = new_leaf();
+	uint32_t path[MaxHeight], slot[MaxHeight];
+	uint32_t node = root;
+	for (uint32_t d = 0; d < height; ++d) {
+		Inner &inner = inners[node];
+		uint32_t i = inner.child_for(key);
+		inner.count[i] += 1;
+		path[d] = node;
+		slot[d] = i;
+		node = inner.child[i];
+	}
+	total += 1;
+
+	uint32_t at;
+	{
+		Leaf &leaf = leaves[node];
+		at = uint32_t(std::lower_bound(leaf.keys, leaf.keys + leaf.n, key) - leaf.keys);
+		assert(at == leaf.n || leaf.keys[at] != key);
+		if (leaf.n < LeafKeys) {
+			std::copy_backward(leaf.keys + at, leaf.keys + leaf.n, leaf.keys + leaf.n + 1);
+			leaf.keys[at] = key;
+			leaf.n += 1;
+			return;
+		}
+	}
+
+	//full: split the leaf, then hand the right half up (splitting parents as needed):
+	uint32_t right = new_leaf();
+	Leaf &l = leaves[node], &r = leaves[right];
+	constexpr uint32_t Half = LeafKeys / 2;
+	r.n = LeafKeys - Half;
+	std::copy(l.keys + Half, l.keys + LeafKeys, r.keys);
+	l.n = Half;
+	r.next = l.next;
+	l.next = right;
+	Leaf &into = (at <= Half ? l : r);
+	if (at > Half) at -= Half;
+	std::copy_backward(into.keys + at, into.keys + into.n, into.keys + into.n + 1);
+	into.keys[at] = key;
+	into.n += 1;
+
+	uint64_t separator = r.keys[0];
+	uint32_t child = right, count = r.n, left_count = l.n;
+	for (uint32_t d = height; d-- > 0; ) {
+		inners[path[d]].count[slot[d]] = left_count;
+		uint64_t up = 0;
+		uint32_t split = add_child(path[d], slot[d], separator, child, count, &up);
+		if (split == None) return;
+		left_count = sum(inners[path[d]]);
+		count = sum(inners[split]);
+		separator = up;
+		child = split;
+	}
+	//the root itself was split, so the tree grows a level:
+	uint32_t top = new_inner();
+	Inner &t = inners[top];
+	t.n = 2;
+	t.child[0] = root;
+	t.child[1] = child;
+	t.count[0] = left_count;
+	t.count[1] = count;
+	t.separator[0] = separator;
+	root = top;
+	height += 1;
+	assert(height < MaxHeight);
+}
+
+//drop child 'j' (> 0) of 'inner', along with the separator in front of it:
+static void remove_slot(RankTree::Inner &inner, uint32_t j) {
+	for (uint32_t i = j; i + 1 < inner.n; ++i) {
+		inner.child[i] = inner.child[i + 1];
+		inner.count[i] = inner.count[i + 1];
+	}
+	for (uint32_t i = j - 1; i + 2 < inner.n; ++i) {
+		inner.separator[i] = inner.separator[i + 1];
+	}
+	inner.n -= 1;
+}
+
+bool RankTree::erase(uint64_t key) {
+	if (root == None) return false;
+	uint32_t path[MaxHeight], slot[MaxHeight];
+	uint32_t node = root;
+	for (uint32_t d = 0; d < height; ++d) {
+		Inner const &inner = inners[node];
+		uint32_t i = inner.child_for(key);
+		path[d] = node;
+		slot[d] = i;
+		node = inner.child[i];
+	}
+	{
+		Leaf &leaf = leaves[node];
+		uint32_t at = uint32_t(std::lower_bound(leaf.keys, leaf.keys + leaf.n, key) - leaf.keys);
+		if (at == leaf.n || leaf.keys[at] != key) return false;
+		std::copy(leaf.keys + at + 1, leaf.keys + leaf.n, leaf.keys + at);
+		leaf.n -= 1;
+	}
+	total -= 1;
+	for (uint32_t d = 0; d < height; ++d) {
+		inners[path[d]].count[slot[d]] -= 1;
+	}
+
+	//a node under a quarter full is merged with a sibling, or evened out with it if both won't fit in one:
+	for (uint32_t d = height; d-- > 0; ) {
+		Inner &p = inners[path[d]];
+		uint32_t c = p.child[slot[d]];
+		bool leaf_level = (d + 1 == height);
+		if (leaf_level ? leaves[c].n >= LeafKeys / 4 : inners[c].n >= Fanout / 4) break;
+		if (p.n < 2) break; //(only the root can have one child; it is replaced below)
+		uint32_t a = (slot[d] > 0 ? slot[d] - 1 : 0); //merge children a and a + 1
+		if (leaf_level) {
+			Leaf &l = leaves[p.child[a]], &r = leaves[p.child[a + 1]];
+			if (l.n + r.n <= LeafKeys) {
+				std::copy(r.keys, r.keys + r.n, l.keys + l.n);
+				l.n += r.n;
+				l.next = r.next;
+				free_leaves.emplace_back(p.child[a + 1]);
+				p.count[a] += p.count[a + 1];
+				remove_slot(p, a + 1);
+			} else {
+				uint64_t keys[2 * LeafKeys];
+				uint32_t n = l.n + r.n;
+				std::copy(l.keys, l.keys + l.n, keys);
+				std::copy(r.keys, r.keys + r.n, keys + l.n);
+				l.n = n / 2;
+				r.n = n - l.n;
+				std::copy(keys, keys + l.n, l.keys);
+				std::copy(keys + l.n, keys + n, r.keys);
+				p.separator[a] = r.keys[0];
+				p.count[a] = l.n;
+				p.count[a + 1] = r.n;
+			}
+		} else {
+			Inner &l = inners[p.child[a]], &r = inners[p.child[a + 1]];
+			//(the parent's separator goes between the two halves' own)
+			uint32_t children[2 * Fanout], counts[2 * Fanout];
+			uint64_t separators[2 * Fanout];
+			uint32_t n = l.n + r.n;
+			std::copy(l.child, l.child + l.n, children);
+			std::copy(r.child, r.child + r.n, children + l.n);
+			std::copy(l.count, l.count + l.n, counts);
+			std::copy(r.count, r.count + r.n, counts + l.n);
+			std::copy(l.separator, l.separator + l.n - 1, separators);
+			separators[l.n - 1] = p.separator[a];
+			std::copy(r.separator, r.separator + r.n - 1, separators + l.n);
+			if (n <= Fanout) {
+				l.n = n;
+				std::copy(children, children + n, l.child);
+				std::copy(counts, counts + n, l.count);
+				std::copy(separators, separators + n - 1, l.separator);
+				free_inners.emplace_back(p.child[a + 1]);
+				p.count[a] += p.count[a + 1];
+				remove_slot(p, a + 1);
+			} else {
+				l.n = n / 2;
+				r.n = n - l.n;
+				std::copy(children, children + l.n, l.child);
+				std::copy(counts, counts + l.n, l.count);
+				std::copy(separators, separators + l.n - 1, l.separator);
+				p.separator[a] = separators[l.n - 1];
+				std::copy(children + l.n, children + n, r.child);
+				std::copy(counts + l.n, counts + n, r.count);
+				std::copy(separators + l.n, separators + n - 1, r.separator);
+				p.count[a] = sum(l);
+				p.count[a + 1] = sum(r);
+			}
+		}
+	}
+	//a root with one child hands the job down:
+	while (height > 0 && inners[root].n == 1) {
+		free_inners.emplace_back(root);
+		root = inners[root].child[0];
+		height -= 1;
+	}
+	return true;
+}
+
+void RankTree::clear() {
+	leaves.clear();
+	inners.clear();
+	free_leaves.clear();
+	free_inners.clear();
+	root = None;
+	height = 0;
+	total = 0;
+}
+
+void RankTree::assign(std::vector< uint64_t > const &keys) {
+	clear();
+	if (keys.empty()) return;
+	assert(std::is_sorted(keys.begin(), keys.end()));
+	total = keys.size();
+
+	//leaves three quarters full (room to insert before splitting), spread evenly:
+	std::vector< uint32_t > level, counts;
+	std::vector< uint64_t > firsts; //smallest key under each node of 'level'
+	size_t groups = (keys.size() + LeafKeys * 3 / 4 - 1) / (LeafKeys * 3 / 4);
+	leaves.resize(groups);
+	for (size_t g = 0; g < groups; ++g) {
+		size_t begin = keys.size() * g / groups, end = keys.size() * (g + 1) / groups;
+		Leaf &leaf = leaves[g];
+		leaf.n = uint32_t(end - begin);
+		leaf.next = (g + 1 < groups ? uint32_t(g + 1) : None);
+		std::copy(keys.begin() + begin, keys.begin() + end, leaf.keys);
+		level.emplace_back(uint32_t(g));
+		counts.emplace_back(leaf.n);
+		firsts.emplace_back(leaf.keys[0]);
+	}
+
+	//then inner levels the same way until one node is left:
+	while (level.size() > 1) {
+		std::vector< uint32_t > up, up_counts;
+		std::vector< uint64_t > up_firsts;
+		groups = (level.size() + Fanout * 3 / 4 - 1) / (Fanout * 3 / 4);
+		for (size_t g = 0; g < groups; ++g) {
+			size_t begin = level.size() * g / groups, end = level.size() * (g + 1) / groups;
+			uint32_t node = new_inner();
+			Inner &inner = inners[node];
+			inner.n = uint32_t(end - begin);
+			uint32_t total_count = 0;
+			for (size_t i = begin; i < end; ++i) {
+				inner.child[i - begin] = level[i];
+				inner.count[i - begin] = counts[i];
+				if (i > begin) inner.separator[i - begin - 1] = firsts[i];
+				total_count += counts[i];
+			}
+			up.emplace_back(node);
+			up_counts.emplace_back(total_count);
+			up_firsts.emplace_back(firsts[begin]);
+		}
+		level = std::move(up);
+		counts = std::move(up_counts);
+		firsts = std::move(up_firsts);
+		height += 1;
+	}
+	root = level[0];
+}
+
+size_t RankTree::rank(uint64_t key) const {
+	if (root == None) return 0;
+	size_t before = 0;
+	uint32_t node = root;
+	for (uint32_t d = 0; d < height; ++d) {
+		Inner const &inner = inners[node];
+		uint32_t i = inner.child_for(key);
+		for (uint32_t j = 0; j < i; ++j) before += inner.count[j];
+		node = inner.child[i];
+	}
+	Leaf const &leaf = leaves[node];
+	return before + size_t(std::lower_bound(leaf.keys, leaf.keys + leaf.n, key) - leaf.keys);
+}
+
+uint64_t RankTree::select(size_t index) const {
+	std::vector< uint64_t > out;
+	range(index, 1, &out);
+	assert(out.size() == 1);
+	return out[0];
+}
+
+void RankTree::range(size_t from, size_t count, std::vector< uint64_t > *out) const {
+	if (from >= total || count == 0) return;
+	uint32_t node = root;
+	for (uint32_t d = 0; d < height; ++d) {
+		Inner const &inner = inners[node];
+		uint32_t i = 0;
+		while (from >= inner.count[i]) {
+			from -= inner.count[i];
+			++i;
+		}
+		node = inner.child[i];
+	}
+	//(then along the leaves)
+	for (uint32_t at = uint32_t(from); node != None && count > 0; node = leaves[node].next, at = 0) {
+		Leaf const &leaf = leaves[node];
+		uint32_t take = uint32_t(std::min< size_t >(count, leaf.n - at));
+		out->insert(out->end(), leaf.keys + at, leaf.keys + at + take);
+		count -= take;
+	}
+}
+
+size_t RankTree::memory() const {
+	return leaves.capacity() * sizeof(Leaf) + inners.capacity() * sizeof(Inner)
+		+ (free_leaves.capacity() + free_inners.capacity()) * sizeof(uint32_t);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * RankTree is an ordered set of 64-bit keys that also answers "how many keys are smaller than
+ * this one?" and "which key is the i-th?", each in O(log n) (an order-statistics tree).
+ *
+ * It is a B+tree: keys live in leaves of 64 (512 bytes, a few cache lines, searched in place),
+ * and each inner node keeps, next to each child, the number of keys under it. Ranks come from
+ * adding up those counts on the way down, so there is no per-key pointer chasing as in a
+ * binary tree or skip list. Leaves are linked in order for reading ranges.
+ *
+ * Nodes are kept in two vectors and refer to each other by index, so the whole tree is a
+ * handful of large allocations.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct RankTree {
+	//add 'key' (keys must be unique):
+	void insert(uint64_t key);
+	//remove 'key' (returns false if it wasn't there):
+	bool erase(uint64_t key);
+	//replace the contents with 'keys', which must be sorted and unique (faster than inserting them):
+	void assign(std::vector< uint64_t > const &keys);
+	void clear();
+
+	size_t size() const { return total; }
+	//number of keys less than 'key':
+	size_t rank(uint64_t key) const;
+	//the key with 'index' keys before it (index < size()):
+	uint64_t select(size_t index) const;
+	//append up to 'count' keys in order, starting with select(from), to 'out':
+	void range(size_t from, size_t count, std::vector< uint64_t > *out) const;
+
+	//heap bytes in use:
+	size_t memory() const;
+
+	//----- internals -----
+	static constexpr uint32_t LeafKeys = 64;
+	static constexpr uint32_t Fanout = 32; //children per inner node
+	static constexpr uint32_t None = ~0u;
+	struct Leaf {
+		uint32_t n = 0;
+		uint32_t next = None; //following leaf
+		uint64_t keys[LeafKeys];
+	};
+	struct Inner {
+		uint32_t n = 0; //children
+		uint32_t child[Fanout];
+		uint32_t count[Fanout]; //keys under each child
+		uint64_t separator[Fanout - 1]; //separator[i]: keys in child[i + 1] and later are >= this
+		uint32_t child_for(uint64_t key) const;
+	};
+	std::vector< Leaf > leaves;
+	std::vector< Inner > inners;
+	std::vector< uint32_t > free_leaves, free_inners;
+	uint32_t root = None;
+	uint32_t height = 0; //inner levels above the leaves
+	size_t total = 0;
+
+	uint32_t new_leaf();
+	uint32_t new_inner();
+	//insert child 'node' (with 'count' keys, all >= 'separator') after slot 'at' of inner 'parent':
+	// returns the new inner node if 'parent' had to be split (None otherwise), which the caller adds to the level above
+	uint32_t add_child(uint32_t parent, uint32_t at, uint64_t separator, uint32_t node, uint32_t count, uint64_t *split_separator);
+};
@@ -0,0 +1,178 @@
+#include "Ratings.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char const Magic[4] = {'b','r','t','1'};
+static constexpr uint32_t InitialCapacity = 1024;
+
+Ratings::Ratings(std::string const &path_, int32_t initial_) : initial(initial_), path(path_) {
+	if (path.empty()) {
+		reserve(InitialCapacity);
+		return;
+	}
+#ifdef _WIN32
+	throw std::runtime_error("Memory-mapped ratings are not supported on Windows.");
+#else
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) throw std::system_error(errno, std::system_category(), "failed to open '" + path + "'");
+	struct stat info;
+	if (fstat(fd, &info) != 0) throw std::system_error(errno, std::system_category(), "failed to stat '" + path + "'");
+	if (info.st_size == 0) {
+		reserve(InitialCapacity);
+		return;
+	}
+
+	//an existing file: map all of it, check the header, then index every record:
+	size_t size = size_t(info.st_size);
+	Header header;
+	if (size < sizeof(Header) || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+	 || std::memcmp(header.magic, Magic, 4) != 0 || header.count > header.capacity
+	 || sizeof(Header) + size_t(header.capacity) * sizeof(Record) > size) {
+		throw std::runtime_error("'" + path + "' is not a ratings file.");
+	}
+	void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) throw std::system_error(errno, std::system_category(), "failed to map '" + path + "'");
+	base = static_cast< char * >(mapping);
+	mapped = size;
+	count = header.count;
+	capacity = header.capacity;
+
+	std::vector< uint64_t > keys;
+	keys.reserve(count);
+	by_name.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Record &record = records()[i];
+		record.name[MaxName] = '\0';
+		if (!by_name.emplace(record.name, i).second) {
+			throw std::runtime_error("'" + path + "' rates '" + record.name + "' twice.");
+		}
+		keys.emplace_back(key(record.rating, i));
+	}
+	std::sort(keys.begin(), keys.end());
+	index.assign(keys);
+#endif
+}
+
+Ratings::~Ratings() {
+#ifndef _WIN32
+	if (fd >= 0) {
+		if (base) munmap(base, mapped);
+		::close(fd);
+	}
+#endif
+}
+
+void Ratings::reserve(uint32_t records) {
+	if (records <= capacity) return;
+	uint32_t grown = std::max(records, std::max(InitialCapacity, capacity * 2));
+	size_t bytes = sizeof(Header) + size_t(grown) * sizeof(Record);
+	if (path.empty()) {
+		in_memory.resize(bytes);
+		base = in_memory.data();
+	} else {
+#ifndef _WIN32
+		//(remapping moves the records, so callers re-fetch records() after adding anyone)
+		if (base) munmap(base, mapped);
+		base = nullptr;
+		if (ftruncate(fd, off_t(bytes)) != 0) throw std::system_error(errno, std::system_category(), "failed to grow '" + path + "'");
+		void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mapping == MAP_FAILED) throw std::system_error(errno, std::system_category(), "failed to map '" + path + "'");
+		base = static_cast< char * >(mapping);
+		mapped = bytes;
+#endif
+	}
+	capacity = grown;
+	Header header;
+	std::memcpy(header.magic, Magic, 4);
+	header.count = count;
+	header.capacity = capacity;
+	header.reserved = 0;
+	std::memcpy(base, &header, sizeof(header));
+}
+
+uint32_t Ratings::add(std::string const &name) {
+	std::string const name_key = key_name(name);
+	auto f = by_name.find(name_key);
+	if (f != by_name.end()) return f->second;
+	reserve(count + 1);
+	Record &record = records()[count];
+	std::memset(&record, 0, sizeof(record));
+	std::memcpy(record.name, name_key.data(), name_key.size());
+	record.rating = initial;
+	record.games = 0;
+	by_name.emplace(name_key, count);
+	index.insert(key(initial, count));
+	count += 1;
+	//(the count goes in last, so a crash never leaves it covering a half-written record)
+	reinterpret_cast< Header * >(base)->count = count;
+	return count - 1;
+}
+
+int32_t Ratings::rating(std::string const &name) const {
+	auto f = by_name.find(name.size() > MaxName ? key_name(name) : name);
+	if (f == by_name.end()) return initial;
+	return records()[f->second].rating;
+}
+
+void Ratings::record(std::string const &winner, std::string const &loser) {
+	if (winner.empty() || loser.empty() || key_name(winner) == key_name(loser)) return;
+	uint32_t w = add(winner);
+	uint32_t l = add(loser);
+	Record &won = records()[w], &lost = records()[l];
+
+	//the winner takes more the less they were expected to win:
+	double expected = 1.0 / (1.0 + std::pow(10.0, (lost.rating - won.rating) / 400.0));
+	int32_t delta = std::max< int32_t >(1, int32_t(std::lround(K * (1.0 - expected))));
+
+	index.erase(key(won.rating, w));
+	index.erase(key(lost.rating, l));
+	won.rating += delta;
+	lost.rating -= delta;
+	won.games += 1;
+	lost.games += 1;
+	index.insert(key(won.rating, w));
+	index.insert(key(lost.rating, l));
+	updates += 1;
+}
+
+bool Ratings::find(std::string const &name, Entry *entry) const {
+	auto f = by_name.find(name.size() > MaxName ? key_name(name) : name);
+	if (f == by_name.end()) return false;
+	Record const &record = records()[f->second];
+	*entry = Entry{record.name, record.rating, record.games, index.rank(key(record.rating, f->second))};
+	return true;
+}
+
+void Ratings::top(uint64_t from, uint32_t count_, std::vector< Entry > *out) const {
+	static thread_local std::vector< uint64_t > keys;
+	keys.clear();
+	index.range(size_t(from), count_, &keys);
+	for (uint64_t k : keys) {
+		Record const &record = records()[uint32_t(k)];
+		out->emplace_back(Entry{record.name, record.rating, record.games, from++});
+	}
+}
+
+void Ratings::flush() {
+#ifndef _WIN32
+	if (fd >= 0 && base) msync(base, mapped, MS_ASYNC);
+#endif
+}
+
+size_t Ratings::memory() const {
+	//(the name lookup's size is estimated: a node per name, plus the buckets)
+	size_t names = by_name.size() * (sizeof(std::pair< std::string const, uint32_t >) + 2 * sizeof(void *))
+		+ by_name.bucket_count() * sizeof(void *);
+	return index.memory() + names + in_memory.capacity();
+}
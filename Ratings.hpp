@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * Ratings keeps every player's Elo rating, updated after each reveal between two humans,
+ * and answers leaderboard queries: a player's rank, or the players at ranks [from, from + n).
+ *
+ * Players are known by name (the only identity the game has). Names longer than
+ * MaxName bytes are rated under their first MaxName bytes.
+ *
+ * Records live in a memory-mapped file (./server --ratings <path>), so an update is a
+ * couple of stores into the mapping: the OS writes them back, a crashed server loses
+ * nothing it already applied, and flush() asks for the write-back to start. Without a
+ * path the records are kept in memory only. Memory mapping is Unix only.
+ *
+ * Ranks come from a RankTree over (rating, record) keys, rebuilt when the file is
+ * opened: an update moves one key, and a rank lookup or a page of the leaderboard is a
+ * walk down the tree, both O(log n).
+ *
+ * File (native endian): |b |r |t |1 | count (32-bit) | capacity (32-bit) | (reserved, 32-bit) | Record x capacity
+ */
+
+#include "RankTree.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Ratings {
+	static constexpr uint32_t MaxName = 23;
+	static constexpr int32_t K = 32; //most a rating moves in one game
+
+	//open (or create) the ratings at 'path', or keep them in memory if 'path' is empty:
+	// (throws if the file can't be mapped or isn't a ratings file)
+	explicit Ratings(std::string const &path = "", int32_t initial = 1500);
+	~Ratings();
+	Ratings(Ratings const &) = delete;
+	Ratings &operator=(Ratings const &) = delete;
+
+	//'name's rating ('initial' if they have never finished a game):
+	int32_t rating(std::string const &name) const;
+
+	//'winner' beat 'loser': move both ratings (adds either player if new):
+	void record(std::string const &winner, std::string const &loser);
+
+	struct Entry {
+		std::string name;
+		int32_t rating;
+		uint32_t games;
+		uint64_t rank; //0 is the highest rating (ties go to whoever was rated first)
+	};
+	//look up one player (false if they have no rating):
+	bool find(std::string const &name, Entry *entry) const;
+	//append up to 'count' entries, from rank 'from' down, to 'out':
+	void top(uint64_t from, uint32_t count, std::vector< Entry > *out) const;
+
+	size_t size() const { return count; }
+
+	//start writing changed records back to the file (no-op in memory):
+	void flush();
+
+	//----- stats -----
+	uint64_t updates = 0; //games recorded since opening
+	size_t memory() const; //heap bytes in use (index and name lookup, not the mapping)
+
+	//----- internals -----
+	struct Record {
+		char name[MaxName + 1]; //(nul-terminated)
+		int32_t rating;
+		uint32_t games;
+	};
+	static_assert(sizeof(Record) == 32, "Records are 32 bytes in the file.");
+	struct Header {
+		char magic[4];
+		uint32_t count;
+		uint32_t capacity;
+		uint32_t reserved;
+	};
+
+	int32_t initial;
+	std::string path;
+	int fd = -1;
+	char *base = nullptr; //the mapping (a Header, then the records)
+	size_t mapped = 0; //bytes mapped
+	std::vector< char > in_memory; //(in place of the mapping when there's no path)
+	uint32_t count = 0; //records in use
+	uint32_t capacity = 0;
+
+	Record *records() const { return reinterpret_cast< Record * >(base + sizeof(Header)); }
+	std::unordered_map< std::string, uint32_t > by_name; //record index
+	RankTree index;
+
+	static std::string key_name(std::string const &name) { return name.substr(0, MaxName); }
+	//higher ratings sort first, then lower record indices:
+	static uint64_t key(int32_t rating, uint32_t record) {
+		return (uint64_t(~(uint32_t(rating) ^ 0x80000000u)) << 32) | record;
+	}
+	//index of 'name's record, adding one if need be:
+	uint32_t add(std::string const &name);
+	//make room for at least 'records' records (remapping the file):
+	void reserve(uint32_t records);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * ReplayBuffer keeps the most recent bytes of an outbound stream, so a client that
+ * reconnects can be sent just what it missed (see Protocol::CapResume).
+ *
+ * Positions count every byte ever appended. The buffer holds at most 'capacity' of the
+ * newest ones, growing only as bytes arrive, so a short session never pays for the whole
+ * capacity; after that, new bytes overwrite the oldest.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+struct ReplayBuffer {
+	ReplayBuffer() = default;
+	explicit ReplayBuffer(uint32_t capacity_) : capacity(capacity_) { }
+
+	void append(char const *data, size_t size) {
+		if (capacity == 0) {
+			total += size;
+			return;
+		}
+		//while the ring grows, bytes go on its end:
+		if (ring.size() < capacity) {
+			size_t grow = std::min< size_t >(size, capacity - ring.size());
+			if (ring.size() + grow > ring.capacity()) {
+				ring.reserve(std::min< size_t >(capacity, std::max< size_t >({64, 2 * ring.size(), ring.size() + grow})));
+			}
+			ring.insert(ring.end(), data, data + grow);
+			data += grow;
+			size -= grow;
+			total += grow;
+		}
+		if (size == 0) return;
+		//once it's full, they overwrite the oldest (only the newest 'capacity' of them matter),
+		// in at most two spans around the wrap:
+		if (size > capacity) {
+			data += size - capacity;
+			total += size - capacity;
+			size = capacity;
+		}
+		size_t at = index(total);
+		size_t first = std::min(size, size_t(capacity) - at);
+		std::memcpy(ring.data() + at, data, first);
+		std::memcpy(ring.data(), data + first, size - first);
+		total += size;
+	}
+
+	//position after the newest byte:
+	uint64_t end() const { return total; }
+	//position of the oldest byte still held:
+	uint64_t begin() const { return total - ring.size(); }
+
+	//append the bytes from position 'from' to end() to 'out' (false if they aren't all held):
+	bool copy(uint64_t from, std::vector< char > *out) const {
+		if (from < begin() || from > end()) return false;
+		if (from == end()) return true;
+		//(in at most two spans around the wrap)
+		size_t count = size_t(total - from);
+		size_t at = index(from);
+		size_t first = std::min(count, ring.size() - at);
+		out->insert(out->end(), ring.begin() + at, ring.begin() + at + first);
+		out->insert(out->end(), ring.begin(), ring.begin() + (count - first));
+		return true;
+	}
+
+	//start over at position 'at' with nothing held (e.g., the held bytes were lost):
+	void reset(uint64_t at) {
+		ring.clear();
+		origin = total = at;
+	}
+
+	//heap bytes in use:
+	size_t memory() const { return ring.capacity(); }
+
+	uint32_t capacity = 0;
+	std::vector< char > ring;
+	uint64_t origin = 0; //position of ring[0] when the ring was started
+	uint64_t total = 0;
+	size_t index(uint64_t position) const { return size_t((position - origin) % capacity); }
+};
@@ -2,6 +2,7 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "Profile.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -88,6 +89,7 @@ void Scene::draw(Camera const &camera) const {
 }
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	Profile::Zone zone("Scene::draw");
 
 	//Iterate through all drawables, sending each one to OpenGL:
 	for (auto const &drawable : drawables) {
@@ -0,0 +1,118 @@
+#include "Screenshots.hpp"
+
+#include "Profile.hpp"
+#include "gl_errors.hpp"
+#include "load_save_png.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+Screenshots::Screenshots() {
+	for (Read &read : reads) {
+		glGenBuffers(1, &read.buffer);
+	}
+	//(the main thread has frames to draw, so leave it a core)
+	uint32_t threads = std::thread::hardware_concurrency();
+	pool = std::make_unique< ThreadPool >(threads > 1 ? threads - 1 : 1);
+}
+
+Screenshots::~Screenshots() {
+	finish();
+	for (Read &read : reads) {
+		glDeleteBuffers(1, &read.buffer);
+	}
+}
+
+void Screenshots::capture(glm::uvec2 const &size, std::string const &filename) {
+	Profile::Zone zone("Screenshots::capture");
+	//every buffer busy? the oldest read is at least a frame old by now, so waiting for it is short:
+	if (in_flight == Buffers) {
+		hand_off(reads[oldest], true);
+	}
+	Read &read = reads[(oldest + in_flight) % Buffers];
+	in_flight += 1;
+
+	read.size = size;
+	read.filename = filename;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer);
+	//(GL_STREAM_READ: written once by GL, read once by us; re-specifying also orphans the old storage)
+	glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size.x) * size.y * sizeof(glm::u8vec4), nullptr, GL_STREAM_READ);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	//(with a pack buffer bound, the pointer is an offset into it, and the read happens on the GPU's schedule)
+	glReadPixels(0, 0, GLsizei(size.x), GLsizei(size.y), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	read.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	GL_ERRORS();
+}
+
+void Screenshots::poll() {
+	//(reads finish in the order they were started)
+	while (in_flight && hand_off(reads[oldest], false)) { }
+}
+
+void Screenshots::finish() {
+	while (in_flight) {
+		hand_off(reads[oldest], true);
+	}
+	pool->wait();
+}
+
+bool Screenshots::hand_off(Read &read, bool wait) {
+	GLenum status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GLuint64(1000000000) : 0);
+	if (status == GL_TIMEOUT_EXPIRED && !wait) return false;
+	if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+		//(mapping below still waits for the read; this is just a slower way to get there)
+		std::cerr << "NOTE: waiting for a screenshot's read failed or timed out; mapping it anyway." << std::endl;
+	}
+	glDeleteSync(read.fence);
+	read.fence = 0;
+	oldest = (oldest + 1) % Buffers;
+	in_flight -= 1;
+
+	Profile::Zone zone("Screenshots::hand_off");
+	//pixel storage from a frame already encoded (waiting for one if the encoders are too far behind):
+	std::vector< glm::u8vec4 > pixels;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		encoded.wait(lock, [this](){ return encoding < MaxEncoding; });
+		encoding += 1;
+		if (!spare.empty()) {
+			pixels = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+	pixels.resize(size_t(read.size.x) * read.size.y);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer);
+	void const *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(pixels.size() * sizeof(glm::u8vec4)), GL_MAP_READ_BIT);
+	if (mapped) {
+		std::memcpy(static_cast< void * >(pixels.data()), mapped, pixels.size() * sizeof(glm::u8vec4));
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		std::cerr << "NOTE: couldn't map a screenshot's pixels; '" << read.filename << "' will be blank." << std::endl;
+		std::fill(pixels.begin(), pixels.end(), glm::u8vec4(0));
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	GL_ERRORS();
+	saved += 1;
+
+	//(a shared_ptr, since ThreadPool tasks are std::functions and must be copyable)
+	auto frame = std::make_shared< std::vector< glm::u8vec4 > >(std::move(pixels));
+	pool->submit([this, frame, size = read.size, filename = read.filename](uint32_t) {
+		Profile::Zone zone("Screenshots::encode");
+		//the window's alpha is whatever blending left there; a screenshot should be opaque:
+		for (auto &px : *frame) {
+			px.a = 0xff;
+		}
+		save_png(filename, size, frame->data(), LowerLeftOrigin);
+		std::lock_guard< std::mutex > lock(mutex);
+		spare.emplace_back(std::move(*frame));
+		encoding -= 1;
+		encoded.notify_one();
+	});
+	return true;
+}
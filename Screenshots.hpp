@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * Screenshots saves frames the client has drawn as PNG files without holding up the frames
+ * that follow.
+ *
+ * capture() (called after drawing a frame, before swapping it) starts reading the back buffer
+ * into one of a few pixel buffer objects and fences the read, so it returns without waiting for
+ * the GPU. poll() (called every pass through the main loop) maps each read the GPU has finished,
+ * usually a frame or two later, copies the pixels out, and hands them to worker threads, which
+ * set alpha and encode the PNG. The main thread's share is one copy of the pixels per frame.
+ *
+ * Capturing every frame (a recording) is the same, just more of it. Frames are never dropped:
+ * if the GPU falls more than Buffers reads behind, or the encoders more than MaxEncoding frames
+ * behind, capture() waits for them.
+ */
+
+#include "GL.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct Screenshots {
+	static constexpr uint32_t Buffers = 3; //reads in flight on the GPU
+	static constexpr uint32_t MaxEncoding = 8; //frames copied out and waiting for (or being) encoded (3.5 MiB each at 1280x720)
+
+	//(needs a current GL context; encodes on all but one hardware thread)
+	Screenshots();
+	//(saves whatever is still in flight)
+	~Screenshots();
+
+	Screenshots(Screenshots const &) = delete;
+	Screenshots &operator=(Screenshots const &) = delete;
+
+	//start saving the frame in the default framebuffer's back buffer (of 'size' pixels) as 'filename':
+	void capture(glm::uvec2 const &size, std::string const &filename);
+
+	//hand every finished read to the encoders (without waiting for unfinished ones):
+	void poll();
+
+	//wait until every captured frame has been saved:
+	void finish();
+
+	//reads the GPU hasn't finished (the main loop shouldn't sleep long while there are any):
+	uint32_t reading() const { return in_flight; }
+
+	uint64_t saved = 0; //frames handed to the encoders so far
+
+private:
+	struct Read {
+		GLuint buffer = 0;
+		GLsync fence = 0; //(0 if the buffer is free)
+		glm::uvec2 size = glm::uvec2(0);
+		std::string filename;
+	};
+	Read reads[Buffers];
+	uint32_t oldest = 0; //index in 'reads' of the read started longest ago
+	uint32_t in_flight = 0;
+
+	//map a read (waiting for it if 'wait') and pass its pixels to the encoders: returns false if not finished yet
+	bool hand_off(Read &read, bool wait);
+
+	std::unique_ptr< ThreadPool > pool;
+	std::mutex mutex;
+	std::condition_variable encoded;
+	uint32_t encoding = 0; //frames with the encoders
+	std::vector< std::vector< glm::u8vec4 > > spare; //pixel storage to reuse
+};
@@ -0,0 +1,998 @@
+#include "ServerState.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+ServerState::ServerState(Server &server_, Options const &options_, ThreadPool *pool_, SessionRecorder *recorder, Journal *journal)
+	: server(server_), options(options_), pool(pool_), events{recorder, journal}, table_seeds(options_.seed),
+	  matchmaker([&](){
+		Matchmaker::Options match_options;
+		match_options.table_size = options_.seats;
+		match_options.bot_after = options_.bot_after;
+		return match_options;
+	}()), next_batch(std::chrono::steady_clock::now()) {
+}
+
+ServerState::~ServerState() {
+	if (pool) pool->wait();
+}
+
+//------------ the poll loop ------------
+
+void ServerState::connected(Connection *c) {
+	PlayerInfo info;
+	info.id = next_id++;
+	info.bucket = TokenBucket(options.rate, 2.0f * options.rate, std::chrono::steady_clock::now());
+	players.emplace(c, info);
+	by_id.emplace(info.id, c);
+}
+
+bool ServerState::received(Connection *c) {
+	assert(players.count(c));
+	//messages are handled in serve(), unless too many are piling up:
+	if (c->recv_buffer.size() > MaxBacklog) {
+		std::cout << " client is flooding; disconnecting." << std::endl;
+		flood_drops += 1;
+		forget(c);
+		c->close();
+		return false;
+	}
+	mark_ready(c);
+	return true;
+}
+
+void ServerState::forget(Connection *c, bool keep_seat) {
+	auto f = players.find(c);
+	assert(f != players.end());
+	PlayerInfo &info = f->second;
+	Table *table = info.table;
+	if (table && keep_seat && info.token) {
+		//(nothing is logged: replay goes on updating the seat under this id until it is resumed or closed)
+		detached.emplace(info.id, Detached{table, info.player, resume_deadline(), info.token, std::move(info.baseline)});
+		table = nullptr;
+	} else if (table) {
+		settle(*table);
+		events.record(SessionLog::Close, info.id);
+		table->game.remove_player(info.player);
+		sessions.erase(info.token);
+	} else {
+		matchmaker.cancel(info.id);
+		watchers.erase(c);
+	}
+	queued.erase(c);
+	throttled.erase(c);
+	waiting_resumes.erase(c);
+	by_id.erase(info.id);
+	players.erase(f);
+	if (table) maybe_empty.insert(table);
+}
+
+double ServerState::poll_timeout(double remain, std::chrono::steady_clock::time_point now) const {
+	//wake up for the next matchmaking batch if anyone is waiting:
+	if (matchmaker.waiting() || !watchers.empty()) {
+		remain = std::max(0.0, std::min(remain, std::chrono::duration< double >(next_batch - now).count()));
+	}
+	//...and don't wait at all if there's input left over, or only until a throttled connection has tokens:
+	if (!ready.empty()) remain = 0.0;
+	for (Connection *c : throttled) {
+		remain = std::min(remain, double(players.at(c).bucket.wait()));
+	}
+	//...and check on resumes waiting for an old connection to go every so often:
+	if (!waiting_resumes.empty()) remain = std::min(remain, 0.1);
+	return remain;
+}
+
+void ServerState::serve(std::chrono::steady_clock::time_point now) {
+	//what the tables handled since the last pass:
+	if (!running.empty() || !doomed.empty()) collect_tables();
+	//resumes waiting on a session's old connection (which may have closed, or gone quiet, since):
+	if (!waiting_resumes.empty()) {
+		std::vector< Connection * > waiting(waiting_resumes.begin(), waiting_resumes.end());
+		for (Connection *c : waiting) {
+			if (waiting_resumes.count(c)) resume_session(c, players.at(c));
+		}
+	}
+	serve_input(now);
+	if (now >= next_batch) {
+		run_matchmaking(now);
+		next_batch = now + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(MatchInterval));
+	}
+	close_empty_tables();
+}
+
+uint64_t ServerState::tick(std::chrono::steady_clock::time_point tick_start) {
+	//(everything below reads or changes the tables, so they must be idle, and their input logged before the updates)
+	settle();
+	//send updated game state to all seated clients
+	//spectators all see the same thing, so their update is serialized once per table and wire format and shared:
+	for (auto &table : tables) {
+		for (uint32_t packed = 0; packed < 2; ++packed) {
+			table.spectator_update[packed].reset();
+			table.spectator_delta[packed].reset();
+			table.spectator_full[packed].reset();
+		}
+	}
+	SessionRecorder *recorder = events.recorder;
+	//(players granted CapCompression get their update as a delta against the last one)
+	static std::vector< char > update;
+	for (auto &[c, info] : players) {
+		if (!info.table) continue;
+		Game &game = info.table->game;
+		bool compressed = (info.player->capabilities & Protocol::CapCompression);
+		size_t before = c->send_buffer.size();
+		if (!info.player->spectator) {
+			if (compressed) {
+				update.clear();
+				game.send_update(*info.player, update);
+				if (recorder) recorder->record(SessionLog::Send, info.id, update.data(), update.size());
+				Delta::encode(c->send_buffer, info.baseline, update.data(), update.size());
+				update_bytes += update.size();
+				delta_bytes += c->send_buffer.size() - before;
+			} else {
+				game.send_update(*info.player, c->send_buffer);
+				if (recorder) recorder->record(SessionLog::Send, info.id, c->send_buffer.data() + before, c->send_buffer.size() - before);
+			}
+			if (info.token) sessions.at(info.token).sent.append(c->send_buffer.data() + before, c->send_buffer.size() - before);
+			continue;
+		}
+		Table &table = *info.table;
+		bool packed = (info.player->capabilities & Protocol::CapPacked);
+		Connection::Payload &shared = table.spectator_update[packed];
+		if (!shared) {
+			auto spectator_update = std::make_shared< std::vector< char > >();
+			game.send_spectator_update(packed, *spectator_update);
+			shared = std::move(spectator_update);
+		}
+		game.send_handshake(*info.player, c->send_buffer);
+		if (recorder) {
+			//(log exactly what send_update would have produced)
+			std::vector< char > sent(c->send_buffer.begin() + before, c->send_buffer.end());
+			sent.insert(sent.end(), shared->begin(), shared->end());
+			recorder->record(SessionLog::Send, info.id, sent.data(), sent.size());
+		}
+		if (!compressed) {
+			c->send_shared(shared);
+			continue;
+		}
+		if (shared->empty()) continue; //(nothing to send, and no baseline to change)
+		//every spectator that got the table's deltas holds its spectator_baseline, so they can share the next;
+		// the rest get a whole 'U' if the others' baseline moves (and so join them), or the update as it is:
+		if (!table.spectator_delta[packed]) {
+			auto delta = std::make_shared< std::vector< char > >();
+			if (Delta::encode(*delta, table.spectator_baseline[packed], shared->data(), shared->size())) {
+				auto full = std::make_shared< std::vector< char > >();
+				Delta::encode_full(*full, shared->data(), shared->size());
+				table.spectator_full[packed] = std::move(full);
+			} else {
+				table.spectator_full[packed] = shared;
+			}
+			table.spectator_delta[packed] = std::move(delta);
+		}
+		Connection::Payload const &sent = (info.baseline.known ? table.spectator_delta[packed] : table.spectator_full[packed]);
+		info.baseline.known = (sent != shared);
+		update_bytes += shared->size();
+		delta_bytes += sent->size();
+		c->send_shared(sent);
+	}
+	//seats waiting for a resume go on getting updates, held for when their player is back:
+	for (auto &[id, d] : detached) {
+		if (!d.token) continue;
+		update.clear();
+		d.table->game.send_update(*d.player, update);
+		if (recorder) recorder->record(SessionLog::Send, id, update.data(), update.size());
+		ReplayBuffer &sent = sessions.at(d.token).sent;
+		if (d.player->capabilities & Protocol::CapCompression) {
+			static std::vector< char > delta;
+			delta.clear();
+			Delta::encode(delta, d.baseline, update.data(), update.size());
+			sent.append(delta.data(), delta.size());
+		} else {
+			sent.append(update.data(), update.size());
+		}
+	}
+	uint64_t messages_total = closed_messages;
+	for (auto &table : tables) {
+		rate_games(table);
+		table.game.end_tick();
+		messages_total += table.game.messages_handled;
+	}
+	events.record(SessionLog::Tick, 0);
+
+	if (Journal *journal = events.journal) {
+		//group commit: one write and one fsync for everything this tick changed:
+		journal->commit();
+		if (++ticks_since_snapshot >= SnapshotTicks) {
+			journal->snapshot(save_state());
+			ticks_since_snapshot = 0;
+		}
+	}
+
+	//recovered or dropped seats whose players didn't come back in time are given up:
+	for (auto d = detached.begin(); d != detached.end(); /*later*/) {
+		if (d->second.expires > tick_start) {
+			++d;
+			continue;
+		}
+		events.record(SessionLog::Close, d->first);
+		d->second.table->game.remove_player(d->second.player);
+		maybe_empty.insert(d->second.table);
+		sessions.erase(d->second.token);
+		d = detached.erase(d);
+	}
+	return messages_total;
+}
+
+void ServerState::open_ratings(std::string const &path) {
+	ratings = std::make_unique< Ratings >(path, DefaultSkill);
+	if (!path.empty()) {
+		std::cout << "Rating players in '" << path << "' (" << ratings->size() << " rated so far)." << std::endl;
+	}
+	for (Table &table : tables) table.game.rated = true;
+}
+
+Metrics::Load ServerState::load() const {
+	Metrics::Load load;
+	load.tables = uint32_t(tables.size());
+	load.waiting = uint32_t(matchmaker.waiting());
+	load.match_seconds_p50 = matchmaker.time_to_match(0.50f);
+	load.match_seconds_p90 = matchmaker.time_to_match(0.90f);
+	load.match_seconds_p99 = matchmaker.time_to_match(0.99f);
+	load.throttled = throttle_events;
+	load.deferred = deferred_polls;
+	load.flood_drops = flood_drops;
+	load.detached = uint32_t(detached.size());
+	load.sessions = uint32_t(sessions.size());
+	for (auto const &[token, session] : sessions) load.session_bytes += session.sent.memory();
+	load.resumes = resumes;
+	load.resyncs = resyncs;
+	load.rated = uint32_t(ratings->size());
+	load.rating_updates = ratings->updates;
+	load.update_bytes = update_bytes;
+	load.delta_bytes = delta_bytes;
+	if (Journal const *journal = events.journal) {
+		load.journal_bytes = journal->bytes;
+		load.journal_commit_seconds_max = journal->commit_seconds_max;
+		load.snapshot_seconds = journal->snapshot_seconds;
+	}
+	for (auto const &[pc, info] : players) {
+		load.connections += 1;
+		if (!info.player) continue; //(in the lobby)
+		if (info.player->spectator) load.spectators += 1;
+		else load.players += 1;
+	}
+	for (auto const &table : tables) {
+		for (auto const &p : table.game.players) {
+			load.bots += p.bot;
+		}
+	}
+	for (auto const &other : server.connections) {
+		if (other.listener == admin_listener) continue;
+		load.queued_send += other.pending_send();
+		load.queued_recv += other.recv_buffer.size();
+	}
+	return load;
+}
+
+//------------ tables and input ------------
+
+void ServerState::mark_ready(Connection *c) {
+	if (throttled.count(c)) return; //(rejoins once its tokens come back)
+	if (queued.insert(c).second) ready.emplace_back(c);
+}
+
+ServerState::Table &ServerState::open_table() {
+	tables.emplace_back(next_table_id++, uint32_t(table_seeds()), options.seats);
+	Table &table = tables.back();
+	table.game.rated = true;
+	uint32_t const created[2] = {table.game.seed, table.game.seats};
+	events.record(SessionLog::Table, table.id, reinterpret_cast< char const * >(created), sizeof(created));
+	return table;
+}
+
+void ServerState::rate_games(Table &table) {
+	for (Game::Outcome const &outcome : table.game.outcomes) {
+		ratings->record(outcome.winner, outcome.loser);
+	}
+	table.game.outcomes.clear();
+}
+
+void ServerState::close_if_empty(Table &table) {
+	settle(table);
+	for (auto const &p : table.game.players) {
+		if (!p.bot && !p.spectator) return;
+	}
+	for (auto &[c, info] : players) {
+		if (info.table != &table) continue;
+		events.record(SessionLog::Close, info.id);
+		//(watch again when a table is available; the welcome will be repeated)
+		Protocol::send_watch(info.lobby, info.player->version, info.player->capabilities);
+		info.stashed += 1;
+		info.table->game.remove_player(info.player);
+		info.table = nullptr;
+		info.player = nullptr;
+		watchers.insert(c);
+	}
+	events.record(SessionLog::Drop, table.id);
+	rate_games(table);
+	closed_messages += table.game.messages_handled;
+	if (table.running) running.erase(std::find(running.begin(), running.end(), &table));
+	//(a worker may still be finishing the drain that handled the table's last input)
+	if (table.mailbox) retired.emplace_back(std::move(table.mailbox));
+	tables.remove_if([&](Table const &t) { return &t == &table; });
+}
+
+void ServerState::close_empty_tables() {
+	for (Table *table : maybe_empty) {
+		close_if_empty(*table);
+	}
+	maybe_empty.clear();
+}
+
+std::chrono::steady_clock::time_point ServerState::resume_deadline() const {
+	return std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(ResumeSeconds));
+}
+
+bool ServerState::feed(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled) {
+	Game &game = info.table->game;
+	//log exactly the bytes the table consumes, so replay hands it the same batches:
+	static std::vector< char > copy;
+	size_t before = c->recv_buffer.size();
+	if (events.any()) copy.assign(c->recv_buffer.begin(), c->recv_buffer.end());
+	uint64_t messages = game.messages_handled;
+	bool ok = game.handle_messages(*info.player, c->recv_buffer, limit);
+	*handled = uint32_t(game.messages_handled - messages);
+	if (events.any() && c->recv_buffer.size() < before) {
+		events.record(SessionLog::Recv, info.id, copy.data(), before - c->recv_buffer.size());
+	}
+	if (!ok) {
+		std::cout << " invalid message received from client!" << std::endl;
+		//shut down client connection (Server::poll won't report OnClose for this):
+		forget(c);
+		c->close();
+		return false;
+	}
+	return true;
+}
+
+bool ServerState::queue_input(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled) {
+	if (info.doomed) return false;
+	bool invalid = false;
+	size_t size = Protocol::split< Protocol::ToServer >(c->recv_buffer, limit, handled, &invalid);
+	if (size) {
+		Table &table = *info.table;
+		if (table.inbox.empty()) busy.emplace_back(&table);
+		table.inbox.emplace_back(Inbound{c, info.player, info.id, std::vector< char >(c->recv_buffer.begin(), c->recv_buffer.begin() + size)});
+		c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + size);
+	}
+	if (invalid) {
+		//(closed once its queued messages are handled, as feed would)
+		info.doomed = true;
+		doomed.emplace_back(info.id);
+		return false;
+	}
+	return true;
+}
+
+//the body of every table's actor: handle one connection's messages (on some worker thread):
+static void handle_inbound(ServerState::Table &table, ServerState::Inbound &in) {
+	//once a connection is rejected, the rest of its input is dropped with it:
+	if (table.rejected.count(in.id)) {
+		in.ok = false;
+		in.bytes.clear();
+	} else {
+		table.scratch.assign(in.bytes.begin(), in.bytes.end());
+		in.ok = table.game.handle_messages(*in.player, table.scratch);
+		in.bytes.resize(in.bytes.size() - table.scratch.size());
+		if (!in.ok) table.rejected.insert(in.id);
+	}
+	std::lock_guard< std::mutex > lock(table.handled_mutex);
+	table.handled.emplace_back(std::move(in));
+}
+
+void ServerState::run_tables() {
+	for (Table *table : busy) {
+		if (!table->mailbox) {
+			table->mailbox = std::make_unique< Mailbox< Inbound > >(*pool, [table](Inbound &in) { handle_inbound(*table, in); });
+		}
+		if (!table->running) {
+			table->running = true;
+			running.emplace_back(table);
+		}
+		table->posted += table->inbox.size();
+		for (Inbound &in : table->inbox) {
+			table->mailbox->post(std::move(in));
+		}
+		table->inbox.clear();
+	}
+	busy.clear();
+}
+
+void ServerState::collect(Table &table) {
+	static std::vector< Inbound > batch;
+	{
+		std::lock_guard< std::mutex > lock(table.handled_mutex);
+		std::swap(batch, table.handled);
+	}
+	//(in the order the table handled them, so replay hands it the same batches)
+	for (Inbound &in : batch) {
+		if (!in.bytes.empty()) events.record(SessionLog::Recv, in.id, in.bytes.data(), in.bytes.size());
+		if (in.ok) continue;
+		//(by id: the connection may have closed, and its address been reused, since this was posted)
+		auto f = by_id.find(in.id);
+		if (f == by_id.end() || players.at(f->second).doomed) continue;
+		players.at(f->second).doomed = true;
+		doomed.emplace_back(in.id);
+	}
+	table.collected += batch.size();
+	batch.clear();
+}
+
+void ServerState::collect_tables() {
+	for (size_t i = 0; i < running.size(); /*later*/) {
+		Table &table = *running[i];
+		collect(table);
+		if (table.collected == table.posted) {
+			table.running = false;
+			running[i] = running.back();
+			running.pop_back();
+		} else {
+			++i;
+		}
+	}
+	for (size_t i = 0; i < doomed.size(); /*later*/) {
+		auto f = by_id.find(doomed[i]);
+		if (f != by_id.end()) {
+			Connection *c = f->second;
+			Table *table = players.at(c).table;
+			if (table && !idle(*table)) {
+				++i;
+				continue;
+			}
+			std::cout << " invalid message received from client!" << std::endl;
+			forget(c);
+			c->close();
+		}
+		doomed[i] = doomed.back();
+		doomed.pop_back();
+	}
+}
+
+void ServerState::settle(Table &table) {
+	if (!pool || idle(table)) return;
+	if (!table.inbox.empty()) run_tables();
+	while (true) {
+		collect(table);
+		if (table.collected == table.posted) break;
+		std::this_thread::yield();
+	}
+}
+
+void ServerState::settle() {
+	if (!pool) return;
+	if (!busy.empty()) run_tables();
+	pool->wait();
+	collect_tables();
+	retired.clear();
+}
+
+//while in the lobby a client may only join (or watch) and get ready:
+namespace {
+struct Lobby {
+	ServerState::PlayerInfo &info;
+	//keep a message to hand to the table later:
+	bool stash(Protocol::Frame const &m) {
+		info.lobby.insert(info.lobby.end(), m.data, m.data + m.size);
+		info.stashed += 1;
+		return true;
+	}
+	bool join(Protocol::Frame const &m) {
+		if (info.joined || info.watching || info.resuming) return false;
+		info.joined = true;
+		info.name = std::string(m.payload(), m.payload_size());
+		return stash(m);
+	}
+};
+}
+static constexpr Protocol::Handlers< Lobby, Protocol::ToServer > lobby_handlers = {
+	//Join:
+	[](Lobby &lobby, Protocol::Frame const &m) { return lobby.join(m); },
+	//Start:
+	[](Lobby &lobby, Protocol::Frame const &m) { return lobby.stash(m); },
+	//Claim:
+	[](Lobby &, Protocol::Frame const &) { return false; },
+	//Reveal:
+	[](Lobby &, Protocol::Frame const &) { return false; },
+	//Hello:
+	[](Lobby &lobby, Protocol::Frame const &m) { return lobby.join(m); },
+	//PackedClaim:
+	[](Lobby &, Protocol::Frame const &) { return false; },
+	//Watch:
+	[](Lobby &lobby, Protocol::Frame const &m) {
+		if (lobby.info.joined || lobby.info.watching || lobby.info.resuming) return false;
+		lobby.info.watching = true;
+		return lobby.stash(m);
+	},
+	//Resume: only as the first message (see resume_session)
+	[](Lobby &lobby, Protocol::Frame const &m) {
+		ServerState::PlayerInfo &info = lobby.info;
+		if (info.joined || info.watching || info.resuming || info.stashed) return false;
+		info.resuming = true;
+		info.resume_token = m.field64(0);
+		info.resume_received = m.field64(8);
+		return true;
+	},
+};
+
+bool ServerState::lobby_input(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled) {
+	bool was_joined = info.joined, was_watching = info.watching, was_resuming = info.resuming;
+	Lobby lobby{info};
+	uint64_t count = 0;
+	bool ok = Protocol::dispatch< Protocol::ToServer >(lobby_handlers, lobby, c->recv_buffer, &count, limit);
+	*handled = uint32_t(count);
+	if (!ok) {
+		std::cout << " invalid message received from client in lobby!" << std::endl;
+		forget(c);
+		c->close();
+		return false;
+	}
+	if (info.resuming && !was_resuming) {
+		return resume_session(c, info);
+	}
+	if (info.joined && !was_joined) {
+		bool resumed = false;
+		if (!detached.empty() && !resume(c, info, &resumed)) return false;
+		if (!resumed) matchmaker.enqueue(info.id, ratings->rating(info.name), c->rtt_ms(), std::chrono::steady_clock::now());
+	}
+	if (info.watching && !was_watching) {
+		watchers.insert(c);
+	}
+	return true;
+}
+
+//(a client flooding messages gets the same share as everyone else and is capped by its rate limit)
+void ServerState::serve_input(TokenBucket::Clock::time_point now) {
+	for (auto t = throttled.begin(); t != throttled.end(); /*later*/) {
+		Connection *c = *t;
+		if (players.at(c).bucket.available(now) > 0) {
+			t = throttled.erase(t);
+			mark_ready(c);
+		} else {
+			++t;
+		}
+	}
+	uint32_t budget = PollBudget;
+	while (!ready.empty() && budget > 0) {
+		Connection *c = ready.front();
+		ready.pop_front();
+		if (!queued.erase(c)) continue;
+		PlayerInfo &info = players.at(c);
+		uint32_t allowance = std::min(Quantum, budget);
+		if (options.rate > 0.0f) {
+			uint32_t tokens = info.bucket.available(now);
+			if (tokens == 0) {
+				throttle_events += 1;
+				throttled.insert(c);
+				continue;
+			}
+			allowance = std::min(allowance, tokens);
+		}
+		uint32_t handled = 0;
+		bool open;
+		if (!info.table) open = lobby_input(c, info, allowance, &handled);
+		else if (pool) open = queue_input(c, info, allowance, &handled);
+		else open = feed(c, info, allowance, &handled);
+		if (!open) continue;
+		if (options.rate > 0.0f) info.bucket.take(handled);
+		budget -= handled;
+		if (handled == allowance) mark_ready(c); //(there may be more)
+	}
+	if (!ready.empty()) deferred_polls += 1;
+	if (!busy.empty()) run_tables();
+}
+
+void ServerState::run_matchmaking(Matchmaker::Clock::time_point now) {
+	static std::vector< Matchmaker::Match > matches;
+	matches.clear();
+	matchmaker.match(now, &matches);
+	for (auto const &match : matches) {
+		Table &table = open_table();
+		for (uint64_t id : match.ids) {
+			seat(by_id.at(uint32_t(id)), table);
+		}
+		for (uint32_t b = 0; b < match.bots; ++b) {
+			table.game.add_bot();
+			events.record(SessionLog::Bot, table.id);
+		}
+		maybe_empty.insert(&table); //(in case every human dropped while being seated)
+	}
+	if (!watchers.empty() && !tables.empty()) {
+		std::vector< Connection * > waiting(watchers.begin(), watchers.end());
+		watchers.clear();
+		for (Connection *c : waiting) {
+			seat(c, tables.front());
+		}
+	}
+}
+
+//------------ sessions ------------
+
+bool ServerState::hand_over(Connection *c, PlayerInfo &info) {
+	c->recv_buffer.insert(c->recv_buffer.begin(), info.lobby.begin(), info.lobby.end());
+	info.lobby.clear();
+	//(stashed messages were already paid for in the lobby)
+	uint32_t stashed = info.stashed, handled = 0;
+	info.stashed = 0;
+	if (!feed(c, info, stashed, &handled)) return false;
+	if (!c->recv_buffer.empty()) mark_ready(c);
+	return true;
+}
+
+void ServerState::open_session(Connection *c, PlayerInfo &info) {
+	if (info.player->spectator || !(info.player->capabilities & Protocol::CapResume)) return;
+	uint64_t token;
+	do {
+		token = (uint64_t(session_tokens()) << 32) | session_tokens();
+	} while (token == 0 || sessions.count(token));
+	sessions.emplace(token, Session{info.id});
+	info.token = token;
+	//(the session's stream starts after this, with the next tick's update)
+	Protocol::send_session(c->send_buffer, token, 0);
+}
+
+bool ServerState::seat(Connection *c, Table &table) {
+	settle(table); //(a spectator may be shown a table that is running)
+	PlayerInfo &info = players.at(c);
+	info.table = &table;
+	info.player = table.game.add_player();
+	info.baseline = Delta::Baseline(); //(a spectator may have watched another table)
+	events.record(SessionLog::Open, info.id, table.id);
+	if (!hand_over(c, info)) return false;
+	open_session(c, info);
+	return true;
+}
+
+bool ServerState::resume(Connection *c, PlayerInfo &info, bool *resumed) {
+	*resumed = false;
+	//(seats with a session wait for their resume instead)
+	auto f = std::find_if(detached.begin(), detached.end(), [&](auto const &d) { return d.second.token == 0 && d.second.player->name == info.name; });
+	if (f == detached.end()) return true;
+	*resumed = true;
+	settle(*f->second.table);
+	info.table = f->second.table;
+	info.player = f->second.player;
+	events.record(SessionLog::Attach, info.id, f->first);
+	detached.erase(f);
+	std::cout << "Player '" << info.name << "' resumed their seat." << std::endl;
+	//(the stashed join repeats the handshake; see Game::join)
+	if (!hand_over(c, info)) return false;
+	//a game in progress: the dice were only sent while rolling, so send them again:
+	Game &game = info.table->game;
+	if (game.state == 2) {
+		Protocol::send_dice(c->send_buffer, info.player->capabilities & Protocol::CapPacked, game.dice_of(info.player->player_id));
+	}
+	open_session(c, info);
+	return true;
+}
+
+bool ServerState::resume_session(Connection *c, PlayerInfo &info) {
+	auto s = sessions.find(info.resume_token);
+	if (s != sessions.end() && !detached.count(s->second.id)) {
+		//the old connection is still open: its drop may not have been noticed yet, or it may be
+		// fine, and a token alone isn't reason to cut it off. It is let go only once its peer has
+		// stopped acknowledging what it is sent (and after the tables have handled anything it
+		// queued, so that is logged under its own id):
+		auto now = std::chrono::steady_clock::now();
+		if (!waiting_resumes.count(c)) {
+			info.resume_by = now + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(ResumeWaitSeconds));
+		}
+		auto old = by_id.find(s->second.id);
+		if (old != by_id.end() && old->second->unacknowledged_ms() < DeadAfterMs) {
+			if (now < info.resume_by) {
+				waiting_resumes.insert(c);
+				return true;
+			}
+			//(still answering: not this client's session to take)
+			waiting_resumes.erase(c);
+			info.resuming = false;
+			Protocol::send_session(c->send_buffer, 0, 0);
+			return true;
+		}
+		if (old != by_id.end()) {
+			Connection *o = old->second;
+			PlayerInfo &seat = players.at(o);
+			if (seat.table) settle(*seat.table);
+			//(one that sent something invalid loses the seat with it, as it would have anyway)
+			forget(o, !seat.doomed);
+			o->close();
+			s = sessions.find(info.resume_token);
+		}
+	}
+	waiting_resumes.erase(c);
+	info.resuming = false;
+	auto d = (s != sessions.end() ? detached.find(s->second.id) : detached.end());
+	if (d == detached.end()) {
+		//(unknown or expired: the client joins again)
+		Protocol::send_session(c->send_buffer, 0, 0);
+		return true;
+	}
+	Session &session = s->second;
+	settle(*d->second.table);
+	info.table = d->second.table;
+	info.player = d->second.player;
+	info.token = s->first;
+	info.joined = true;
+	info.name = info.player->name;
+	info.baseline = std::move(d->second.baseline);
+	events.record(SessionLog::Attach, info.id, session.id);
+	detached.erase(d);
+	session.id = info.id;
+	resumes += 1;
+	uint64_t received = info.resume_received;
+	if (received >= session.sent.begin() && received <= session.sent.end()) {
+		//everything missed is still held, so the client can't tell the connection dropped:
+		Protocol::send_session(c->send_buffer, info.token, received);
+		session.sent.copy(received, &c->send_buffer);
+	} else {
+		//too much was missed: carry on from here; the next tick's update brings the table back
+		// (whole, as the client's delta baseline is unknown), but dice are only sent while rolling,
+		// so send them again if the game is in progress:
+		resyncs += 1;
+		info.baseline = Delta::Baseline();
+		Protocol::send_session(c->send_buffer, info.token, session.sent.end());
+		Game &game = info.table->game;
+		if (game.state == 2) {
+			size_t before = c->send_buffer.size();
+			Protocol::send_dice(c->send_buffer, info.player->capabilities & Protocol::CapPacked, game.dice_of(info.player->player_id));
+			session.sent.append(c->send_buffer.data() + before, c->send_buffer.size() - before);
+		}
+	}
+	std::cout << "Player '" << info.name << "' resumed their session." << std::endl;
+	return hand_over(c, info);
+}
+
+//------------ journal snapshots and recovery ------------
+
+std::vector< char > ServerState::save_state() const {
+	std::vector< char > state;
+	SnapshotWriter out{state};
+	out.put(next_table_id);
+	out.put(next_id);
+	out.put(table_seeds);
+	out.put(closed_messages);
+	out.put(uint32_t(tables.size()));
+	for (Table const &table : tables) {
+		out.put(table.id);
+		table.game.save(out);
+	}
+	//seats held by connections (and recovered seats still waiting), by position in their table's players:
+	auto put_seat = [&](uint32_t id, Table const *table, Game::Player const *player) {
+		auto const &list = table->game.players;
+		auto at = std::find_if(list.begin(), list.end(), [&](Game::Player const &p) { return &p == player; });
+		out.put(id);
+		out.put(table->id);
+		out.put(uint32_t(std::distance(list.begin(), at)));
+	};
+	uint32_t seats = uint32_t(detached.size());
+	for (auto const &[c, info] : players) seats += (info.table != nullptr);
+	out.put(seats);
+	for (auto const &[c, info] : players) {
+		if (info.table) put_seat(info.id, info.table, info.player);
+	}
+	for (auto const &[id, d] : detached) {
+		put_seat(id, d.table, d.player);
+	}
+	return state;
+}
+
+void ServerState::load_state(SnapshotReader &in, std::unordered_map< uint32_t, Table * > *by_table, Seats *seats) {
+	next_table_id = in.get< uint32_t >();
+	next_id = in.get< uint32_t >();
+	table_seeds = in.get< DiceRng >();
+	closed_messages = in.get< uint64_t >();
+	for (uint32_t count = in.get< uint32_t >(); count > 0; --count) {
+		uint32_t id = in.get< uint32_t >();
+		Table &table = tables.emplace_back(id, 0, Game::DefaultSeats); //(load sets seed and seats)
+		table.game.load(in);
+		(*by_table)[id] = &table;
+	}
+	for (uint32_t count = in.get< uint32_t >(); count > 0; --count) {
+		uint32_t id = in.get< uint32_t >();
+		Table *table = by_table->at(in.get< uint32_t >());
+		uint32_t index = in.get< uint32_t >();
+		if (index >= table->game.players.size()) throw std::runtime_error("Snapshot seat is out of range.");
+		(*seats)[id] = Seat{table, &*std::next(table->game.players.begin(), index)};
+	}
+}
+
+void ServerState::detach_seats(Seats const &seats) {
+	auto expires = resume_deadline();
+	for (auto const &[id, seat] : seats) {
+		if (seat.player->spectator) {
+			seat.table->game.remove_player(seat.player);
+		} else {
+			detached.emplace(id, Detached{seat.table, seat.player, expires});
+		}
+	}
+	for (Table &table : tables) maybe_empty.insert(&table);
+}
+
+void ServerState::recover() {
+	Journal &journal = *events.journal;
+	std::unordered_map< uint32_t, Table * > by_table;
+	Seats seats;
+	SnapshotReader in{journal.recovered_snapshot.data(), journal.recovered_snapshot.data() + journal.recovered_snapshot.size()};
+	load_state(in, &by_table, &seats);
+
+	//then apply the journal, exactly as the events first happened:
+	auto value = [](SessionLog::Event const &event) {
+		if (event.data.size() != 4) throw std::runtime_error("Expected a 32-bit value in journal event.");
+		uint32_t v;
+		std::memcpy(&v, event.data.data(), 4);
+		return v;
+	};
+	std::vector< char > buffer;
+	for (SessionLog::Event const &event : journal.recovered_events) {
+		if (event.type == SessionLog::Table) {
+			if (event.data.size() != 8) throw std::runtime_error("Expected a seed and seat count in journal event.");
+			uint32_t created[2];
+			std::memcpy(created, event.data.data(), 8);
+			if (created[1] < Game::DefaultSeats || created[1] > Game::MaxSeats) throw std::runtime_error("Unsupported table size in journal.");
+			Table &table = tables.emplace_back(event.connection, created[0], created[1]);
+			by_table[table.id] = &table;
+			next_table_id = std::max(next_table_id, table.id + 1);
+			table_seeds(); //(the draw that picked this seed)
+		} else if (event.type == SessionLog::Open) {
+			Table *table = by_table.at(value(event));
+			seats[event.connection] = Seat{table, table->game.add_player()};
+			next_id = std::max(next_id, event.connection + 1);
+		} else if (event.type == SessionLog::Attach) {
+			seats[event.connection] = seats.at(value(event));
+			seats.erase(value(event));
+			next_id = std::max(next_id, event.connection + 1);
+		} else if (event.type == SessionLog::Bot) {
+			by_table.at(event.connection)->game.add_bot();
+		} else if (event.type == SessionLog::Close) {
+			Seat &seat = seats.at(event.connection);
+			seat.table->game.remove_player(seat.player);
+			seats.erase(event.connection);
+		} else if (event.type == SessionLog::Recv) {
+			Seat &seat = seats.at(event.connection);
+			buffer.assign(event.data.begin(), event.data.end());
+			seat.table->game.handle_messages(*seat.player, buffer);
+		} else if (event.type == SessionLog::Drop) {
+			Table *table = by_table.at(event.connection);
+			closed_messages += table->game.messages_handled;
+			by_table.erase(table->id);
+			tables.remove_if([&](Table const &t) { return &t == table; });
+		} else if (event.type == SessionLog::Tick) {
+			for (Table &table : tables) table.game.end_tick();
+		} else {
+			throw std::runtime_error("Unexpected event in journal.");
+		}
+	}
+
+	//nobody is connected any more:
+	detach_seats(seats);
+	std::cout << "Recovered " << tables.size() << " table(s) from " << journal.recovered_events.size()
+		<< " journaled event(s); " << detached.size() << " seat(s) wait " << ResumeSeconds << " s for their players." << std::endl;
+	journal.recovered_snapshot.clear();
+	journal.recovered_events.clear();
+}
+
+//------------ handoff to (and from) another server process ------------
+
+std::vector< char > ServerState::hand_off(std::vector< Socket > *sockets) {
+	settle();
+	if (events.journal) events.journal->commit();
+	//(the new server opens the ratings once it has the state, so they must be complete)
+	for (Table &table : tables) rate_games(table);
+	ratings->flush();
+	std::vector< char > state = save_state();
+	SnapshotWriter out{state};
+	sockets->assign(server.listen_sockets.begin(), server.listen_sockets.end());
+	out.put(uint32_t(sockets->size()));
+	out.put(admin_listener);
+	out.put(handoff_listener);
+	std::vector< Connection * > handed;
+	for (Connection &c : server.connections) {
+		if (!c || c.listener == handoff_listener) continue;
+		handed.emplace_back(&c);
+	}
+	out.put(uint32_t(handed.size()));
+	std::vector< char > unsent;
+	for (Connection *c : handed) {
+		//(bytes already in flight stay with the socket; what's still queued here goes along)
+		unsent.clear();
+		for (auto const &payload : c->send_queue) unsent.insert(unsent.end(), payload->begin(), payload->end());
+		unsent.erase(unsent.begin(), unsent.begin() + c->send_queue_offset);
+		unsent.insert(unsent.end(), c->send_buffer.begin(), c->send_buffer.end());
+		out.put(c->listener);
+		out.put_vector(c->recv_buffer);
+		out.put_vector(unsent);
+		sockets->emplace_back(c->socket);
+		if (c->listener == admin_listener) continue;
+		PlayerInfo const &info = players.at(c);
+		out.put(info.id);
+		out.put(uint8_t(info.joined | (info.watching << 1)));
+		out.put_string(info.name);
+		out.put_vector(info.lobby);
+		out.put(info.stashed);
+		out.put(info.token);
+	}
+	//sessions, with the bytes their replay buffers hold:
+	out.put(uint32_t(sessions.size()));
+	std::vector< char > held;
+	for (auto const &[token, session] : sessions) {
+		held.clear();
+		session.sent.copy(session.sent.begin(), &held);
+		out.put(token);
+		out.put(session.id);
+		out.put(session.sent.begin());
+		out.put_vector(held);
+	}
+	return state;
+}
+
+uint32_t ServerState::take_over(std::vector< char > const &state, std::vector< Socket > const &sockets) {
+	std::unordered_map< uint32_t, Table * > by_table;
+	Seats seats;
+	SnapshotReader in{state.data(), state.data() + state.size()};
+	load_state(in, &by_table, &seats);
+	uint32_t listeners = in.get< uint32_t >();
+	admin_listener = in.get< uint32_t >();
+	handoff_listener = in.get< uint32_t >();
+	uint32_t count = in.get< uint32_t >();
+	if (sockets.size() != size_t(listeners) + count) throw std::runtime_error("Handoff sent the wrong number of sockets.");
+	for (uint32_t l = 0; l < listeners; ++l) {
+		server.adopt_listener(sockets[l]);
+	}
+	auto now = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < count; ++i) {
+		Connection *c = server.adopt(sockets[listeners + i], in.get< uint32_t >());
+		c->recv_buffer = in.get_vector< char >();
+		c->send_buffer = in.get_vector< char >();
+		if (c->listener == admin_listener) continue;
+		PlayerInfo info;
+		info.id = in.get< uint32_t >();
+		uint8_t flags = in.get< uint8_t >();
+		info.joined = (flags & 1);
+		info.watching = (flags & 2);
+		info.name = in.get_string();
+		info.lobby = in.get_vector< char >();
+		info.stashed = in.get< uint32_t >();
+		info.token = in.get< uint64_t >();
+		info.bucket = TokenBucket(options.rate, 2.0f * options.rate, now); //(starts full again)
+		auto f = seats.find(info.id);
+		if (f != seats.end()) {
+			info.table = f->second.table;
+			info.player = f->second.player;
+			seats.erase(f);
+		} else if (info.watching) {
+			watchers.insert(c);
+		} else if (info.joined) {
+			//(waits from the start again; ratings aren't open yet, since the old server may still be rating games)
+			matchmaker.enqueue(info.id, DefaultSkill, c->rtt_ms(), now);
+		}
+		players.emplace(c, std::move(info));
+		by_id.emplace(players.at(c).id, c);
+		if (!c->recv_buffer.empty()) mark_ready(c);
+	}
+	for (uint32_t count = in.get< uint32_t >(); count > 0; --count) {
+		uint64_t token = in.get< uint64_t >();
+		Session &session = sessions.emplace(token, Session{in.get< uint32_t >()}).first->second;
+		session.sent.reset(in.get< uint64_t >());
+		std::vector< char > held = in.get_vector< char >();
+		session.sent.append(held.data(), held.size());
+	}
+	//(seats that were waiting for their players to come back keep waiting)
+	detach_seats(seats);
+	for (auto const &[token, session] : sessions) {
+		auto d = detached.find(session.id);
+		if (d != detached.end()) d->second.token = token;
+	}
+	return count;
+}
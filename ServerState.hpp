@@ -0,0 +1,303 @@
+#pragma once
+
+/*
+ * ServerState is everything the server keeps about its tables and the connections playing or
+ * waiting at them: the lobby and matchmaking queue, seated players, spectators, resumable
+ * sessions, and seats waiting for their players to come back. server.cpp owns the sockets and
+ * the loop; each pass it hands this the poll's events, then serve(), and once a tick, tick().
+ *
+ * It never opens or reads a socket itself, so it can be driven without a network: connections
+ * only need their recv_buffer filled and send_buffer read (see ./bench state).
+ *
+ * The same state is also what survives a restart or a new binary:
+ *  - save_state() / recover(): journal snapshots, and rebuilding the tables after a crash
+ *    (see Journal.hpp);
+ *  - hand_off() / take_over(): the tables, connections and sessions passed to a new server
+ *    process along with the sockets (see Handoff.hpp).
+ */
+
+#include "Connection.hpp"
+#include "Game.hpp"
+#include "Matchmaker.hpp"
+#include "SessionLog.hpp"
+#include "Journal.hpp"
+#include "Snapshot.hpp"
+#include "Metrics.hpp"
+#include "TokenBucket.hpp"
+#include "ThreadPool.hpp"
+#include "Mailbox.hpp"
+#include "ReplayBuffer.hpp"
+#include "Ratings.hpp"
+#include "Delta.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ServerState {
+	static constexpr double MatchInterval = 0.005; //seconds between matchmaking batches
+	static constexpr int32_t DefaultSkill = 1500; //a new player's rating
+	static constexpr uint32_t SnapshotTicks = 60; //ticks between journal snapshots
+	static constexpr double ResumeSeconds = 60.0; //how long a recovered (or dropped) seat waits for its player to come back
+	static constexpr uint32_t ReplayBytes = 4096; //recent outbound bytes kept per session, for resuming (see Protocol::CapResume)
+	static constexpr double ResumeWaitSeconds = 5.0; //how long a resume waits for its session's old connection to go
+	static constexpr uint32_t DeadAfterMs = 2000; //a connection whose peer hasn't acknowledged what it was sent for this long is gone
+
+	//input fairness: each connection's messages are rate limited ('rate', 0 for no limit), and each
+	// poll handles at most PollBudget messages, Quantum at a time per connection, round-robin:
+	static constexpr uint32_t PollBudget = 1024;
+	static constexpr uint32_t Quantum = 16;
+	static constexpr size_t MaxBacklog = 64 * 1024; //drop a connection whose unhandled input grows past this
+
+	struct Options {
+		uint32_t seed = 0; //the tables' seeds are drawn from this
+		uint32_t seats = Game::DefaultSeats; //players per table
+		double bot_after = 10.0; //seconds a lone player waits before being seated with bots
+		float rate = 50.0f; //messages/sec per connection (0 for no limit)
+	};
+
+	//(with a 'pool', tables handle their input on its threads; 'recorder' and 'journal' may be null)
+	ServerState(Server &server, Options const &options, ThreadPool *pool, SessionRecorder *recorder, Journal *journal);
+
+	//(waits for the pool, which may still be handling the tables' input)
+	~ServerState();
+
+	ServerState(ServerState const &) = delete;
+	ServerState &operator=(ServerState const &) = delete;
+
+	Server &server;
+	Options const options;
+	ThreadPool *pool;
+	static constexpr uint32_t NoListener = ~0u;
+	uint32_t admin_listener = NoListener; //connections not to treat as players
+	uint32_t handoff_listener = NoListener;
+
+	//state-changing events go to the recording and the journal alike:
+	struct Events {
+		SessionRecorder *recorder;
+		Journal *journal;
+		bool any() const { return recorder || journal; }
+		void record(SessionLog::Type type, uint32_t id, char const *data = nullptr, size_t size = 0) {
+			if (recorder) recorder->record(type, id, data, size);
+			if (journal) journal->record(type, id, data, size);
+		}
+		void record(SessionLog::Type type, uint32_t id, uint32_t value) {
+			record(type, id, reinterpret_cast< char const * >(&value), sizeof(value));
+		}
+	} events;
+
+	//----- the poll loop -----
+	//a client connected (it waits in the lobby until it joins):
+	void connected(Connection *c);
+	//a client sent something (it is handled in serve(); returns false if it was dropped for flooding):
+	bool received(Connection *c);
+	//forget a connection (it has closed, or is being closed):
+	// with 'keep_seat', a player with a session keeps their seat for a while in case they resume
+	void forget(Connection *c, bool keep_seat = false);
+
+	//the longest the next poll may wait (at most 'remain') before serve() has something to do:
+	double poll_timeout(double remain, std::chrono::steady_clock::time_point now) const;
+	//handle what the poll brought in: waiting resumes, input, matchmaking, and tables left empty:
+	void serve(std::chrono::steady_clock::time_point now);
+	//once a tick: send every seat and spectator its update, advance the tables, commit the journal,
+	// and give up on seats whose players didn't come back (returns the messages handled so far):
+	uint64_t tick(std::chrono::steady_clock::time_point tick_start);
+	//with a pool: wait until the tables have handled all their input, and log it (before reading them):
+	// (tick, hand_off and the destructor do this themselves)
+	void settle();
+
+	//open the player ratings (see Ratings.hpp), and start rating the tables' games:
+	// (called once the tables are recovered or taken over: their games before that were rated already)
+	void open_ratings(std::string const &path);
+
+	//the figures the admin port reports (see Metrics.hpp):
+	Metrics::Load load() const;
+
+	//----- journal snapshots and recovery -----
+	//everything needed to rebuild the tables (lobby connections and the matchmaking queue aren't kept):
+	std::vector< char > save_state() const;
+	//rebuild the tables from the journal's last snapshot and the events journaled after it:
+	void recover();
+
+	//----- handoff to (and from) another server process -----
+	//a newer server asked to take over: the tables, connections and sessions, and (in '*sockets')
+	// every socket to pass along, listening ones first (see Handoff::send):
+	std::vector< char > hand_off(std::vector< Socket > *sockets);
+	//take over what hand_off() wrote (the state must have no tables yet; returns the connections adopted):
+	uint32_t take_over(std::vector< char > const &state, std::vector< Socket > const &sockets);
+
+	//----- tables -----
+	//with a pool: complete messages from one connection, posted to its table's mailbox:
+	struct Inbound {
+		Connection *connection;
+		Game::Player *player;
+		uint32_t id; //connection id (for the log)
+		std::vector< char > bytes; //left holding just the bytes the table consumed
+		bool ok = true; //false if the table rejected a message
+	};
+	struct Table {
+		Table(uint32_t id_, uint32_t seed_, uint32_t seats_) : id(id_), game(seed_, seats_) { }
+		uint32_t id;
+		Game game;
+		//this tick's spectator update, serialized once per wire format:
+		Connection::Payload spectator_update[2];
+		//...and for spectators granted CapCompression, as a delta against the last (for those who got that) or whole:
+		Connection::Payload spectator_delta[2], spectator_full[2];
+		Delta::Baseline spectator_baseline[2];
+		//with a pool: input framed during this poll, then posted all at once (see run_tables):
+		std::vector< Inbound > inbox;
+		std::unique_ptr< Mailbox< Inbound > > mailbox; //(created on first use)
+		uint64_t posted = 0, collected = 0; //Inbounds posted to the mailbox, and taken back from 'handled'
+		bool running = false; //in ServerState::running
+		//filled by the mailbox's handler, emptied by collect():
+		std::mutex handled_mutex;
+		std::vector< Inbound > handled;
+		//touched only by the mailbox's handler:
+		std::vector< char > scratch;
+		std::unordered_set< uint32_t > rejected; //connection ids whose input is dropped from here on
+	};
+	std::list< Table > tables; //oldest first; spectators watch the oldest table
+	std::unique_ptr< Ratings > ratings; //(see open_ratings)
+	uint32_t next_table_id = 0;
+	DiceRng table_seeds; //each table's Game seed (recorded with the table)
+	uint64_t closed_messages = 0; //messages handled by tables that have since closed
+
+	//----- connections -----
+	struct PlayerInfo {
+		Table *table = nullptr; //nullptr while in the lobby
+		Game::Player *player = nullptr;
+		uint32_t id = 0; //connection id used in session log and as matchmaking ticket
+		TokenBucket bucket; //rate limit on messages handled
+		//messages that arrived before the client had a table (handed to the table on seating):
+		std::vector< char > lobby;
+		uint32_t stashed = 0; //messages in 'lobby'
+		std::string name; //from the join
+		bool joined = false; //sent a join (so is queued for matchmaking)
+		bool watching = false; //sent a watch (so waits to be shown a table)
+		uint64_t token = 0; //session this seat can be resumed with (0 if none)
+		//sent a resume (token, stream position received), handled right after:
+		bool resuming = false;
+		uint64_t resume_token = 0, resume_received = 0;
+		std::chrono::steady_clock::time_point resume_by; //(while the session's old connection is still open)
+		//the last update sent as a delta (CapCompression):
+		// (a spectator only uses 'known': whether it holds its table's spectator_baseline)
+		Delta::Baseline baseline;
+		bool doomed = false; //sent something invalid; closed once its table is done with what it queued
+	};
+	std::unordered_map< Connection *, PlayerInfo > players;
+	std::unordered_map< uint32_t, Connection * > by_id;
+	std::unordered_set< Connection * > watchers; //lobby spectators waiting for a table
+	uint32_t next_id = 0;
+
+	//matchmaking: joined players wait here until they are grouped into a table (or seated with bots):
+	Matchmaker matchmaker;
+	std::chrono::steady_clock::time_point next_batch;
+
+	//seats recovered from the journal, or dropped with a session, waiting for their players (by previous connection id):
+	struct Detached {
+		Table *table;
+		Game::Player *player;
+		std::chrono::steady_clock::time_point expires;
+		uint64_t token = 0; //its session (without one, the player gets the seat back by joining under the same name)
+		Delta::Baseline baseline; //(kept for a resume that picks up the stream where it left off)
+	};
+	std::unordered_map< uint32_t, Detached > detached;
+
+	//resumable sessions, by token: the seat's connection id (current, or last if detached) and what it was sent lately:
+	struct Session {
+		uint32_t id;
+		ReplayBuffer sent{ReplayBytes};
+	};
+	std::unordered_map< uint64_t, Session > sessions;
+	//(a token is all it takes to resume a seat, so each is drawn from the OS, not from a generator
+	// whose earlier outputs would give the next away)
+	std::random_device session_tokens;
+	std::unordered_set< Connection * > waiting_resumes; //resumes waiting for their session's old connection to go
+
+	//connections with input left to handle, served round-robin:
+	std::deque< Connection * > ready;
+	std::unordered_set< Connection * > queued; //connections in 'ready' (other entries are stale)
+	std::unordered_set< Connection * > throttled; //out of tokens with input waiting
+
+	//with a pool, seated connections' input is only framed while serving; run_tables then posts each
+	// table its batch, and the workers handle it while this thread goes on. A table with input posted
+	// and not yet collected may be in use on a worker, so nothing here touches it without settle(table):
+	std::vector< Table * > busy; //tables with input in their inbox
+	std::vector< Table * > running; //tables with input posted and not all collected
+	std::vector< uint32_t > doomed; //connection ids to close once their tables are idle
+	std::vector< std::unique_ptr< Mailbox< Inbound > > > retired; //closed tables' mailboxes (freed once the pool is idle)
+
+	//tables that may have lost their last human (closed by close_empty_tables):
+	// (so a Table & stays valid while seating)
+	std::unordered_set< Table * > maybe_empty;
+
+	uint32_t ticks_since_snapshot = 0;
+
+	//----- counters (see Metrics::Load) -----
+	uint64_t throttle_events = 0, deferred_polls = 0, flood_drops = 0;
+	uint64_t resumes = 0, resyncs = 0;
+	uint64_t update_bytes = 0, delta_bytes = 0; //CapCompression updates before and after encoding
+
+	//----- internals -----
+	void mark_ready(Connection *c);
+	Table &open_table();
+	//rate the games a table has finished since last time:
+	void rate_games(Table &table);
+	//close a table once no human holds a seat at it (its spectators go back to the lobby):
+	void close_if_empty(Table &table);
+	void close_empty_tables();
+	std::chrono::steady_clock::time_point resume_deadline() const;
+
+	//hand up to 'limit' complete messages to the connection's table (returns false if the connection was closed):
+	bool feed(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled);
+	//with a pool: frame up to 'limit' messages for the table's next batch (returns false if the connection is doomed):
+	bool queue_input(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled);
+	//post every busy table's batch to its mailbox (without waiting for the workers):
+	void run_tables();
+	//log what a table has handled so far, and doom connections it rejected (without waiting):
+	void collect(Table &table);
+	//collect from every running table, then close doomed connections whose tables are idle:
+	void collect_tables();
+	//wait until a table has handled (and this has collected) everything queued for it, so it may be used here:
+	void settle(Table &table);
+	bool idle(Table const &table) const { return table.inbox.empty() && table.collected == table.posted; }
+	//handle up to 'limit' messages from a connection still in the lobby (returns false if the connection was closed):
+	bool lobby_input(Connection *c, PlayerInfo &info, uint32_t limit, uint32_t *handled);
+	//handle waiting input round-robin, a quantum per connection, until the poll's budget is spent:
+	void serve_input(TokenBucket::Clock::time_point now);
+	//form tables from the matchmaking queue and show waiting spectators a table:
+	void run_matchmaking(Matchmaker::Clock::time_point now);
+
+	//----- sessions -----
+	//hand a newly seated connection's table everything it sent while waiting in the lobby:
+	bool hand_over(Connection *c, PlayerInfo &info);
+	//give a newly seated player a session to resume if their connection drops (if they asked for CapResume):
+	void open_session(Connection *c, PlayerInfo &info);
+	//seat (or show) a lobby connection at a table:
+	bool seat(Connection *c, Table &table);
+	//give a joining player back their recovered seat, if they have one (sets *resumed):
+	// returns false if the connection was closed
+	bool resume(Connection *c, PlayerInfo &info, bool *resumed);
+	//give a reconnected player their seat back and resend what they missed (returns false if the connection was closed):
+	// (called again for waiting_resumes until the session's old connection has gone, or the wait is over)
+	bool resume_session(Connection *c, PlayerInfo &info);
+
+	//----- snapshot helpers -----
+	struct Seat {
+		Table *table;
+		Game::Player *player;
+	};
+	using Seats = std::unordered_map< uint32_t, Seat >; //by connection id
+	//rebuild the tables written by save_state (the server must have none yet):
+	void load_state(SnapshotReader &in, std::unordered_map< uint32_t, Table * > *by_table, Seats *seats);
+	//seats whose connections are gone: spectators are let go, players get a while to come back:
+	void detach_seats(Seats const &seats);
+};
@@ -0,0 +1,67 @@
+#include "SessionLog.hpp"
+
+#include <stdexcept>
+
+static constexpr char const Magic[4] = {'b','s','l','6'};
+
+SessionLog SessionLog::load(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open session log '" + filename + "'.");
+	}
+
+	char magic[4];
+	SessionLog log;
+	if (!in.read(magic, 4)
+	 || !in.read(reinterpret_cast< char * >(&log.seed), sizeof(log.seed))) {
+		throw std::runtime_error("Failed to read session log header.");
+	}
+	if (std::string(magic, 4) != std::string(Magic, 4)) {
+		//(the same format, but recorded by a server whose games would play out differently)
+		if (std::string(magic, 3) == std::string(Magic, 3)) {
+			throw std::runtime_error("Session log was recorded by another version of the server ('" + std::string(magic, 4) + "'; this one replays '" + std::string(Magic, 4) + "').");
+		}
+		throw std::runtime_error("Unexpected magic number in session log.");
+	}
+
+	while (true) {
+		uint8_t type;
+		if (!in.read(reinterpret_cast< char * >(&type), 1)) break; //clean end of file
+		Event event;
+		event.type = Type(type);
+		uint32_t size = 0;
+		if (!in.read(reinterpret_cast< char * >(&event.connection), sizeof(event.connection))
+		 || !in.read(reinterpret_cast< char * >(&size), sizeof(size))) {
+			throw std::runtime_error("Truncated event in session log.");
+		}
+		event.data.resize(size);
+		if (size && !in.read(event.data.data(), size)) {
+			throw std::runtime_error("Truncated event data in session log.");
+		}
+		log.events.emplace_back(std::move(event));
+	}
+
+	return log;
+}
+
+SessionRecorder::SessionRecorder(std::string const &filename, uint32_t seed) : out(filename, std::ios::binary) {
+	if (!out) {
+		throw std::runtime_error("Failed to open session log '" + filename + "' for writing.");
+	}
+	out.write(Magic, 4);
+	out.write(reinterpret_cast< char const * >(&seed), sizeof(seed));
+}
+
+void SessionRecorder::record(SessionLog::Type type, uint32_t connection, char const *data, size_t size) {
+	uint8_t t = type;
+	uint32_t sz = uint32_t(size);
+	out.write(reinterpret_cast< char const * >(&t), 1);
+	out.write(reinterpret_cast< char const * >(&connection), sizeof(connection));
+	out.write(reinterpret_cast< char const * >(&sz), sizeof(sz));
+	if (size) out.write(data, size);
+	if (type == SessionLog::Tick) out.flush();
+}
+
+void SessionRecorder::record(SessionLog::Type type, uint32_t connection, uint32_t value) {
+	record(type, connection, reinterpret_cast< char const * >(&value), sizeof(value));
+}
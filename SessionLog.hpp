@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * SessionLog records everything the server's tables saw and sent, so a session can be
+ * replayed against Game without sockets, sleeps, or the matchmaker (see replay.cpp).
+ *
+ * File format:
+ * |b |s |l |6 | <-- four byte magic number (bumped whenever old logs would replay differently)
+ * |se|ed|se|ed| <-- 32-bit (native endian) server seed
+ * followed by any number of events:
+ * |T |cc|cc|cc|cc|sz|sz|sz|sz|data...| <-- type, connection (or table) id, data size, data
+ */
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+struct SessionLog {
+	enum Type : uint8_t {
+		Table = 'T', //table created: id is the table id, data is its 32-bit Game seed and 32-bit seat count
+		Open = 'o', //connection seated at (or watching) a table: data is the 32-bit table id
+		Bot = 'b', //bot seated: id is the table id
+		Close = 'x', //connection left its table
+		Recv = 'r', //bytes handed to the connection's table
+		Send = 's', //bytes queued for connection during a tick
+		Drop = 'd', //table closed: id is the table id
+		Tick = 't', //end of a server tick
+		Attach = 'a', //connection took over a seat recovered from the journal, or resumed a session: data is the 32-bit id of the seat's old connection
+	};
+	struct Event {
+		Type type;
+		uint32_t connection = 0;
+		std::vector< char > data;
+	};
+
+	uint32_t seed = 0;
+	std::vector< Event > events;
+
+	//read a log written by SessionRecorder (throws on malformed data):
+	static SessionLog load(std::string const &filename);
+};
+
+//Appends events to a session log file as they happen:
+struct SessionRecorder {
+	SessionRecorder(std::string const &filename, uint32_t seed);
+
+	void record(SessionLog::Type type, uint32_t connection, char const *data = nullptr, size_t size = 0);
+	//an event whose data is one 32-bit value:
+	void record(SessionLog::Type type, uint32_t connection, uint32_t value);
+
+	std::ofstream out;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * SnapshotWriter and SnapshotReader (de)serialize compact state for Journal snapshots.
+ *
+ * Values are written as raw native-endian bytes, like the session log; strings and
+ * arrays are prefixed with a 32-bit count. Reading past the end throws.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct SnapshotWriter {
+	std::vector< char > &to;
+
+	template< typename T >
+	void put(T const &value) {
+		static_assert(std::is_trivially_copyable< T >::value, "put() writes raw bytes");
+		char const *bytes = reinterpret_cast< char const * >(&value);
+		to.insert(to.end(), bytes, bytes + sizeof(T));
+	}
+	void put_string(std::string const &value) {
+		put(uint32_t(value.size()));
+		to.insert(to.end(), value.begin(), value.end());
+	}
+	template< typename T >
+	void put_vector(std::vector< T > const &values) {
+		static_assert(std::is_trivially_copyable< T >::value, "put_vector() writes raw bytes");
+		put(uint32_t(values.size()));
+		char const *bytes = reinterpret_cast< char const * >(values.data());
+		to.insert(to.end(), bytes, bytes + values.size() * sizeof(T));
+	}
+};
+
+struct SnapshotReader {
+	char const *at;
+	char const *end;
+
+	template< typename T >
+	T get() {
+		static_assert(std::is_trivially_copyable< T >::value, "get() reads raw bytes");
+		T value;
+		std::memcpy(&value, take(sizeof(T)), sizeof(T));
+		return value;
+	}
+	std::string get_string() {
+		uint32_t size = get< uint32_t >();
+		return std::string(take(size), size);
+	}
+	template< typename T >
+	std::vector< T > get_vector() {
+		uint32_t count = get< uint32_t >();
+		char const *data = take(count * sizeof(T)); //(checked before allocating)
+		std::vector< T > values(count);
+		if (count) std::memcpy(values.data(), data, count * sizeof(T));
+		return values;
+	}
+
+	char const *take(size_t size) {
+		if (size_t(end - at) < size) throw std::runtime_error("Truncated snapshot.");
+		char const *data = at;
+		at += size;
+		return data;
+	}
+};
@@ -0,0 +1,203 @@
+#include "TableState.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+TableState::TableState(std::string const &name_) : name(name_) {
+	seat_names[seat] = name;
+	//(names fit without allocating from here on unless they are longer than this)
+	for (std::string &s : seat_names) s.reserve(32);
+}
+
+//----- message handlers -----
+//(messages the server repeats every tick change nothing the second time)
+
+static void on_seat(TableState &ts, uint8_t seat, uint8_t seats) {
+	if (seats < 2 || seats > TableState::MaxSeats || seat >= seats) return; //(tables seat at most eight)
+	if (seat == ts.seat && seats == ts.seats) return;
+	ts.seat_names[ts.seat].clear();
+	ts.seat = seat;
+	ts.seats = seats;
+	ts.seat_names[seat] = ts.name;
+	ts.change = TableState::Seat;
+}
+
+//in waiting room, a seated player's name:
+// with CapTables 'id' is that player's seat; otherwise it is our own seat, and the name is the other player's
+static void on_name(TableState &ts, uint8_t id, char const *name, uint32_t size) {
+	auto same = [&](std::string const &s) { return s.size() == size && std::memcmp(s.data(), name, size) == 0; };
+	if (ts.capabilities & Protocol::CapTables) {
+		if (id >= ts.seats || same(ts.seat_names[id])) return;
+		ts.seat_names[id].assign(name, size);
+	} else {
+		uint8_t seat = id % 2;
+		if (seat == ts.seat && same(ts.seat_names[1 - seat])) return;
+		ts.seat_names[ts.seat].clear();
+		ts.seat = seat;
+		ts.seat_names[seat] = ts.name;
+		ts.seat_names[1 - seat].assign(name, size); //(e.g. a human took over a bot's seat)
+	}
+	ts.change = TableState::Names;
+}
+
+//our dice (sent every tick while rolling):
+static void on_dice(TableState &ts, uint8_t const *dice) {
+	if (ts.rolled && std::equal(dice, dice + 6, ts.dice)) return;
+	std::copy(dice, dice + 6, ts.dice);
+	ts.rolled = true;
+	ts.revealed = false;
+	ts.change = TableState::Dice;
+}
+
+//whose turn it is and the claim standing (sent every tick while playing):
+static void on_action(TableState &ts, bool active, uint8_t dice_num, uint8_t dice_point) {
+	if (ts.acted && active == ts.active && dice_num == ts.dice_num && dice_point == ts.dice_point) return;
+	ts.acted = true;
+	ts.active = active;
+	ts.dice_num = dice_num;
+	ts.dice_point = dice_point;
+	ts.change = TableState::Action;
+}
+
+//the winner and every seat's dice (sent every tick until the next game):
+// (the game is over, so the next game's dice and turns count as changes even if they repeat these)
+static void on_reveal(TableState &ts, uint8_t winner, uint8_t seats, uint8_t const *dice) {
+	if (ts.revealed && winner == ts.winner && seats == ts.revealed_seats && std::equal(dice, dice + 6 * seats, ts.revealed_dice)) return;
+	ts.revealed = true;
+	ts.winner = winner;
+	ts.revealed_seats = seats;
+	std::copy(dice, dice + 6 * seats, ts.revealed_dice);
+	ts.rolled = ts.acted = false;
+	ts.change = TableState::Result;
+}
+
+//winner and the other player's dice (a table of two without CapTables):
+static void on_result(TableState &ts, uint8_t winner, uint8_t const *dice) {
+	uint8_t both[12];
+	std::copy(dice, dice + 6, both + 6 * (1 - ts.seat % 2));
+	std::copy(ts.dice, ts.dice + 6, both + 6 * (ts.seat % 2));
+	on_reveal(ts, winner, 2, both);
+}
+
+//winner and every seat's dice, packed in seat order (CapTables):
+static void on_table_result(TableState &ts, uint8_t winner, uint8_t seats, uint8_t const *packed, uint32_t size) {
+	if (seats != ts.seats || size < Protocol::packed_dice_bytes(6 * seats)) return;
+	uint8_t dice[6 * TableState::MaxSeats];
+	Protocol::unpack_dice(packed, 6 * seats, dice);
+	on_reveal(ts, winner, seats, dice);
+}
+
+//handlers for each message the server sends, indexed by Protocol::ToClient slot:
+static constexpr Protocol::Handlers< TableState, Protocol::ToClient > handlers = {
+	//Name:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_name(ts, m.field(0), m.payload(), m.payload_size());
+		return true;
+	},
+	//Dice:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_dice(ts, reinterpret_cast< uint8_t const * >(m.data + 1));
+		return true;
+	},
+	//Action:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_action(ts, m.field(0) == 'a', m.field(1), m.field(2));
+		return true;
+	},
+	//Result:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_result(ts, m.field(0), reinterpret_cast< uint8_t const * >(m.data + 2));
+		return true;
+	},
+	//Hello: server accepted the join with this version and these capabilities
+	[](TableState &ts, Protocol::Frame const &m) {
+		ts.protocol_version = m.field(0);
+		ts.capabilities = m.field16(1);
+		ts.change = TableState::Hello;
+		return true;
+	},
+	//PackedName:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_name(ts, m.field(0), m.payload(), m.payload_size());
+		return true;
+	},
+	//PackedDice:
+	[](TableState &ts, Protocol::Frame const &m) {
+		uint8_t dice[6];
+		Protocol::unpack_dice(reinterpret_cast< uint8_t const * >(m.data + 1), 6, dice);
+		on_dice(ts, dice);
+		return true;
+	},
+	//PackedActive:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_action(ts, true, Protocol::claim_num(m.field(0)), Protocol::claim_point(m.field(0)));
+		return true;
+	},
+	//PackedWait:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_action(ts, false, Protocol::claim_num(m.field(0)), Protocol::claim_point(m.field(0)));
+		return true;
+	},
+	//PackedResult:
+	[](TableState &ts, Protocol::Frame const &m) {
+		uint8_t dice[6];
+		Protocol::unpack_dice(reinterpret_cast< uint8_t const * >(m.data + 2), 6, dice);
+		on_result(ts, m.field(0), dice);
+		return true;
+	},
+	//Seat:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_seat(ts, m.field(0), m.field(1));
+		return true;
+	},
+	//TableResult:
+	[](TableState &ts, Protocol::Frame const &m) {
+		on_table_result(ts, m.field(0), m.field(1), reinterpret_cast< uint8_t const * >(m.payload()), m.payload_size());
+		return true;
+	},
+	//Session: our token, and the stream position of the byte after this message
+	[](TableState &ts, Protocol::Frame const &m) {
+		ts.session = m.field64(0);
+		ts.received = m.field64(8);
+		ts.change = TableState::Session;
+		return true;
+	},
+	//Repeat: this tick's update is the same as the last delta's (read by next())
+	[](TableState &ts, Protocol::Frame const &) {
+		ts.update_at = 0;
+		return true;
+	},
+	//Delta: this tick's update, against the last delta's (read by next())
+	[](TableState &ts, Protocol::Frame const &m) {
+		ts.update_at = 0;
+		return Delta::decode(m, ts.baseline);
+	},
+};
+
+TableState::Change TableState::next(std::vector< char > const &buffer, size_t *at) {
+	while (true) {
+		//the messages in an update sent as a delta come before whatever followed it:
+		bool update = (update_at < baseline.bytes.size());
+		char const *data = (update ? baseline.bytes.data() + update_at : buffer.data() + *at);
+		size_t available = (update ? baseline.bytes.size() - update_at : buffer.size() - *at);
+		if (available == 0) return None;
+
+		uint8_t slot = 0;
+		uint32_t header = 0;
+		int64_t size = Protocol::frame< Protocol::ToClient >(data, available, &slot, &header);
+		if (size < 0 || (size == 0 && update)) return Invalid; //(an update holds only whole messages)
+		if (size == 0) return None;
+		if (update) {
+			//(an update never holds another)
+			if (slot == Protocol::ToClient::Repeat || slot == Protocol::ToClient::Delta) return Invalid;
+			update_at += size_t(size);
+		} else {
+			*at += size_t(size);
+			received += uint64_t(size);
+		}
+
+		change = None;
+		if (!handlers[slot](*this, Protocol::Frame{data, header, uint32_t(size)})) return Invalid;
+		if (change != None) return change;
+	}
+}
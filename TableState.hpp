@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * TableState is what a player's client knows of its table (and its session), decoded from the
+ * server's messages.
+ *
+ * Decoding doesn't allocate once the fields below have grown to fit: next() walks the received
+ * bytes with a read cursor, writes each message into fields sized for the largest table up front,
+ * and leaves the bytes for the caller to consume all at once (one erase per poll). Updates sent
+ * as deltas (Protocol::CapCompression) are read straight out of the delta baseline.
+ *
+ * The server repeats its whole view of the table every tick, so next() only stops at a message
+ * that changed something, and says what: the client redraws only that.
+ */
+
+#include "Protocol.hpp"
+#include "Delta.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TableState {
+	static constexpr uint8_t MaxSeats = 8;
+
+	explicit TableState(std::string const &name);
+
+	//what a message changed:
+	enum Change : uint8_t {
+		None, //(no complete message left)
+		Hello, //protocol_version, capabilities
+		Seat, //seat, seats
+		Names, //seat_names
+		Dice, //dice (a new game)
+		Action, //active, dice_num, dice_point
+		Result, //winner, revealed (the game is over)
+		Session, //session (and received)
+		Invalid, //an unknown or malformed message (stop reading)
+	};
+	//handle the messages in 'buffer' from *at on, advancing *at past each, until one changes something:
+	// (the bytes before *at may be erased once the caller is done; the cursor then starts over at 0)
+	Change next(std::vector< char > const &buffer, size_t *at);
+
+	//----- what the server said -----
+	std::string name; //ours
+	uint8_t protocol_version = 0; //agreed with the server at join
+	uint16_t capabilities = 0; //granted by the server at join
+	uint8_t seat = 0; //ours
+	uint8_t seats = 2; //at our table
+	std::array< std::string, MaxSeats > seat_names; //by seat ("" while empty)
+	//the current game:
+	bool rolled = false; //dice has our dice
+	uint8_t dice[6] = {1,1,1,1,1,1};
+	bool acted = false; //there is a turn (below)
+	bool active = false; //it's ours
+	uint8_t dice_num = 1, dice_point = 1; //the claim standing
+	//the last game's reveal:
+	bool revealed = false;
+	uint8_t winner = 0;
+	uint8_t revealed_seats = 0;
+	uint8_t revealed_dice[6 * MaxSeats]; //every seat's dice, in seat order
+	//session to resume if the connection drops (see Protocol::CapResume):
+	uint64_t session = 0; //token (0 if none)
+	uint64_t received = 0; //position in the session's stream, after the messages handled so far
+
+	//----- internals -----
+	Change change = None; //set by the handler of each message
+	Delta::Baseline baseline; //last update received as a delta
+	size_t update_at = 0; //read cursor in baseline.bytes (past the end once handled)
+};
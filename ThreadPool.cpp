@@ -0,0 +1,102 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+//which pool (and which worker of it) the current thread belongs to:
+static thread_local ThreadPool const *current_pool = nullptr;
+static thread_local uint32_t current_index = 0;
+
+ThreadPool::ThreadPool(uint32_t threads_) {
+	uint32_t count = threads_ ? threads_ : std::max(1u, std::thread::hardware_concurrency());
+	workers.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		workers.emplace_back(std::make_unique< Worker >());
+	}
+	threads.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		threads.emplace_back([this, i](){ run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard< std::mutex > lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+int32_t ThreadPool::current_worker() const {
+	return current_pool == this ? int32_t(current_index) : -1;
+}
+
+void ThreadPool::submit(Task task) {
+	int32_t self = current_worker();
+	uint32_t index = (self >= 0 ? uint32_t(self) : next_worker.fetch_add(1) % size());
+
+	unfinished.fetch_add(1);
+	{
+		std::lock_guard< std::mutex > lock(workers[index]->mutex);
+		workers[index]->tasks.emplace_back(std::move(task));
+	}
+	queued.fetch_add(1);
+	{
+		//(lock so a worker between checking 'queued' and sleeping can't miss this)
+		std::lock_guard< std::mutex > lock(sleep_mutex);
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock< std::mutex > lock(sleep_mutex);
+	idle.wait(lock, [this](){ return unfinished.load() == 0; });
+}
+
+bool ThreadPool::take(uint32_t index, Task *task) {
+	{ //newest task from own deque:
+		Worker &own = *workers[index];
+		std::lock_guard< std::mutex > lock(own.mutex);
+		if (!own.tasks.empty()) {
+			*task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	//oldest task from someone else's:
+	for (uint32_t i = 1; i < size(); ++i) {
+		Worker &victim = *workers[(index + i) % size()];
+		std::lock_guard< std::mutex > lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			*task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(uint32_t index) {
+	current_pool = this;
+	current_index = index;
+
+	Task task;
+	while (true) {
+		if (take(index, &task)) {
+			queued.fetch_sub(1);
+			task(index);
+			task = nullptr;
+			if (unfinished.fetch_sub(1) == 1) {
+				std::lock_guard< std::mutex > lock(sleep_mutex);
+				idle.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock< std::mutex > lock(sleep_mutex);
+		wake.wait(lock, [this](){ return stopping || queued.load() > 0; });
+		if (stopping && queued.load() == 0) break;
+	}
+}
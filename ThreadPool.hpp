@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * ThreadPool is a small work-stealing thread pool.
+ *
+ * Each worker has its own task deque: it takes work from the back of its own deque
+ * and, when that is empty, steals from the front of the others'. Tasks submitted from
+ * a worker go to that worker's deque (so related work stays on one core); tasks
+ * submitted from elsewhere are dealt out round-robin.
+ *
+ * Tasks receive the index of the worker running them, which makes per-worker
+ * scratch space (random generators, statistics) easy to keep without locking.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+	using Task = std::function< void(uint32_t worker) >;
+
+	//threads == 0 means one per hardware thread:
+	explicit ThreadPool(uint32_t threads = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	void submit(Task task);
+
+	//block until every submitted task (including tasks they submit) has finished:
+	void wait();
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//index of the calling worker, or -1 if not called from one of this pool's workers:
+	int32_t current_worker() const;
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque< Task > tasks;
+	};
+	std::vector< std::unique_ptr< Worker > > workers;
+	std::vector< std::thread > threads;
+
+	std::atomic< uint32_t > next_worker{0}; //round-robin target for outside submissions
+	std::atomic< uint64_t > queued{0}; //tasks sitting in deques
+	std::atomic< uint64_t > unfinished{0}; //tasks submitted but not yet finished
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake; //signalled when work is queued (or on shutdown)
+	std::condition_variable idle; //signalled when 'unfinished' reaches zero
+	bool stopping = false;
+
+	bool take(uint32_t index, Task *task);
+	void run(uint32_t index);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * TokenBucket limits how fast one connection's messages are handled.
+ *
+ * The bucket holds up to 'burst' tokens and refills at 'rate' tokens per second; each
+ * message handled takes one token. A client that sends faster than 'rate' isn't cut
+ * off, its messages just wait in its recv_buffer until tokens come back.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+struct TokenBucket {
+	using Clock = std::chrono::steady_clock;
+
+	TokenBucket() = default;
+	TokenBucket(float rate_, float burst_, Clock::time_point now) : rate(rate_), burst(burst_), tokens(burst_), refilled(now) { }
+
+	//whole tokens available at 'now':
+	uint32_t available(Clock::time_point now) {
+		float elapsed = std::chrono::duration< float >(now - refilled).count();
+		tokens = std::min(burst, tokens + elapsed * rate);
+		refilled = now;
+		return uint32_t(tokens);
+	}
+	//spend tokens (after checking available):
+	void take(uint32_t count) {
+		tokens -= float(count);
+	}
+	//seconds until at least one token is available (0 if one is):
+	float wait() const {
+		return tokens >= 1.0f ? 0.0f : (1.0f - tokens) / rate;
+	}
+
+	float rate = 0.0f; //tokens per second
+	float burst = 0.0f; //bucket size
+	float tokens = 0.0f;
+	Clock::time_point refilled;
+};
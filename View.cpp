@@ -9,6 +9,7 @@
 #include "Load.hpp"
 #include "data_path.hpp"
 #include "ColorTextureProgram.hpp"
+#include "Profile.hpp"
 
 namespace view {
 
@@ -299,8 +300,17 @@ void TextSpan::update(float elapsed) {
 	}
 }
 
+bool TextSpan::animating_ = false;
+
+bool TextSpan::take_animating() {
+	bool was = animating_;
+	animating_ = false;
+	return was;
+}
+
 void TextSpan::draw() {
 	if (!is_visible_) { return; }
+	Profile::Zone zone("TextSpan::draw");
 	do_render();
 	// Bind Stuff
 	GL_ERRORS();
@@ -322,6 +332,7 @@ void TextSpan::draw() {
 
 	size_t shown_glyph_count = animation_speed_.has_value() ? visible_glyph_count_ : glyph_count_;
 	assert(shown_glyph_count <= glyph_count_);
+	if (shown_glyph_count < glyph_count_) { animating_ = true; }
 	for (size_t i = 0; i < shown_glyph_count; ++i) {
 		hb_codepoint_t glyphid = glyph_info_[i].codepoint;
 		float x_offset = glyph_pos_[i].x_offset / 64.0f;
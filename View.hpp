@@ -129,6 +129,12 @@ public:
 	void draw();
 	void update(float elapsed);
 
+	/**
+	 * take_animating: true if a span drawn since the last call was still partway through its animation
+	 * (so the next frame will look different, and should be drawn even if nothing else changed).
+	 */
+	static bool take_animating();
+
 
 private:
 	void do_render();
@@ -149,6 +155,7 @@ private:
 	// ---- internal state related to animation ----
 	float total_time_elapsed_ = 0.0f;
 	unsigned int visible_glyph_count_ = 0;
+	static bool animating_;
 
 	// ---- internal states that can be discarded on a copy constructor
 	// text_is_rendered_: a state variable
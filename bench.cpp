@@ -0,0 +1,1000 @@
+#include "Protocol.hpp"
+#include "Game.hpp"
+#include "Odds.hpp"
+#include "Bot.hpp"
+#include "DiceRng.hpp"
+#include "Connection.hpp"
+#include "Matchmaker.hpp"
+#include "Journal.hpp"
+#include "Snapshot.hpp"
+#include "ThreadPool.hpp"
+#include "Mailbox.hpp"
+#include "Ratings.hpp"
+#include "Delta.hpp"
+#include "TableState.hpp"
+#include "Profile.hpp"
+#include "ServerState.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <functional>
+#include <random>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//Microbenchmarks for the game's hot paths.
+//Usage: ./bench [benchmark ...] (runs every benchmark if none are named)
+
+//run 'fn' and return elapsed seconds:
+static double time_it(std::function< void() > const &fn) {
+	auto before = std::chrono::high_resolution_clock::now();
+	fn();
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double >(after - before).count();
+}
+
+static void report(std::string const &what, uint64_t count, double seconds, std::string const &unit) {
+	std::cout << "  " << what << ": " << count << " " << unit << " in " << seconds * 1000.0 << " ms ("
+		<< uint64_t(count / seconds) << " " << unit << "/sec)" << std::endl;
+}
+
+//every heap allocation made while benchmarking (for paths that are meant not to allocate):
+static std::atomic< uint64_t > allocations{0};
+
+//(these pair malloc with free, which newer GCCs can't see once operator new is inlined at a call site)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t size) {
+	allocations += 1;
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+//----------------------------------------------------------------------------
+//Protocol encode + dispatch throughput:
+
+static void bench_codec() {
+	constexpr uint32_t Rounds = 1000000;
+	std::vector< char > buffer;
+	buffer.reserve(Rounds * 16);
+
+	double encode = time_it([&](){
+		for (uint32_t i = 0; i < Rounds; ++i) {
+			Protocol::send_claim(buffer, false, uint8_t(i % 12 + 1), uint8_t(i % 6 + 1));
+			if (i % 8 == 0) Protocol::send_join(buffer, "player");
+			if (i % 16 == 0) Protocol::send_reveal(buffer);
+		}
+	});
+	uint64_t encoded = Rounds + Rounds / 8 + Rounds / 16;
+	size_t bytes = buffer.size();
+
+	struct Counts {
+		uint64_t claims = 0, joins = 0, reveals = 0, name_bytes = 0;
+	} counts;
+	static constexpr Protocol::Handlers< Counts, Protocol::ToServer > handlers = {
+		[](Counts &c, Protocol::Frame const &m) { c.joins += 1; c.name_bytes += m.payload_size(); return true; },
+		[](Counts &, Protocol::Frame const &) { return true; },
+		[](Counts &c, Protocol::Frame const &m) { c.claims += m.field(0) + m.field(1); return true; },
+		[](Counts &c, Protocol::Frame const &) { c.reveals += 1; return true; },
+	};
+
+	uint64_t decoded = 0;
+	double decode = time_it([&](){
+		Protocol::dispatch< Protocol::ToServer >(handlers, counts, buffer, &decoded);
+	});
+
+	std::cout << "codec (" << bytes << " bytes):" << std::endl;
+	report("encode", encoded, encode, "messages");
+	report("dispatch", decoded, decode, "messages");
+	std::cout << "  decode rate: " << (bytes / decode) / (1024.0 * 1024.0) << " MiB/sec" << std::endl;
+	if (decoded != encoded || !buffer.empty()) {
+		std::cout << "  ERROR: decoded " << decoded << " of " << encoded << " messages." << std::endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//Bytes on the wire per game, original vs. packed format, over a simulated tournament:
+
+struct WireBytes {
+	uint64_t to_server = 0;
+	uint64_t to_client = 0;
+};
+
+//play one game between two scripted players through Game, one action per server tick:
+static WireBytes play_scripted_game(uint32_t seed, bool packed) {
+	WireBytes bytes;
+	Game game(seed);
+	std::mt19937 script(seed ^ 0x5eed);
+
+	Game::Player *seats[2] = {game.add_player(), game.add_player()};
+	std::vector< char > inbound, outbound;
+
+	auto from = [&](Game::Player *player, auto &&encode) {
+		inbound.clear();
+		encode(inbound);
+		bytes.to_server += inbound.size();
+		game.handle_messages(*player, inbound);
+	};
+	auto tick = [&]() {
+		for (Game::Player *player : seats) {
+			outbound.clear();
+			game.send_update(*player, outbound);
+			bytes.to_client += outbound.size();
+		}
+		game.end_tick();
+	};
+
+	for (uint32_t i = 0; i < 2; ++i) {
+		from(seats[i], [&](std::vector< char > &to) {
+			std::string name = "player" + std::to_string(i);
+			if (packed) Protocol::send_hello(to, Protocol::Version, Protocol::CapPacked, name);
+			else Protocol::send_join(to, name);
+		});
+	}
+	tick();
+	//(the table starts once both seats are ready)
+	for (Game::Player *player : seats) {
+		from(player, [](std::vector< char > &to) { Protocol::send_start(to); });
+	}
+	tick();
+	tick();
+
+	bool first = true;
+	while (game.state != 3) {
+		Game::Player *turn = seats[game.cur_player % 2];
+		//raise the claim until someone calls it (more likely as claims grow):
+		std::uniform_int_distribution< uint32_t > percent(0, 99);
+		if (!first && (game.dice_num >= 12 || percent(script) < game.dice_num * 8u)) {
+			from(turn, [](std::vector< char > &to) { Protocol::send_reveal(to); });
+		} else {
+			uint8_t num = game.dice_num, point = game.dice_point;
+			if (first || point == 6 || percent(script) < 50) {
+				num += (first ? 0 : 1);
+				point = uint8_t(1 + percent(script) % 6);
+			} else {
+				point += 1;
+			}
+			from(turn, [&](std::vector< char > &to) { Protocol::send_claim(to, packed, num, point); });
+		}
+		first = false;
+		tick();
+	}
+	return bytes;
+}
+
+static void bench_wire_bytes() {
+	constexpr uint32_t Games = 10000;
+	std::cout << "wire bytes (" << Games << " games):" << std::endl;
+	uint64_t totals[2] = {0, 0};
+	for (bool packed : {false, true}) {
+		WireBytes sum;
+		double seconds = time_it([&](){
+			for (uint32_t g = 0; g < Games; ++g) {
+				WireBytes b = play_scripted_game(g, packed);
+				sum.to_server += b.to_server;
+				sum.to_client += b.to_client;
+			}
+		});
+		totals[packed] = sum.to_server + sum.to_client;
+		std::cout << "  " << (packed ? "packed:  " : "original:") << " "
+			<< double(sum.to_server) / Games << " bytes/game to server, "
+			<< double(sum.to_client) / Games << " bytes/game to clients ("
+			<< seconds * 1000.0 << " ms)" << std::endl;
+	}
+	std::cout << "  packed format uses " << 100.0 * double(totals[1]) / double(totals[0]) << "% of the original bytes" << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Claim probability evaluation:
+
+static void bench_odds() {
+	constexpr uint32_t Hands = 1 << 16;
+	constexpr uint32_t Rounds = 64;
+	std::mt19937 mt(0xdeadbeef);
+	std::vector< uint8_t > hands(Hands * 6);
+	for (auto &d : hands) d = uint8_t(mt() % 6 + 1);
+
+	//full 48x6 claim tables (72 of which are reachable with two players):
+	Odds::Claims claims;
+	float sink = 0.0f;
+	double seconds = time_it([&](){
+		for (uint32_t r = 0; r < Rounds; ++r) {
+			for (uint32_t h = 0; h < Hands; ++h) {
+				Odds::evaluate(&hands[h * 6], 6, 6 + (h % 8) * 6, &claims);
+				sink += claims(2 + h % 10, 1 + h % 6);
+			}
+		}
+	});
+	uint64_t tables = uint64_t(Hands) * Rounds;
+	std::cout << "odds:" << std::endl;
+	report("claim tables", tables, seconds, "tables");
+	report("claims (via tables)", tables * Odds::MaxDice * Odds::Faces, seconds, "claims");
+
+	//single claims:
+	seconds = time_it([&](){
+		for (uint32_t r = 0; r < Rounds; ++r) {
+			for (uint32_t h = 0; h < Hands; ++h) {
+				sink += Odds::claim_probability(&hands[h * 6], 6, 6, 1 + h % 12, 1 + r % 6);
+			}
+		}
+	});
+	report("single claims", tables, seconds, "claims");
+	if (sink < 0.0f) std::cout << sink << std::endl; //keep the optimizer honest
+}
+
+//----------------------------------------------------------------------------
+//Bot decision cost, alone and as whole bot-vs-bot games through Game:
+
+static void bench_bot() {
+	constexpr uint32_t Hands = 1 << 16;
+	std::mt19937 mt(0xb07);
+	std::vector< uint8_t > hands(Hands * 6);
+	for (auto &d : hands) d = uint8_t(mt() % 6 + 1);
+
+	Bot bot;
+	uint64_t reveals = 0;
+	double seconds = time_it([&](){
+		for (uint32_t h = 0; h < Hands; ++h) {
+			uint8_t num = uint8_t(1 + h % 5), point = uint8_t(1 + h % 6);
+			Bot::Move move = bot.decide(&hands[h * 6], 6, 6, (h % 7 == 0), num, point);
+			reveals += move.reveal;
+		}
+	});
+	std::cout << "bot:" << std::endl;
+	report("decisions", Hands, seconds, "decisions");
+	std::cout << "  " << seconds / Hands * 1e9 << " ns/decision (" << reveals << " reveals)" << std::endl;
+
+	//bot-filled tables, each played to the end within one tick:
+	constexpr uint32_t Tables = 10000;
+	uint64_t finished = 0;
+	seconds = time_it([&](){
+		for (uint32_t t = 0; t < Tables; ++t) {
+			Game game(t);
+			game.add_bot();
+			game.add_bot(); //(a full table of bots starts right away)
+			game.end_tick(); //bots play the whole game here
+			finished += (game.state == 3);
+		}
+	});
+	report("bot-vs-bot tables", Tables, seconds, "tables");
+	if (finished != Tables) std::cout << "  ERROR: only " << finished << " tables finished." << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Dice generation, std::mt19937 + uniform_int_distribution vs. DiceRng, one generator and many tables:
+
+static void bench_dice() {
+	constexpr uint32_t Tables = 1 << 20;
+	constexpr uint32_t PerTable = 12;
+	constexpr uint64_t Dice = uint64_t(Tables) * PerTable;
+	std::vector< uint8_t > dices(Dice);
+
+	std::mt19937 mt(0xd1ce);
+	double mt_seconds = time_it([&](){
+		std::uniform_int_distribution< uint32_t > face(1, 6);
+		for (auto &d : dices) d = uint8_t(face(mt));
+	});
+
+	DiceRng rng(0xd1ce);
+	double rng_seconds = time_it([&](){
+		rng.roll(dices.data(), uint32_t(Dice));
+	});
+
+	//each table with its own generator, as on a server with many tables:
+	std::vector< DiceRng > rngs;
+	rngs.reserve(Tables);
+	for (uint32_t t = 0; t < Tables; ++t) rngs.emplace_back(t);
+	double tables_seconds = time_it([&](){
+		roll_tables(rngs.data(), dices.data(), Tables, PerTable);
+	});
+
+	//faces should come out (very nearly) equally often:
+	uint64_t counts[7] = {0};
+	for (auto d : dices) counts[d] += 1;
+
+	std::cout << "dice:" << std::endl;
+	report("mt19937", Dice, mt_seconds, "dice");
+	report("DiceRng", Dice, rng_seconds, "dice");
+	report("DiceRng per table", Dice, tables_seconds, "dice");
+	std::cout << "  faces:";
+	for (uint32_t f = 1; f <= 6; ++f) std::cout << " " << double(counts[f]) / Dice;
+	std::cout << std::endl;
+	if (counts[0]) std::cout << "  ERROR: " << counts[0] << " dice out of range." << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Spectator fan-out, a copy of the update per connection vs. one shared payload:
+
+static void bench_fanout() {
+	Game game(1);
+	game.add_bot();
+	game.add_bot();
+	game.state = 3; //the largest spectator update (both seats' dice)
+
+	std::cout << "fanout:" << std::endl;
+	for (uint32_t audience : {10u, 1000u, 100000u}) {
+		std::list< Connection > connections(audience);
+		constexpr uint32_t Ticks = 10;
+
+		double copy_seconds = time_it([&](){
+			for (uint32_t t = 0; t < Ticks; ++t) {
+				for (auto &c : connections) {
+					game.send_spectator_update(false, c.send_buffer);
+					c.send_buffer.clear(); //(as if sent)
+				}
+			}
+		});
+
+		size_t queued = 0;
+		double shared_seconds = time_it([&](){
+			for (uint32_t t = 0; t < Ticks; ++t) {
+				auto update = std::make_shared< std::vector< char > >();
+				game.send_spectator_update(false, *update);
+				Connection::Payload payload = std::move(update);
+				for (auto &c : connections) {
+					c.send_shared(payload);
+				}
+				for (auto &c : connections) {
+					queued += c.pending_send();
+					c.send_queue.clear(); //(as if sent)
+				}
+			}
+		});
+
+		uint64_t sends = uint64_t(audience) * Ticks;
+		std::cout << "  " << audience << " spectators: copy " << copy_seconds / sends * 1e9
+			<< " ns/spectator, shared " << shared_seconds / sends * 1e9 << " ns/spectator ("
+			<< queued / sends << "-byte update)" << std::endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//Matchmaking a large queue, in simulated time (batches every 5ms while players keep arriving):
+
+static void bench_match() {
+	constexpr uint32_t Players = 100000;
+	constexpr uint32_t Batches = 200; //one second of arrivals
+	std::mt19937 mt(0x3a7c);
+	std::normal_distribution< float > skill(1500.0f, 300.0f);
+	std::uniform_int_distribution< uint32_t > rtt(5, 250);
+
+	Matchmaker matchmaker;
+	std::vector< Matchmaker::Match > matches;
+	auto start = Matchmaker::Clock::now();
+	auto batch = std::chrono::duration_cast< Matchmaker::Clock::duration >(std::chrono::duration< double >(0.005));
+
+	uint64_t seated = 0, bots = 0, tables = 0;
+	uint64_t id = 0;
+	double seconds = time_it([&](){
+		//players arrive evenly over the first second, then the queue drains:
+		for (uint32_t b = 0; matchmaker.waiting() > 0 || id < Players; ++b) {
+			auto now = start + batch * b;
+			for (uint32_t i = 0; i < Players / Batches && id < Players; ++i) {
+				matchmaker.enqueue(id++, int32_t(skill(mt)), rtt(mt), now);
+			}
+			matches.clear();
+			matchmaker.match(now, &matches);
+			for (auto const &m : matches) {
+				tables += 1;
+				seated += m.ids.size();
+				bots += m.bots;
+			}
+		}
+	});
+
+	std::cout << "match:" << std::endl;
+	report("players matched", seated, seconds, "players");
+	std::cout << "  " << tables << " tables, " << bots << " bot seats; time to match p50 "
+		<< matchmaker.time_to_match(0.50f) * 1000.0 << " ms, p90 "
+		<< matchmaker.time_to_match(0.90f) * 1000.0 << " ms, p99 "
+		<< matchmaker.time_to_match(0.99f) * 1000.0 << " ms (simulated time)" << std::endl;
+	if (seated != Players) std::cout << "  ERROR: only " << seated << " of " << Players << " players seated." << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Journaling 50k events/sec (queue + group commit with fsync once per tick), and snapshots:
+
+static void bench_journal() {
+	constexpr uint32_t EventsPerSecond = 50000;
+	constexpr uint32_t Seconds = 4;
+	constexpr uint32_t Tables = 5000;
+	std::string const path = "bench-journal.tmp";
+
+	std::cout << "journal:" << std::endl;
+	for (uint32_t ticks_per_second : {1u, 20u}) {
+		Journal journal(path);
+		journal.snapshot(std::vector< char >());
+		char const claim[2] = {'C', 17};
+		double record = 0.0, commit = 0.0;
+		for (uint32_t tick = 0; tick < Seconds * ticks_per_second; ++tick) {
+			record += time_it([&](){
+				for (uint32_t i = 0; i < EventsPerSecond / ticks_per_second; ++i) {
+					journal.record(SessionLog::Recv, i % 1000, claim, sizeof(claim));
+				}
+				journal.record(SessionLog::Tick, 0);
+			});
+			commit += time_it([&](){ journal.commit(); });
+		}
+		std::cout << "  " << ticks_per_second << " commit(s)/sec:" << std::endl;
+		report("  record", journal.events, record, "events");
+		std::cout << "    commit: " << journal.commits << " commits of " << journal.bytes / journal.commits << " bytes, "
+			<< commit / journal.commits * 1000.0 << " ms average, " << journal.commit_seconds_max * 1000.0 << " ms max" << std::endl;
+		std::cout << "    overhead: " << (record + commit) / Seconds * 100.0 << "% of one core at " << EventsPerSecond << " events/sec" << std::endl;
+	}
+
+	{ //snapshot a busy server's worth of tables:
+		std::vector< Game > games;
+		games.reserve(Tables);
+		for (uint32_t t = 0; t < Tables; ++t) {
+			games.emplace_back(t);
+			games.back().add_bot();
+			games.back().add_bot();
+		}
+		std::vector< char > state;
+		double save = time_it([&](){
+			SnapshotWriter out{state};
+			for (Game const &game : games) game.save(out);
+		});
+		Journal journal(path);
+		double write = time_it([&](){ journal.snapshot(state); });
+		std::vector< Game > loaded(Tables, Game(0));
+		double load = time_it([&](){
+			SnapshotReader in{state.data(), state.data() + state.size()};
+			for (Game &game : loaded) game.load(in);
+		});
+		std::cout << "  snapshot of " << Tables << " tables: " << state.size() << " bytes; save " << save * 1000.0
+			<< " ms, write + fsync " << write * 1000.0 << " ms, load " << load * 1000.0 << " ms" << std::endl;
+	}
+
+	std::remove(path.c_str());
+	std::remove((path + ".snap").c_str());
+}
+
+//----------------------------------------------------------------------------
+//The server's state without sockets (ServerState.hpp): players joining through the lobby and
+// matchmaking, a tick of updates, and a journal snapshot of it all, loaded back into a fresh state:
+
+static void bench_state() {
+	constexpr uint32_t Players = 10000;
+	std::cout << "state (" << Players << " players):" << std::endl;
+	Server server; //(listens on nothing; the connections below have no sockets)
+	ServerState::Options options;
+	options.rate = 0.0f;
+	ServerState state(server, options, nullptr, nullptr, nullptr);
+	state.open_ratings("");
+	std::list< Connection > connections(Players);
+
+	uint32_t seated = 0;
+	double join = time_it([&](){
+		uint32_t i = 0;
+		for (Connection &c : connections) {
+			state.connected(&c);
+			Protocol::send_hello(c.recv_buffer, Protocol::Version, Protocol::CapPacked, "player" + std::to_string(i++));
+			Protocol::send_start(c.recv_buffer);
+			state.received(&c);
+		}
+		auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (seated < Players && std::chrono::steady_clock::now() < give_up) {
+			state.serve(std::chrono::steady_clock::now());
+			seated = uint32_t(std::count_if(state.players.begin(), state.players.end(), [](auto const &p) { return p.second.table != nullptr; }));
+		}
+	});
+	report("joined and seated", seated, join, "players");
+
+	uint64_t sent = 0;
+	double tick = time_it([&](){
+		state.tick(std::chrono::steady_clock::now());
+	});
+	for (Connection &c : connections) sent += c.send_buffer.size();
+
+	std::vector< char > saved;
+	double save = time_it([&](){
+		saved = state.save_state();
+	});
+	ServerState loaded(server, options, nullptr, nullptr, nullptr);
+	std::unordered_map< uint32_t, ServerState::Table * > by_table;
+	ServerState::Seats seats;
+	double load = time_it([&](){
+		SnapshotReader in{saved.data(), saved.data() + saved.size()};
+		loaded.load_state(in, &by_table, &seats);
+	});
+	//(the same tables, game for game, and every seat found again)
+	bool same = (loaded.tables.size() == state.tables.size() && seats.size() == seated);
+	std::vector< char > a, b;
+	for (auto t = state.tables.begin(), u = loaded.tables.begin(); same && t != state.tables.end(); ++t, ++u) {
+		a.clear();
+		b.clear();
+		SnapshotWriter wa{a}, wb{b};
+		t->game.save(wa);
+		u->game.save(wb);
+		same = (t->id == u->id && a == b);
+	}
+	std::cout << "  " << state.tables.size() << " tables; a tick: " << tick * 1000.0 << " ms, " << double(sent) / Players
+		<< " bytes/player; snapshot: " << saved.size() << " bytes, saved in " << save * 1000.0 << " ms, loaded in " << load * 1000.0 << " ms"
+		<< (same && seated == Players ? "" : " (INVALID!)") << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Bot-only tables of 2 to 8 seats: per-game cost, allocations, and the reveal every seat is sent:
+
+static void bench_seats() {
+	constexpr uint32_t Games = 20000;
+	std::cout << "seats (" << Games << " bot games per table size):" << std::endl;
+	for (uint32_t seats : {2u, 4u, 8u}) {
+		Game game(seats, seats);
+		for (uint32_t s = 0; s < seats; ++s) {
+			game.add_bot(); //(the last one starts the game)
+		}
+		Game::Player viewer; //what a human in each seat would be sent
+		viewer.capabilities = Protocol::CapPacked | Protocol::CapTables;
+		std::vector< char > out;
+		out.reserve(256);
+		uint64_t bytes = 0, finished = 0;
+		uint64_t allocated = allocations;
+		double seconds = time_it([&](){
+			for (uint32_t g = 0; g < Games; ++g) {
+				game.end_tick(); //rolled -> playing; the bots play it out
+				finished += (game.state == 3);
+				for (uint32_t s = 0; s < seats; ++s) {
+					viewer.player_id = uint8_t(s);
+					out.clear();
+					game.send_update(viewer, out);
+					bytes += out.size();
+				}
+				game.start_if_ready(); //(bots are always ready)
+			}
+		});
+		allocated = allocations - allocated;
+		std::cout << "  " << seats << " seats: " << finished << " games, " << seconds / Games * 1e6 << " us/game, "
+			<< double(allocated) / Games << " allocations/game, " << double(bytes) / (Games * seats) << " reveal bytes/seat" << std::endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//Rules (not timed): claims and calls out of turn, before play, or after a game is decided are
+// ignored, so two human players can't add rated outcomes by revealing again and again; and a seat
+// left mid-game is played out by a bot, so the players still there aren't left waiting on it:
+
+static void bench_rules() {
+	std::cout << "rules:" << std::endl;
+	Game game(1, 2);
+	game.rated = true;
+	Game::Player &alice = *game.add_player();
+	Game::Player &bob = *game.add_player();
+	std::vector< char > in;
+	auto send = [&](Game::Player &player, auto &&write) {
+		in.clear();
+		write(in);
+		return game.handle_messages(player, in);
+	};
+	auto claim = [](uint8_t num, uint8_t point) { return [=](std::vector< char > &to) { Protocol::send_claim(to, true, num, point); }; };
+	auto reveal = [](std::vector< char > &to) { Protocol::send_reveal(to); };
+	bool ok = send(alice, [](std::vector< char > &to) { Protocol::send_join(to, "alice"); })
+	       && send(bob, [](std::vector< char > &to) { Protocol::send_join(to, "bob"); });
+
+	//in the waiting room:
+	ok = ok && send(alice, claim(12, 6));
+	for (uint32_t i = 0; i < 3; ++i) ok = ok && send(alice, reveal);
+	bool waiting = (game.state == 0 && game.outcomes.empty());
+
+	ok = ok && send(alice, [](std::vector< char > &to) { Protocol::send_start(to); })
+	       && send(bob, [](std::vector< char > &to) { Protocol::send_start(to); });
+	game.end_tick(); //rolled -> playing
+	Game::Player &first = (game.cur_player == alice.player_id ? alice : bob);
+	Game::Player &second = (&first == &alice ? bob : alice);
+
+	//out of turn, and before any claim:
+	ok = ok && send(second, claim(1, 2)) && send(second, reveal) && send(first, reveal);
+	bool early = (game.state == 2 && game.opening && game.outcomes.empty());
+
+	//a claim that doesn't raise the standing one (one 1, to start with) is invalid:
+	bool lowest = !send(first, claim(1, 1));
+	ok = ok && send(first, claim(1, 2)) && send(first, claim(1, 3));
+	bool raised = (game.dice_num == 1 && game.dice_point == 2 && !game.opening);
+
+	//one call decides the game; more change nothing:
+	ok = ok && send(second, reveal);
+	for (uint32_t i = 0; i < 3; ++i) ok = ok && send(second, reveal) && send(first, reveal);
+	bool once = (game.state == 3 && game.outcomes.size() == 1);
+
+	//the largest claim still fits a claim byte at eight seats:
+	uint8_t const top = Protocol::claim_byte(Protocol::MaxClaimDice, 6);
+	bool fits = valid_claim(Game::MaxSeats * Game::DicePerSeat, Protocol::MaxClaimDice, 6)
+	         && !valid_claim(Game::MaxSeats * Game::DicePerSeat, Protocol::MaxClaimDice + 1, 1)
+	         && Protocol::claim_num(top) == Protocol::MaxClaimDice && Protocol::claim_point(top) == 6;
+
+	//at a table of three, the player whose turn it is leaves:
+	Game three(2, 3);
+	std::vector< Game::Player * > humans{three.add_player(), three.add_player(), three.add_player()};
+	for (Game::Player *p : humans) {
+		in.clear();
+		Protocol::send_start(in);
+		ok = ok && three.handle_messages(*p, in);
+	}
+	three.end_tick(); //rolled -> playing
+	uint8_t left = uint8_t(three.cur_player);
+	three.remove_player(humans[left]);
+	auto stand_in = std::find_if(three.players.begin(), three.players.end(), [&](Game::Player const &p) { return p.player_id == left; });
+	//(the bot either called, or claimed and passed the turn to a player still seated)
+	bool taken_over = stand_in != three.players.end() && stand_in->bot && three.seated() == 3
+	                && (three.state == 3 || (three.state == 2 && three.cur_player != left));
+
+	std::cout << "  waiting room: " << (waiting ? "ignored" : "(INVALID!)")
+		<< "; out of turn / before a claim: " << (early ? "ignored" : "(INVALID!)")
+		<< "; non-raising claim: " << (lowest ? "rejected" : "(INVALID!)")
+		<< "; claims: " << (raised ? "raise, in turn" : "(INVALID!)")
+		<< "; repeated calls: " << game.outcomes.size() << " rated outcome" << (once ? "" : " (INVALID!)")
+		<< "; largest claim: " << int(Protocol::MaxClaimDice) << (fits ? "" : " (INVALID!)")
+		<< "; seat left mid-turn: " << (taken_over ? "played by a bot" : "(INVALID!)")
+		<< (ok ? "" : " (a valid message was rejected!)") << std::endl;
+}
+
+//----------------------------------------------------------------------------
+//Tables as actors (server --workers): messages posted round-robin to many tables' mailboxes,
+// drained by a work-stealing pool; each message has its table play a bot game:
+
+static void bench_actors() {
+	constexpr uint32_t Tables = 256;
+	constexpr uint32_t Messages = 100000;
+	std::cout << "actors (" << Messages << " messages to " << Tables << " tables of 2 bots):" << std::endl;
+
+	std::vector< std::unique_ptr< Game > > games;
+	auto reset = [&]() {
+		games.clear();
+		for (uint32_t t = 0; t < Tables; ++t) {
+			games.emplace_back(std::make_unique< Game >(t, 2));
+			games.back()->add_bot();
+			games.back()->add_bot();
+		}
+	};
+	auto play = [](Game &game) {
+		game.end_tick(); //rolled -> playing; the bots play it out
+		game.start_if_ready();
+	};
+
+	//on the calling thread, for comparison:
+	reset();
+	double inline_seconds = time_it([&](){
+		for (uint32_t m = 0; m < Messages; ++m) {
+			play(*games[m % Tables]);
+		}
+	});
+	report("inline", Messages, inline_seconds, "messages");
+
+	std::vector< uint32_t > thread_counts = {1, 2, 4, 8};
+	uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	thread_counts.erase(std::remove_if(thread_counts.begin(), thread_counts.end(), [&](uint32_t t) { return t > hardware; }), thread_counts.end());
+	if (thread_counts.back() != hardware) thread_counts.emplace_back(hardware);
+	for (uint32_t threads : thread_counts) {
+		reset();
+		ThreadPool pool(threads);
+		std::vector< std::unique_ptr< Mailbox< uint32_t > > > mailboxes;
+		for (uint32_t t = 0; t < Tables; ++t) {
+			Game *game = games[t].get();
+			mailboxes.emplace_back(std::make_unique< Mailbox< uint32_t > >(pool, [game, &play](uint32_t &) { play(*game); }));
+		}
+		double seconds = time_it([&](){
+			for (uint32_t m = 0; m < Messages; ++m) {
+				mailboxes[m % Tables]->post(m);
+			}
+			pool.wait();
+		});
+		uint64_t handled = 0;
+		for (auto const &mailbox : mailboxes) handled += mailbox->handled;
+		report(std::to_string(threads) + " thread(s)", handled, seconds, "messages");
+		std::cout << "    (" << inline_seconds / seconds << "x inline)" << std::endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//Rounds as coroutines (C++20 build): memory held by many suspended rounds, and the cost of waking them:
+
+static void bench_rounds() {
+#ifdef GAME_COROUTINES
+	constexpr uint32_t Tables = 100000;
+	std::cout << "rounds (" << Tables << " tables of 2 bots):" << std::endl;
+	size_t reserved = FramePool::reserved(), live = FramePool::live();
+	std::vector< Game > games;
+	games.reserve(Tables);
+	for (uint32_t t = 0; t < Tables; ++t) {
+		Game &game = games.emplace_back(t);
+		game.add_bot();
+		game.add_bot(); //(the round rolls, then waits for the tick)
+	}
+	size_t frames = FramePool::live() - live;
+	reserved = FramePool::reserved() - reserved;
+	std::cout << "  " << frames << " suspended rounds: " << reserved / 1024 << " KiB of frames ("
+		<< double(reserved) / frames << " bytes/round, next to " << sizeof(Game) << " bytes/Game)" << std::endl;
+	uint64_t finished = 0;
+	double seconds = time_it([&](){
+		for (Game &game : games) {
+			game.end_tick(); //rolled -> playing; the bots play it out
+			finished += (game.state == 3);
+			game.start_if_ready();
+		}
+	});
+	report("games", finished, seconds, "games");
+#else
+	std::cout << "rounds: only in the C++20 build (jam -sCOROUTINES=1)" << std::endl;
+#endif
+}
+
+//----------------------------------------------------------------------------
+//Ratings for a million players in a memory-mapped file: Elo updates, rank lookups, leaderboard pages, reopening:
+
+static void bench_ratings() {
+	constexpr uint32_t Players = 1000000;
+	constexpr uint32_t Updates = 1000000;
+	constexpr uint32_t Lookups = 1000000;
+	constexpr uint32_t Pages = 10000; //of 100 entries, from random ranks
+	std::string const path = "bench-ratings.tmp";
+	std::remove(path.c_str());
+
+	std::cout << "ratings (" << Players << " players):" << std::endl;
+	std::vector< std::string > names;
+	names.reserve(Players);
+	for (uint32_t i = 0; i < Players; ++i) names.emplace_back("player" + std::to_string(i));
+	std::mt19937 mt(1);
+	std::vector< uint32_t > pairs(2 * Updates);
+	for (uint32_t &p : pairs) p = mt() % Players;
+	{
+		Ratings ratings(path);
+		double add = time_it([&](){
+			for (uint32_t i = 0; i + 1 < Players; i += 2) ratings.record(names[i], names[i + 1]);
+		});
+		report("first games (adding players)", Players / 2, add, "updates");
+		double update = time_it([&](){
+			for (uint32_t i = 0; i < Updates; ++i) ratings.record(names[pairs[2 * i]], names[pairs[2 * i + 1]]);
+		});
+		report("updates", Updates, update, "updates");
+		uint64_t checksum = 0;
+		Ratings::Entry entry;
+		double lookup = time_it([&](){
+			for (uint32_t i = 0; i < Lookups; ++i) {
+				if (ratings.find(names[pairs[i]], &entry)) checksum += entry.rank;
+			}
+		});
+		report("rank lookups", Lookups, lookup, "lookups");
+		std::vector< Ratings::Entry > page;
+		double pages = time_it([&](){
+			for (uint32_t i = 0; i < Pages; ++i) {
+				page.clear();
+				ratings.top(mt() % Players, 100, &page);
+				checksum += page.size();
+			}
+		});
+		report("leaderboard pages of 100", Pages, pages, "pages");
+		page.clear();
+		ratings.top(0, 1, &page);
+		std::cout << "  best: " << page[0].name << " at " << page[0].rating << " after " << page[0].games << " games; index and names take "
+			<< double(ratings.memory()) / Players << " bytes/player (file: " << sizeof(Ratings::Record) << " bytes/player) [" << checksum % 10 << "]" << std::endl;
+	}
+	{
+		double open = time_it([&](){
+			Ratings ratings(path);
+			if (ratings.size() != Players) std::cout << "  reopened the wrong number of players!" << std::endl;
+		});
+		std::cout << "  reopen (map the file and rebuild the index): " << open * 1000.0 << " ms" << std::endl;
+	}
+	std::remove(path.c_str());
+}
+
+//----------------------------------------------------------------------------
+//State updates sent as deltas (CapCompression) or whole, for every seat of a bot table and its spectators;
+// each state is sent for a few ticks, as it is while humans take their time: bytes, and encode/decode cost:
+
+static void bench_delta() {
+	constexpr uint32_t Games = 5000;
+	constexpr uint32_t TicksPerState = 4; //(one-second ticks)
+	std::cout << "delta (" << Games << " bot games per table size, each state sent for " << TicksPerState << " ticks):" << std::endl;
+	for (uint32_t seats : {2u, 8u}) {
+		Game game(seats, seats);
+		for (uint32_t s = 0; s < seats; ++s) {
+			game.add_bot(); //(the last one starts the game)
+		}
+		Game::Player viewer; //what a human in each seat would be sent
+		viewer.capabilities = Protocol::CapPacked | Protocol::CapTables;
+
+		//record every tick's updates: one stream per seat, then the spectators':
+		uint32_t const streams = seats + 1;
+		std::vector< std::vector< char > > updates;
+		auto send_tick = [&]() {
+			for (uint32_t t = 0; t < TicksPerState; ++t) {
+				for (uint32_t s = 0; s < seats; ++s) {
+					viewer.player_id = uint8_t(s);
+					updates.emplace_back();
+					game.send_update(viewer, updates.back());
+				}
+				updates.emplace_back();
+				game.send_spectator_update(true, updates.back());
+			}
+		};
+		for (uint32_t g = 0; g < Games; ++g) {
+			send_tick(); //rolled
+			game.end_tick(); //the bots play it out
+			send_tick(); //revealed
+			game.start_if_ready();
+		}
+
+		uint64_t whole = 0, sent = 0, mismatched = 0;
+		std::vector< char > out;
+		out.reserve(4096);
+		double copy = time_it([&](){
+			for (auto const &update : updates) {
+				out.clear();
+				out.insert(out.end(), update.begin(), update.end());
+				whole += out.size();
+			}
+		});
+		std::vector< Delta::Baseline > encoders(streams), decoders(streams);
+		std::vector< std::vector< char > > encoded(updates.size());
+		double encode = time_it([&](){
+			for (size_t i = 0; i < updates.size(); ++i) {
+				Delta::encode(encoded[i], encoders[i % streams], updates[i].data(), updates[i].size());
+				sent += encoded[i].size();
+			}
+		});
+		double decode = time_it([&](){
+			for (size_t i = 0; i < updates.size(); ++i) {
+				uint8_t slot = 0;
+				uint32_t header = 0;
+				int64_t size = (encoded[i].empty() ? 0 : Protocol::frame< Protocol::ToClient >(encoded[i].data(), encoded[i].size(), &slot, &header));
+				if (size <= 0 || (slot != Protocol::ToClient::Repeat && slot != Protocol::ToClient::Delta)) {
+					mismatched += (encoded[i] != updates[i]); //(sent as it was)
+					continue;
+				}
+				Delta::Baseline &baseline = decoders[i % streams];
+				if (size != int64_t(encoded[i].size()) || !Delta::decode(Protocol::Frame{encoded[i].data(), header, uint32_t(size)}, baseline)
+				 || baseline.bytes != updates[i]) mismatched += 1;
+			}
+		});
+		std::cout << "  " << seats << " seats: whole " << double(whole) / updates.size() << " bytes/update, as deltas "
+			<< double(sent) / updates.size() << " (" << 100.0 * double(sent) / double(whole) << "%); copy "
+			<< copy / updates.size() * 1e9 << " ns, encode " << encode / updates.size() * 1e9 << " ns, decode "
+			<< decode / updates.size() * 1e9 << " ns per update" << (mismatched ? " (MISMATCHED!)" : "") << std::endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//The client's decoding (TableState) of what a seat at a 4-seat bot table is sent, each state for a few
+// ticks, whole and as deltas: a poll's worth of bytes at a time, consumed once per poll, as PlayMode does:
+
+static void bench_client() {
+	constexpr uint32_t Games = 2000;
+	constexpr uint32_t TicksPerState = 4; //(one-second ticks)
+	constexpr uint8_t Seats = 4;
+	std::cout << "client (" << Games << " bot games at a table of " << uint32_t(Seats) << ", each state sent for " << TicksPerState << " ticks):" << std::endl;
+
+	Game game(1, Seats);
+	for (uint32_t s = 1; s < Seats; ++s) game.add_bot();
+	Game::Player viewer; //what a human in seat 0 would be sent
+	viewer.capabilities = Protocol::CapPacked | Protocol::CapTables;
+	std::vector< std::vector< char > > ticks;
+	auto send_ticks = [&]() {
+		for (uint32_t t = 0; t < TicksPerState; ++t) {
+			ticks.emplace_back();
+			game.send_update(viewer, ticks.back());
+		}
+	};
+	send_ticks(); //the waiting room: seat and names
+	game.add_bot(); //(fills the table, which starts)
+	for (uint32_t g = 0; g < Games; ++g) {
+		send_ticks(); //rolled
+		game.end_tick(); //the bots play it out
+		send_ticks(); //revealed
+		game.start_if_ready();
+	}
+	uint64_t messages = 0;
+	for (auto const &tick : ticks) {
+		bool invalid = false;
+		uint32_t count = 0;
+		Protocol::split< Protocol::ToClient >(tick, ~0u, &count, &invalid);
+		messages += count;
+	}
+
+	for (bool deltas : {false, true}) {
+		std::vector< std::vector< char > > received(ticks.size());
+		Delta::Baseline baseline;
+		for (size_t t = 0; t < ticks.size(); ++t) {
+			if (deltas) Delta::encode(received[t], baseline, ticks[t].data(), ticks[t].size());
+			else received[t] = ticks[t];
+		}
+		TableState table("seat0");
+		table.capabilities = viewer.capabilities;
+		std::vector< char > recv_buffer;
+		recv_buffer.reserve(4096);
+		uint64_t changes = 0, invalid = 0;
+		auto run = [&]() {
+			for (auto const &bytes : received) {
+				recv_buffer.insert(recv_buffer.end(), bytes.begin(), bytes.end());
+				size_t at = 0;
+				while (TableState::Change change = table.next(recv_buffer, &at)) {
+					if (change == TableState::Invalid) {
+						invalid += 1;
+						at = recv_buffer.size();
+						break;
+					}
+					changes += 1;
+				}
+				recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + at);
+			}
+		};
+		run(); //(the first pass grows the fields to fit)
+		changes = 0;
+		uint64_t allocated = 0;
+		double seconds = time_it([&](){
+			uint64_t before = allocations;
+			run();
+			allocated = allocations - before;
+		});
+		std::cout << "  " << (deltas ? "as deltas" : "whole") << ": " << messages << " messages, " << changes << " changes, "
+			<< seconds / messages * 1e9 << " ns/message, " << double(allocated) / messages << " allocations/message"
+			<< (invalid ? " (INVALID!)" : "") << std::endl;
+	}
+}
+
+static void bench_profile() {
+	constexpr uint32_t Zones = 10000000;
+	std::cout << "profile (" << Zones << " nested zones):" << std::endl;
+	for (bool on : {false, true}) {
+		Profile::enable(on);
+		uint64_t before = allocations;
+		double seconds = time_it([&](){
+			for (uint32_t i = 0; i < Zones / 2; ++i) {
+				Profile::Zone outer("outer");
+				Profile::Zone inner("inner");
+			}
+		});
+		std::cout << "  " << (on ? "enabled" : "disabled") << ": " << seconds / Zones * 1e9 << " ns/zone, "
+			<< double(allocations - before) / Zones << " allocations/zone" << std::endl;
+	}
+	Profile::enable(false);
+	auto totals = Profile::summary(60.0);
+	double seconds = time_it([&](){ totals = Profile::summary(60.0); });
+	std::cout << "  summary of the last " << Profile::Capacity << " zones: " << seconds * 1000.0 << " ms ("
+		<< totals.size() << " names)" << std::endl;
+}
+
+//----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+	std::vector< std::pair< std::string, std::function< void() > > > benchmarks = {
+		{"codec", bench_codec},
+		{"bytes", bench_wire_bytes},
+		{"odds", bench_odds},
+		{"bot", bench_bot},
+		{"dice", bench_dice},
+		{"fanout", bench_fanout},
+		{"match", bench_match},
+		{"journal", bench_journal},
+		{"state", bench_state},
+		{"seats", bench_seats},
+		{"rules", bench_rules},
+		{"actors", bench_actors},
+		{"rounds", bench_rounds},
+		{"ratings", bench_ratings},
+		{"delta", bench_delta},
+		{"client", bench_client},
+		{"profile", bench_profile},
+	};
+
+	std::vector< std::string > names(argv + 1, argv + argc);
+	for (auto const &[name, fn] : benchmarks) {
+		if (names.empty() || std::find(names.begin(), names.end(), name) != names.end()) {
+			fn();
+		}
+	}
+	return 0;
+}
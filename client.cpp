@@ -2,30 +2,73 @@
 
 #include "Connection.hpp"
 #include "Mode.hpp"
+#include "View.hpp"
 #include "Load.hpp"
 #include "Sound.hpp"
 #include "GL.hpp"
-#include "load_save_png.hpp"
+#include "DrawLines.hpp"
+#include "Profile.hpp"
+#include "Screenshots.hpp"
 
 #include <SDL.h>
 
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
 
+//the profiler's summary of the last second, in the top left corner ('F3' shows and hides it):
+static void draw_profile(glm::uvec2 const &drawable_size) {
+	constexpr float Height = 16.0f; //of a line, in drawable pixels
+	//(y is flipped so lines go down from the top)
+	DrawLines lines(glm::mat4(
+		2.0f / drawable_size.x, 0.0f, 0.0f, 0.0f,
+		0.0f, -2.0f / drawable_size.y, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		-1.0f, 1.0f, 0.0f, 1.0f
+	));
+	glm::vec3 x(Height, 0.0f, 0.0f), y(0.0f, -Height, 0.0f);
+	float line = 1.5f;
+	auto text = [&](std::string const &s, glm::u8vec4 color) {
+		lines.draw_text(s, glm::vec3(0.5f * Height, line * Height, 0.0f), x, y, color);
+		line += 1.2f;
+	};
+	text("ms/s   calls/s   zone", glm::u8vec4(0xff, 0xff, 0x00, 0xff));
+	char buffer[128];
+	for (Profile::Total const &total : Profile::summary(1.0)) {
+		std::snprintf(buffer, sizeof(buffer), "%6.2f   %7u   %s", total.ms, total.count, total.name);
+		text(buffer, glm::u8vec4(0xff));
+	}
+}
+
 int main(int argc, char **argv) {
 #ifdef _WIN32
 	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
 	try {
 #endif
 	//------------ command line arguments ------------
-	if (argc != 4) {
-		std::cerr << "Usage:\n\t./client <host> <port> <name>" << std::endl;
+	if (!(argc == 4 || (argc == 6 && std::string(argv[4]) == "--profile"))) {
+		std::cerr << "Usage:\n\t./client <host> <port> <name> [--profile <trace.json>]" << std::endl;
 		return 1;
 	}
 
+	//--profile: record from the start, and save a Chrome trace at exit (however the client exits):
+	static std::string trace_filename;
+	if (argc == 6) {
+		trace_filename = argv[5];
+		Profile::enable(true);
+		std::atexit([](){
+			if (Profile::write_trace(trace_filename)) {
+				std::cout << "Wrote profile trace to '" << trace_filename << "'." << std::endl;
+			} else {
+				std::cerr << "Couldn't write profile trace to '" << trace_filename << "'." << std::endl;
+			}
+		});
+	}
+
 	//------------ connect to server --------------
 	Client client(argv[1], argv[2]);
 
@@ -115,46 +158,97 @@ int main(int argc, char **argv) {
 	std::string name(argv[3]);
 	Mode::set_current(std::make_shared< PlayMode >(client, name));
 
+	//------------ wake the main loop on network traffic --------------
+	//(the main loop sleeps until there is an event; this makes the server's messages one)
+	Uint32 const NetworkEvent = SDL_RegisterEvents(1);
+	SocketWatch watch([NetworkEvent](){
+		SDL_Event evt;
+		SDL_zero(evt);
+		evt.type = NetworkEvent;
+		SDL_PushEvent(&evt);
+	});
+
+	//longest the main loop sleeps without an event (nothing in the client runs on a timer, so this is just a backstop):
+	constexpr int IdleTimeout = 1000; //ms
+
+	//screenshots ('PrintScreen') and recordings ('Shift+PrintScreen'), saved in the background:
+	auto screenshots = std::make_unique< Screenshots >();
+	bool screenshot = false; //save the next frame drawn
+	bool recording = false; //save every frame, drawing one every vsync
+	uint32_t recorded = 0;
+
+	//profiler summary, redrawn a few times a second while shown:
+	bool show_profile = false;
+	constexpr auto ProfileRefresh = std::chrono::milliseconds(250);
+	auto profile_drawn = std::chrono::steady_clock::now();
+
 	//------------ main loop ------------
 
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
-		//every pass through the game loop creates one frame of output
-		//  by performing three steps:
+		//every pass through the game loop handles whatever woke it
+		//  by performing five steps (the last two only if there is something new to show):
+
+		{ //(0) sleep until there is an event, unless there is a frame to draw:
+			//(events are input, window changes, and the server's messages; see 'watch' above)
+			if (!Mode::current->redraw) {
+				Profile::Zone zone("idle");
+				int timeout = IdleTimeout;
+				if (show_profile) {
+					auto wait = profile_drawn + ProfileRefresh - std::chrono::steady_clock::now();
+					timeout = int(std::max< int64_t >(0, std::chrono::duration_cast< std::chrono::milliseconds >(wait).count()));
+				}
+				//(a screenshot the GPU is still reading back gets handed off at the next check)
+				if (screenshots->reading()) timeout = std::min(timeout, 5);
+				watch.arm(client.connection.socket, client.connection.pending_send() != 0);
+				SDL_WaitEventTimeout(nullptr, timeout); //(leaves the event for the loop below)
+			}
+		}
 
 		{ //(1) process any events that are pending
+			Profile::Zone zone("events");
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt) == 1) {
 				//handle resizing:
 				if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
 					on_resize();
 				}
+				//the window's contents may need drawing again after any change to the window:
+				if (evt.type == SDL_WINDOWEVENT && Mode::current) {
+					Mode::current->redraw = true;
+				}
 				//handle input:
 				if (Mode::current && Mode::current->handle_event(evt, window_size)) {
 					// mode handled it; great
 				} else if (evt.type == SDL_QUIT) {
 					Mode::set_current(nullptr);
 					break;
-				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_PRINTSCREEN) {
-					// --- screenshot key ---
-					std::string filename = "screenshot.png";
-					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GL_GetDrawableSize(window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_PRINTSCREEN && (evt.key.keysym.mod & KMOD_SHIFT)) {
+					// --- recording key (a numbered screenshot of every frame until pressed again) ---
+					recording = !recording;
+					if (recording) {
+						std::cout << "Recording every frame, starting with 'recording-" << recorded << ".png'." << std::endl;
+					} else {
+						std::cout << "Stopped recording (" << recorded << " frames so far)." << std::endl;
 					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+					Mode::current->redraw = true;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_PRINTSCREEN) {
+					// --- screenshot key (of the next frame, which is drawn for it) ---
+					std::cout << "Saving screenshot to 'screenshot.png'." << std::endl;
+					screenshot = true;
+					Mode::current->redraw = true;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+					// --- profiler summary key (records while shown, and always with --profile) ---
+					show_profile = !show_profile;
+					Profile::enable(show_profile || !trace_filename.empty());
+					Mode::current->redraw = true;
 				}
 			}
 			if (!Mode::current) break;
 		}
 
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
+			Profile::Zone zone("update");
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
@@ -168,17 +262,49 @@ int main(int argc, char **argv) {
 			if (!Mode::current) break;
 		}
 
+		//hand screenshots the GPU has finished reading to the encoders (frame drawn or not):
+		screenshots->poll();
+
+		//the profiler summary is due for a refresh:
+		if (show_profile && std::chrono::steady_clock::now() >= profile_drawn + ProfileRefresh) {
+			Mode::current->redraw = true;
+		}
+
+		//nothing changed? then the frame on screen is still right:
+		if (!Mode::current->redraw) continue;
+
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			Profile::Zone zone("draw");
 			Mode::current->draw(drawable_size);
+			//(text partway through an animation needs the next frame too)
+			Mode::current->redraw = view::TextSpan::take_animating();
+			if (show_profile) {
+				draw_profile(drawable_size);
+				profile_drawn = std::chrono::steady_clock::now();
+			}
 		}
 
-		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		{ //(4) save the frame (from the back buffer, before it's swapped) if asked to:
+			if (screenshot) {
+				screenshots->capture(drawable_size, "screenshot.png");
+				screenshot = false;
+			}
+			if (recording) {
+				screenshots->capture(drawable_size, "recording-" + std::to_string(recorded++) + ".png");
+				Mode::current->redraw = true;
+			}
+		}
+
+		{ //Wait until the recently-drawn frame is shown before doing it all again:
+			Profile::Zone zone("swap");
+			SDL_GL_SwapWindow(window);
+		}
 	}
 
 
 	//------------  teardown ------------
+	screenshots.reset(); //(saves any frames still in flight, so needs the GL context)
+
 	Sound::shutdown();
 
 	SDL_GL_DeleteContext(context);
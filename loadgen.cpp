@@ -0,0 +1,502 @@
+#include "Connection.hpp"
+#include "Protocol.hpp"
+#include "Bot.hpp"
+#include "Delta.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Load generator: keeps many bot-driven players connected to a server (or a router in front of servers).
+//Usage: ./loadgen <host> <port> [--clients <count>] [--seconds <duration>] [--ramp <connections/sec>] [--games <per connection>] [--blips <per sec>] [--delta] [--flood <connections>]
+//Each player joins with the packed format, plays with the same Bot the server uses, asks for a rematch
+// after every game, and reconnects as a new player after --games games (or if its table goes quiet).
+//With --blips, that many seated players a second drop their connection and resume their session on a new
+// one (see Protocol::CapResume); the summary then has resume times (resume sent -> server's answer).
+//With --delta, players ask for their updates as deltas (see Protocol::CapCompression); compare bytes received with and without.
+//With --flood, that many more connections start halfway through and each send FloodRate Start messages a second
+// (far past the server's --rate) without ever joining, so they stay in the lobby, costing the server input but no
+// table; they reconnect when the server drops them. The summary's latencies are then given for the quiet half and the flooded half.
+//Prints throughput once a second and a summary at the end; exits with 1 if no game was finished.
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadClient {
+	Connection *connection = nullptr;
+	uint32_t id = 0;
+	Clock::time_point connected; //when this connection was opened
+	Clock::time_point heard; //last time the game moved on
+	bool seated = false; //got dice at least once
+	bool playing = false; //got dice and no result yet
+	uint8_t dice[6] = {1,1,1,1,1,1};
+	uint8_t seats = 2; //at this player's table (the server says, see Protocol::CapTables)
+	bool claims_seen = false; //a claim has been made this game
+	uint8_t answered = 0xff; //claim_byte of the claim last acted upon (0xff: none)
+	uint8_t mine = 0xff; //claim_byte of our own last claim
+	uint32_t games = 0;
+	uint64_t token = 0; //session (0 if none)
+	uint64_t position = 0; //in the session's stream, after the bytes handled so far
+	bool resuming = false; //sent a resume, waiting for the answer
+	bool delta = false; //asks for CapCompression
+	Delta::Baseline baseline; //last update received as a delta
+	std::vector< char > rebuilt; //scratch for handling it
+	Clock::time_point blipped; //when the resume was sent
+	std::vector< char > out; //scratch for encoding
+};
+
+struct Totals {
+	uint64_t connects = 0;
+	uint64_t failed = 0;
+	uint64_t dropped = 0; //connections the far side closed
+	uint64_t stalled = 0; //connections given up on for going quiet
+	uint64_t games = 0;
+	uint64_t messages = 0; //received
+	uint64_t bytes = 0; //received
+	uint64_t moves = 0; //claims and reveals sent
+	std::vector< float > seat_seconds; //connect -> first dice
+	std::vector< float > session_seconds; //connect -> session token (join handled and matched; no tick to wait for)
+	uint64_t resumed = 0, refused = 0; //(--blips)
+	std::vector< float > resume_seconds; //resume sent -> session answer
+	uint64_t flood_connects = 0, flood_drops = 0, flood_bytes = 0; //(--flood)
+};
+
+struct Context {
+	LoadClient &client;
+	Totals &totals;
+	Bot const &bot;
+	char const *buffer; //start of the bytes being dispatched (for stream positions)
+	bool rebuilding = false; //handling the messages in a delta
+};
+
+static void send_join(LoadClient &lc) {
+	lc.out.clear();
+	uint16_t capabilities = Protocol::CapPacked | Protocol::CapTables | Protocol::CapResume | (lc.delta ? Protocol::CapCompression : 0);
+	Protocol::send_hello(lc.out, Protocol::Version, capabilities, "load" + std::to_string(lc.id));
+	Protocol::send_start(lc.out);
+	lc.connection->send_raw(lc.out.data(), lc.out.size());
+}
+
+static void on_session(Context &ctx, Protocol::Frame const &m) {
+	LoadClient &lc = ctx.client;
+	lc.token = m.field64(0);
+	//the position is that of the byte after this message (the handled bytes are counted after dispatch):
+	lc.position = m.field64(8) - uint64_t(m.data + m.size - ctx.buffer);
+	if (!lc.resuming) {
+		ctx.totals.session_seconds.emplace_back(std::chrono::duration< float >(Clock::now() - lc.connected).count());
+		return;
+	}
+	lc.resuming = false;
+	if (lc.token) {
+		ctx.totals.resumed += 1;
+		ctx.totals.resume_seconds.emplace_back(std::chrono::duration< float >(Clock::now() - lc.blipped).count());
+	} else {
+		//(the seat is gone: join again as a new player)
+		ctx.totals.refused += 1;
+		lc.playing = false;
+		lc.heard = Clock::now();
+		send_join(lc);
+	}
+}
+
+static void on_dice(Context &ctx, uint8_t const *dice) {
+	LoadClient &lc = ctx.client;
+	if (lc.playing) return; //(sent every tick while rolling)
+	auto now = Clock::now();
+	if (!lc.seated) {
+		lc.seated = true;
+		ctx.totals.seat_seconds.emplace_back(std::chrono::duration< float >(now - lc.connected).count());
+	}
+	std::copy(dice, dice + 6, lc.dice);
+	lc.playing = true;
+	lc.claims_seen = false;
+	lc.answered = lc.mine = 0xff;
+	lc.heard = now;
+}
+
+static void on_action(Context &ctx, bool active, uint8_t num, uint8_t point) {
+	LoadClient &lc = ctx.client;
+	if (!lc.playing) return;
+	uint8_t claim = Protocol::claim_byte(num, point);
+	if (claim != 0) lc.claims_seen = true;
+	//actions are repeated every tick, so only act on a claim we haven't answered (or made) yet:
+	if (!active || claim == lc.answered || claim == lc.mine) return;
+	lc.answered = claim;
+	lc.heard = Clock::now();
+
+	Bot::Move move = ctx.bot.decide(lc.dice, 6, 6u * (lc.seats - 1u), !lc.claims_seen, num, point);
+	lc.out.clear();
+	if (move.reveal) {
+		Protocol::send_reveal(lc.out);
+	} else {
+		Protocol::send_claim(lc.out, true, move.dice_num, move.dice_point);
+		lc.mine = Protocol::claim_byte(move.dice_num, move.dice_point);
+		lc.claims_seen = true;
+	}
+	lc.connection->send_raw(lc.out.data(), lc.out.size());
+	ctx.totals.moves += 1;
+}
+
+static void on_result(Context &ctx) {
+	LoadClient &lc = ctx.client;
+	if (!lc.playing) return; //(sent every tick until the rematch starts)
+	lc.playing = false;
+	lc.games += 1;
+	lc.heard = Clock::now();
+	ctx.totals.games += 1;
+	//ask for a rematch (if this connection is done, it's replaced before the rematch matters):
+	lc.out.clear();
+	Protocol::send_start(lc.out);
+	lc.connection->send_raw(lc.out.data(), lc.out.size());
+}
+
+static bool on_delta(Context &ctx, Protocol::Frame const &m);
+
+static constexpr Protocol::Handlers< Context, Protocol::ToClient > handlers = {
+	//Name:
+	[](Context &, Protocol::Frame const &) { return true; },
+	//Dice:
+	[](Context &ctx, Protocol::Frame const &m) {
+		on_dice(ctx, reinterpret_cast< uint8_t const * >(m.data + 1));
+		return true;
+	},
+	//Action:
+	[](Context &ctx, Protocol::Frame const &m) {
+		on_action(ctx, m.field(0) == 'a', m.field(1), m.field(2));
+		return true;
+	},
+	//Result:
+	[](Context &ctx, Protocol::Frame const &) {
+		on_result(ctx);
+		return true;
+	},
+	//Hello:
+	[](Context &, Protocol::Frame const &) { return true; },
+	//PackedName:
+	[](Context &, Protocol::Frame const &) { return true; },
+	//PackedDice:
+	[](Context &ctx, Protocol::Frame const &m) {
+		uint8_t dice[6];
+		Protocol::unpack_dice(reinterpret_cast< uint8_t const * >(m.data + 1), 6, dice);
+		on_dice(ctx, dice);
+		return true;
+	},
+	//PackedActive:
+	[](Context &ctx, Protocol::Frame const &m) {
+		on_action(ctx, true, Protocol::claim_num(m.field(0)), Protocol::claim_point(m.field(0)));
+		return true;
+	},
+	//PackedWait:
+	[](Context &ctx, Protocol::Frame const &m) {
+		on_action(ctx, false, Protocol::claim_num(m.field(0)), Protocol::claim_point(m.field(0)));
+		return true;
+	},
+	//PackedResult:
+	[](Context &ctx, Protocol::Frame const &) {
+		on_result(ctx);
+		return true;
+	},
+	//Seat:
+	[](Context &ctx, Protocol::Frame const &m) {
+		ctx.client.seats = std::max< uint8_t >(2, m.field(1));
+		return true;
+	},
+	//TableResult:
+	[](Context &ctx, Protocol::Frame const &) {
+		on_result(ctx);
+		return true;
+	},
+	//Session:
+	[](Context &ctx, Protocol::Frame const &m) {
+		on_session(ctx, m);
+		return true;
+	},
+	//Repeat:
+	on_delta,
+	//Delta:
+	on_delta,
+};
+
+//handle the update a 'u' or 'U' carries as if its messages had arrived on their own:
+static bool on_delta(Context &ctx, Protocol::Frame const &m) {
+	LoadClient &lc = ctx.client;
+	if (ctx.rebuilding || !Delta::decode(m, lc.baseline)) return false; //(an update never holds another)
+	lc.rebuilt.assign(lc.baseline.bytes.begin(), lc.baseline.bytes.end());
+	ctx.rebuilding = true;
+	bool ok = Protocol::dispatch< Protocol::ToClient >(handlers, ctx, lc.rebuilt) && lc.rebuilt.empty();
+	ctx.rebuilding = false;
+	return ok;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+	std::string host, port;
+	uint32_t clients = 100;
+	double seconds = 30.0;
+	double ramp = 200.0;
+	uint32_t games_per_connection = 5;
+	double blips = 0.0;
+	bool delta = false;
+	uint32_t flood = 0;
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--clients" && i + 1 < argc) {
+			clients = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--seconds" && i + 1 < argc) {
+			seconds = std::stod(argv[++i]);
+		} else if (arg == "--ramp" && i + 1 < argc) {
+			ramp = std::stod(argv[++i]);
+		} else if (arg == "--games" && i + 1 < argc) {
+			games_per_connection = std::max(1u, uint32_t(std::stoul(argv[++i])));
+		} else if (arg == "--blips" && i + 1 < argc) {
+			blips = std::stod(argv[++i]);
+		} else if (arg == "--delta") {
+			delta = true;
+		} else if (arg == "--flood" && i + 1 < argc) {
+			flood = uint32_t(std::stoul(argv[++i]));
+		} else if (host.empty() && arg.substr(0,2) != "--") {
+			host = arg;
+		} else if (port.empty() && arg.substr(0,2) != "--") {
+			port = arg;
+		} else {
+			usage = true;
+		}
+	}
+	if (usage || port.empty()) {
+		std::cerr << "Usage:\n\t./loadgen <host> <port> [--clients <count>] [--seconds <duration>] [--ramp <connections/sec>] [--games <per connection>] [--blips <per sec>] [--delta] [--flood <connections>]" << std::endl;
+		return 1;
+	}
+
+	//a table that hasn't moved on in this long is given up on (the server ticks once a second):
+	constexpr double StallSeconds = 30.0;
+
+	Server hub; //(listens on nothing; holds the outgoing connections)
+	Bot bot;
+	Totals totals;
+	std::unordered_map< Connection *, LoadClient > live;
+	uint32_t next_id = 0;
+
+	auto connect = [&]() -> Connection * {
+		try {
+			Connection *c = hub.connect(host, port);
+			totals.connects += 1;
+			return c;
+		} catch (std::exception const &e) {
+			std::cerr << "Connect failed: " << e.what() << std::endl;
+			totals.failed += 1;
+			return nullptr;
+		}
+	};
+
+	auto open_client = [&](Clock::time_point now) {
+		Connection *c = connect();
+		if (!c) return;
+		LoadClient &lc = live[c];
+		lc.connection = c;
+		lc.id = next_id++;
+		lc.connected = lc.heard = now;
+		lc.delta = delta;
+		send_join(lc);
+	};
+
+	//drop a player's connection and resume their session on a new one:
+	std::mt19937 blip_rng(1);
+	auto blip = [&](Clock::time_point now) {
+		std::vector< Connection * > candidates;
+		for (auto const &[c, lc] : live) {
+			if (lc.token && !lc.resuming) candidates.emplace_back(c);
+		}
+		if (candidates.empty()) return;
+		auto f = live.find(candidates[blip_rng() % candidates.size()]);
+		LoadClient lc = std::move(f->second);
+		live.erase(f);
+		lc.connection->close(); //(any partial message goes with it; the position only counts whole ones)
+		lc.connection = connect();
+		if (!lc.connection) return;
+		lc.resuming = true;
+		lc.blipped = now;
+		lc.out.clear();
+		Protocol::send_resume(lc.out, lc.token, lc.position);
+		lc.connection->send_raw(lc.out.data(), lc.out.size());
+		live.emplace(lc.connection, std::move(lc));
+	};
+
+	//flooders: connections that send nothing but Start messages, kept open (and reopened) from flood_at on:
+	// (paced, rather than as fast as the socket takes them, so that on a small machine it's the server
+	//  being measured and not the loadgen hogging the cores)
+	constexpr double FloodRate = 10000.0; //messages/sec from each flooder
+	std::unordered_set< Connection * > flooders;
+	double flood_budget = 0.0; //messages each flooder may send right now
+	std::vector< char > flood_out;
+	auto feed_flooders = [&](double elapsed) {
+		while (flooders.size() < flood) {
+			Connection *c = connect();
+			if (!c) break;
+			totals.connects -= 1; //(counted separately)
+			totals.flood_connects += 1;
+			flooders.emplace(c);
+		}
+		flood_budget = std::min(FloodRate, flood_budget + FloodRate * elapsed);
+		if (flood_budget < 1.0) return;
+		flood_out.clear();
+		for (uint32_t i = 0; i < uint32_t(flood_budget); ++i) {
+			Protocol::send_start(flood_out);
+		}
+		flood_budget -= uint32_t(flood_budget);
+		for (Connection *c : flooders) {
+			c->send_raw(flood_out.data(), flood_out.size());
+			totals.flood_bytes += flood_out.size();
+		}
+	};
+
+	auto const started = Clock::now();
+	auto const stop = started + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(seconds));
+	auto const flood_at = started + (stop - started) / 2;
+	bool flooding = false;
+	//latencies measured before the flood started (indices into the Totals vectors):
+	size_t quiet_seat = 0, quiet_session = 0, quiet_resume = 0;
+	auto next_report = started + std::chrono::seconds(1);
+	double opened_budget = 0.0; //connections the ramp allows right now
+	double blip_budget = 0.0;
+	auto last = started;
+	Totals at_report;
+
+	while (true) {
+		auto now = Clock::now();
+		if (now >= stop) break;
+
+		//retire finished and stalled players, then top back up to --clients at the --ramp rate:
+		for (auto l = live.begin(); l != live.end(); /*later*/) {
+			LoadClient &lc = l->second;
+			bool done = (!lc.playing && lc.games >= games_per_connection);
+			bool stalled = std::chrono::duration< double >(now - lc.heard).count() > StallSeconds;
+			if (done || stalled) {
+				totals.stalled += stalled && !done;
+				lc.connection->close();
+				l = live.erase(l);
+			} else {
+				++l;
+			}
+		}
+		double elapsed = std::chrono::duration< double >(now - last).count();
+		if (flooding) feed_flooders(elapsed);
+		opened_budget = std::min< double >(clients, opened_budget + ramp * elapsed);
+		blip_budget = std::min< double >(clients, blip_budget + blips * elapsed);
+		last = now;
+		while (blip_budget >= 1.0) {
+			blip(now);
+			blip_budget -= 1.0;
+		}
+		while (live.size() < clients && opened_budget >= 1.0) {
+			open_client(now);
+			opened_budget -= 1.0;
+		}
+		if (flood && !flooding && now >= flood_at) {
+			flooding = true;
+			quiet_seat = totals.seat_seconds.size();
+			quiet_session = totals.session_seconds.size();
+			quiet_resume = totals.resume_seconds.size();
+			std::cout << "Flooding from " << flood << " connection(s)." << std::endl;
+		}
+
+		hub.poll([&](Connection *c, Connection::Event evt){
+			auto flooder = flooders.find(c);
+			if (flooder != flooders.end()) {
+				if (evt == Connection::OnClose) {
+					totals.flood_drops += 1;
+					flooders.erase(flooder);
+				} else if (evt == Connection::OnRecv) {
+					c->recv_buffer.clear();
+				}
+				return;
+			}
+			auto f = live.find(c);
+			if (f == live.end()) return;
+			if (evt == Connection::OnClose) {
+				totals.dropped += 1;
+				live.erase(f);
+			} else if (evt == Connection::OnRecv) {
+				Context ctx{f->second, totals, bot, c->recv_buffer.data()};
+				size_t before = c->recv_buffer.size();
+				bool ok = Protocol::dispatch< Protocol::ToClient >(handlers, ctx, c->recv_buffer, &totals.messages);
+				f->second.position += before - c->recv_buffer.size();
+				totals.bytes += before - c->recv_buffer.size();
+				if (!ok) {
+					std::cerr << "Server sent an unknown message; dropping player " << f->second.id << "." << std::endl;
+					c->close();
+					live.erase(f);
+				}
+			}
+		}, 0.01);
+
+		if (now >= next_report) {
+			next_report += std::chrono::seconds(1);
+			std::cout << "[" << uint32_t(std::chrono::duration< double >(now - started).count() + 0.5) << "s] "
+				<< live.size() << " connected, "
+				<< (totals.games - at_report.games) << " games/s, "
+				<< (totals.messages - at_report.messages) << " msgs/s, "
+				<< (totals.moves - at_report.moves) << " moves/s" << std::endl;
+			at_report = totals;
+		}
+	}
+
+	double elapsed = std::chrono::duration< double >(Clock::now() - started).count();
+	if (!flooding) {
+		quiet_seat = totals.seat_seconds.size();
+		quiet_session = totals.session_seconds.size();
+		quiet_resume = totals.resume_seconds.size();
+	}
+	//print percentiles of the samples in [begin, end) of 'all':
+	auto latency = [](char const *what, std::vector< float > const &all, size_t begin, size_t end) {
+		std::vector< float > seconds(all.begin() + begin, all.begin() + end);
+		std::sort(seconds.begin(), seconds.end());
+		auto percentile = [&](float p) -> double {
+			if (seconds.empty()) return 0.0;
+			return seconds[std::min< size_t >(seconds.size() - 1, size_t(p * seconds.size()))] * 1000.0;
+		};
+		std::cout << what << ": p50 " << percentile(0.50f) << " ms, p90 " << percentile(0.90f) << " ms, p99 " << percentile(0.99f) << " ms ("
+			<< seconds.size() << ")." << std::endl;
+	};
+	std::cout << "\n" << totals.games << " games in " << elapsed << " s (" << totals.games / elapsed << " games/sec), "
+		<< totals.messages << " messages (" << totals.bytes << " bytes) received, " << totals.moves << " moves sent.\n"
+		<< totals.connects << " connects (" << totals.failed << " failed, " << totals.dropped << " dropped by the server, "
+		<< totals.stalled << " stalled).\n";
+	if (blips > 0.0) {
+		std::cout << totals.resumed << " sessions resumed, " << totals.refused << " refused.\n";
+	}
+	if (flood) {
+		std::cout << totals.flood_connects << " flooder connects (" << totals.flood_drops << " dropped by the server), "
+			<< totals.flood_bytes << " bytes flooded.\n"
+			<< "Before the flood:\n";
+	}
+	//(the latencies before the flood, or all of them without one, then those during it)
+	latency("connect to seat", totals.session_seconds, 0, quiet_session);
+	latency("connect to first dice", totals.seat_seconds, 0, quiet_seat);
+	if (blips > 0.0) latency("resume to answer", totals.resume_seconds, 0, quiet_resume);
+	if (flood) {
+		std::cout << "During the flood:\n";
+		latency("connect to seat", totals.session_seconds, quiet_session, totals.session_seconds.size());
+		latency("connect to first dice", totals.seat_seconds, quiet_seat, totals.seat_seconds.size());
+		if (blips > 0.0) latency("resume to answer", totals.resume_seconds, quiet_resume, totals.resume_seconds.size());
+	}
+
+	return (totals.games > 0 ? 0 : 1);
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
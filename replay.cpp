@@ -0,0 +1,151 @@
+#include "Game.hpp"
+#include "SessionLog.hpp"
+
+#include "hex_dump.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+//Replays a session recorded with './server <port> --record <session.log>' through Game,
+// as fast as possible, and checks that every outbound update matches the recording byte-for-byte.
+//Exits with a non-zero status on any mismatch, so it can be used as a regression gate.
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+	if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "--repeat")) {
+		std::cerr << "Usage:\n\t./replay <session.log> [--repeat <count>]" << std::endl;
+		return 1;
+	}
+	uint32_t repeat = (argc == 4 ? uint32_t(std::stoul(argv[3])) : 1);
+
+	SessionLog log = SessionLog::load(argv[1]);
+
+	std::cout << "Replaying " << log.events.size() << " events (seed " << log.seed << ") "
+		<< repeat << " time(s)." << std::endl;
+
+	uint64_t messages = 0;
+	uint64_t bytes_out = 0;
+	uint32_t mismatches = 0;
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t iter = 0; iter < repeat; ++iter) {
+		std::unordered_map< uint32_t, std::unique_ptr< Game > > tables;
+		uint64_t dropped_messages = 0; //handled by tables that have since closed
+
+		struct Replayed {
+			Game *table = nullptr;
+			Game::Player *player = nullptr;
+			std::vector< char > recv_buffer;
+		};
+		std::unordered_map< uint32_t, Replayed > connections;
+		std::vector< char > send_buffer;
+
+		auto data_u32 = [](SessionLog::Event const &event) {
+			if (event.data.size() != 4) throw std::runtime_error("Expected a 32-bit value in session log event.");
+			uint32_t value;
+			std::memcpy(&value, event.data.data(), 4);
+			return value;
+		};
+		auto table = [&](uint32_t id) -> Game & {
+			auto f = tables.find(id);
+			if (f == tables.end()) throw std::runtime_error("Event for unknown table in session log.");
+			return *f->second;
+		};
+		auto connection = [&](SessionLog::Event const &event) -> Replayed & {
+			auto f = connections.find(event.connection);
+			if (f == connections.end()) throw std::runtime_error("Event for unknown connection in session log.");
+			return f->second;
+		};
+
+		for (size_t i = 0; i < log.events.size(); ++i) {
+			SessionLog::Event const &event = log.events[i];
+			if (event.type == SessionLog::Table) {
+				if (event.data.size() != 8) throw std::runtime_error("Expected a seed and seat count in table event.");
+				uint32_t seed_seats[2];
+				std::memcpy(seed_seats, event.data.data(), 8);
+				if (seed_seats[1] < Game::DefaultSeats || seed_seats[1] > Game::MaxSeats) throw std::runtime_error("Unsupported table size in session log.");
+				tables[event.connection] = std::make_unique< Game >(seed_seats[0], seed_seats[1]);
+			} else if (event.type == SessionLog::Open) {
+				Replayed &r = connections[event.connection];
+				r.table = &table(data_u32(event));
+				r.player = r.table->add_player();
+			} else if (event.type == SessionLog::Attach) {
+				//(a resumed session: the seat carries on under the new connection's id)
+				auto f = connections.find(data_u32(event));
+				if (f == connections.end()) throw std::runtime_error("Attach to unknown connection in session log.");
+				Replayed r = std::move(f->second);
+				connections.erase(f);
+				connections[event.connection] = std::move(r);
+			} else if (event.type == SessionLog::Bot) {
+				table(event.connection).add_bot();
+			} else if (event.type == SessionLog::Close) {
+				Replayed &r = connection(event);
+				r.table->remove_player(r.player);
+				connections.erase(event.connection);
+			} else if (event.type == SessionLog::Recv) {
+				Replayed &r = connection(event);
+				r.recv_buffer.insert(r.recv_buffer.end(), event.data.begin(), event.data.end());
+				//(the server logs the bytes each batch consumed, so this handles exactly that batch;
+				// on a protocol error the server logged a Close right after this event)
+				r.table->handle_messages(*r.player, r.recv_buffer);
+			} else if (event.type == SessionLog::Send) {
+				Replayed &r = connection(event);
+				send_buffer.clear();
+				r.table->send_update(*r.player, send_buffer);
+				bytes_out += send_buffer.size();
+				if (send_buffer != event.data) {
+					mismatches += 1;
+					if (mismatches <= 5) {
+						std::cerr << "Mismatch at event " << i << " (connection " << event.connection << ").\n"
+							<< "Recorded:\n" << hex_dump(event.data)
+							<< "Replayed:\n" << hex_dump(send_buffer);
+					}
+				}
+			} else if (event.type == SessionLog::Drop) {
+				dropped_messages += table(event.connection).messages_handled;
+				tables.erase(event.connection);
+			} else if (event.type == SessionLog::Tick) {
+				for (auto &[id, game] : tables) {
+					game->end_tick();
+				}
+			} else {
+				throw std::runtime_error("Unknown event type in session log.");
+			}
+		}
+		messages += dropped_messages;
+		for (auto const &[id, game] : tables) {
+			messages += game->messages_handled;
+		}
+	}
+
+	auto after = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration< double >(after - before).count();
+
+	std::cout << messages << " messages in " << seconds * 1000.0 << " ms: "
+		<< uint64_t(messages / seconds) << " messages/sec, "
+		<< bytes_out << " bytes out." << std::endl;
+
+	if (mismatches) {
+		std::cout << "FAILED: " << mismatches << " outbound update(s) differ from the recording." << std::endl;
+		return 1;
+	}
+	std::cout << "OK: outbound streams match." << std::endl;
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+#Local multi-process test of the router: starts a few servers and a router in front of them,
+# drives the router with the load generator, then checks that every backend took a share of the tables.
+#Usage: ./router-test.sh [backends] [clients] [seconds]
+#(run from the directory holding the built 'dist' folder)
+
+set -e
+
+BACKENDS=${1:-3}
+CLIENTS=${2:-60}
+SECONDS_=${3:-20}
+BASE=${BASE_PORT:-15100}
+DIST=${DIST:-dist}
+LOGS=$(mktemp -d)
+
+PIDS=""
+cleanup() {
+	for pid in $PIDS; do kill $pid 2>/dev/null || true; done
+}
+trap cleanup EXIT INT TERM
+
+PORTS=""
+for i in $(seq 1 $BACKENDS); do
+	port=$((BASE + i))
+	"$DIST/server" $port --bot-after 3 > "$LOGS/server-$port.log" 2>&1 &
+	PIDS="$PIDS $!"
+	PORTS="$PORTS $port"
+done
+sleep 0.5
+
+"$DIST/router" $BASE $PORTS --admin $((BASE + 99)) > "$LOGS/router.log" 2>&1 &
+PIDS="$PIDS $!"
+sleep 0.5
+
+echo "Driving $CLIENTS players through the router on port $BASE to backends:$PORTS for $SECONDS_ s (logs in $LOGS)."
+"$DIST/loadgen" localhost $BASE --clients $CLIENTS --seconds $SECONDS_ > "$LOGS/loadgen.log" 2>&1 || { tail -n 4 "$LOGS/loadgen.log"; echo "FAIL: no games finished"; exit 1; }
+tail -n 4 "$LOGS/loadgen.log"
+
+REPORT=$(printf 'stats\n' | nc -q1 localhost $((BASE + 99)))
+echo "$REPORT"
+
+#every backend should have been sent at least one table's worth of players:
+STARVED=$(echo "$REPORT" | awk '$1 == "backend" && $8 == 0 { print $2 }')
+if [ -n "$STARVED" ]; then
+	echo "FAIL: no tables were routed to backend(s): $STARVED"
+	exit 1
+fi
+echo "PASS"
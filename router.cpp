@@ -0,0 +1,304 @@
+#include "Connection.hpp"
+#include "Game.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Front router: accepts player connections and shards tables across several server processes.
+//Usage: ./router <port> <backend port>... [--host <backend host>] [--admin <port>] [--seats <2-8>]
+//Players arrive in groups of --seats (one table's worth; match the servers' --seats); each group is sent to the backend
+// with the fewest connections, so consecutive arrivals meet on the same backend's matchmaker.
+//The router never parses the protocol: each player gets its own backend connection, and bytes
+// are handed across by swapping buffers rather than copying them whenever the far side is idle.
+//Load is reported per backend on the admin port ('stats' or 'json', one per line).
+//Backend connects don't wait (the player's first bytes queue until the connect is done), so a slow or
+// far-away backend doesn't hold up everyone else; one that fails sends its player on to the next backend.
+// (--host is looked up on every connect, so give a numeric address unless the lookup is local.)
+
+struct Backend {
+	std::string port;
+	uint32_t connections = 0; //players currently routed here
+	uint64_t groups = 0; //tables' worth of players sent here
+	uint64_t bytes_up = 0; //player -> backend
+	uint64_t bytes_down = 0; //backend -> player
+	uint64_t failures = 0; //connects that failed
+	std::chrono::steady_clock::time_point retry_at; //a backend that refused a connection is skipped until then
+};
+
+//one side of a player <-> backend pair:
+struct Route {
+	Connection *peer;
+	uint32_t backend;
+	bool player; //true for the player's side
+};
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	std::string port;
+	std::string host = "localhost";
+	std::string admin_port;
+	std::vector< Backend > backends;
+	uint32_t seats = Game::DefaultSeats;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--host" && i + 1 < argc) {
+			host = argv[++i];
+		} else if (arg == "--admin" && i + 1 < argc) {
+			admin_port = argv[++i];
+		} else if (arg == "--seats" && i + 1 < argc) {
+			seats = std::max(1u, uint32_t(std::stoul(argv[++i])));
+		} else if (arg.substr(0,2) != "--") {
+			if (port.empty()) port = arg;
+			else backends.emplace_back().port = arg;
+		} else {
+			port = "";
+			break;
+		}
+	}
+	if (port.empty() || backends.empty()) {
+		std::cerr << "Usage:\n\t./router <port> <backend port>... [--host <backend host>] [--admin <port>] [--seats <2-8>]" << std::endl;
+		return 1;
+	}
+
+	//------------ initialization ------------
+
+	Server server(port);
+
+	constexpr uint32_t NoListener = ~0u - 1; //(~0u is Server::Outgoing)
+	uint32_t admin_listener = NoListener;
+	if (!admin_port.empty()) {
+		admin_listener = server.listen(admin_port);
+		std::cout << "Admin endpoint on port " << admin_port << "." << std::endl;
+	}
+
+	std::cout << "Routing port " << port << " to " << backends.size() << " backend(s) on " << host << "." << std::endl;
+
+	constexpr double RetrySeconds = 5.0; //wait this long before trying a refusing backend again
+	constexpr size_t MaxQueued = 1 << 20; //drop a pair whose far side isn't keeping up
+
+	std::unordered_map< Connection *, Route > routes; //both sides of every pair
+	std::unordered_set< Connection * > draining; //closed pairs' surviving side, open until its sends finish
+	uint32_t group_backend = 0; //backend taking the current group
+	uint32_t group_left = 0; //arrivals still to send to group_backend
+	uint64_t routed = 0; //players routed so far
+	auto const started = std::chrono::steady_clock::now();
+
+	//a backend that refused a connection is skipped for a while (and its group, if any, ends):
+	auto refused = [&](uint32_t b) {
+		Backend &backend = backends[b];
+		backend.failures += 1;
+		backend.retry_at = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(RetrySeconds));
+		if (group_backend == b) group_left = 0;
+	};
+
+	//connect a new player to a backend, starting a new group if needed (returns the backend's side, or nullptr):
+	auto open_route = [&](Connection *c) -> Connection * {
+		auto now = std::chrono::steady_clock::now();
+		//least loaded first (ties to the lower index, so a quiet fleet fills backends in order):
+		std::vector< uint32_t > order;
+		for (uint32_t b = 0; b < backends.size(); ++b) {
+			if (backends[b].retry_at <= now) order.emplace_back(b);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return backends[a].connections < backends[b].connections;
+		});
+		//...but finish the current group first:
+		auto current = std::find(order.begin(), order.end(), group_backend);
+		if (group_left > 0 && current != order.end()) {
+			std::rotate(order.begin(), current, current + 1);
+		} else {
+			group_left = 0;
+		}
+		for (uint32_t b : order) {
+			Backend &backend = backends[b];
+			Connection *far = nullptr;
+			try {
+				far = server.connect(host, backend.port, false);
+			} catch (std::exception const &e) {
+				std::cerr << "Backend " << backend.port << " refused: " << e.what() << std::endl;
+				refused(b);
+				continue;
+			}
+			if (group_left == 0) {
+				group_backend = b;
+				group_left = seats;
+				backend.groups += 1;
+			}
+			group_left -= 1;
+			backend.connections += 1;
+			routes.emplace(c, Route{far, b, true});
+			routes.emplace(far, Route{c, b, false});
+			routed += 1;
+			return far;
+		}
+		return nullptr;
+	};
+
+	//a backend connect failed after open_route returned: route the player again, with what it has sent so far:
+	auto reroute = [&](Connection *far) {
+		auto f = routes.find(far);
+		if (f == routes.end()) return;
+		Connection *player = f->second.peer;
+		Backend &backend = backends[f->second.backend];
+		std::cerr << "Backend " << backend.port << " refused." << std::endl;
+		refused(f->second.backend);
+		backend.connections -= 1;
+		std::vector< char > unsent = std::move(far->send_buffer);
+		routes.erase(f);
+		routes.erase(player);
+		routed -= 1; //(counted again below)
+		Connection *next = open_route(player);
+		if (!next) {
+			std::cerr << "No backend available; turning a player away." << std::endl;
+			player->close();
+			return;
+		}
+		next->send_buffer = std::move(unsent);
+	};
+
+	//one side went away: forget the pair, letting the other side finish sending what it has:
+	auto close_route = [&](Connection *c) {
+		auto f = routes.find(c);
+		if (f == routes.end()) return;
+		Connection *peer = f->second.peer;
+		backends[f->second.backend].connections -= 1;
+		routes.erase(f);
+		routes.erase(peer);
+		c->close();
+		if (peer->pending_send() == 0) peer->close();
+		else draining.emplace(peer);
+	};
+
+	//hand 'from's received bytes to its peer:
+	auto splice = [&](Connection *from, Route const &route) {
+		Connection *to = route.peer;
+		size_t bytes = from->recv_buffer.size();
+		if (to->send_buffer.empty()) {
+			//common case: swap the buffers (and reuse the old send_buffer's storage for the next recv):
+			std::swap(to->send_buffer, from->recv_buffer);
+		} else {
+			to->send_buffer.insert(to->send_buffer.end(), from->recv_buffer.begin(), from->recv_buffer.end());
+		}
+		from->recv_buffer.clear();
+
+		Backend &backend = backends[route.backend];
+		(route.player ? backend.bytes_up : backend.bytes_down) += bytes;
+		if (to->pending_send() > MaxQueued) {
+			std::cerr << "Dropping a connection that isn't keeping up." << std::endl;
+			close_route(from);
+		}
+	};
+
+	auto report = [&](bool json) {
+		std::ostringstream out;
+		double uptime = std::chrono::duration< double >(std::chrono::steady_clock::now() - started).count();
+		auto now = std::chrono::steady_clock::now();
+		if (json) {
+			out << "{\"uptime_seconds\":" << uptime << ",\"routes\":" << routes.size() / 2 << ",\"routed\":" << routed << ",\"draining\":" << draining.size() << ",\"backends\":[";
+		} else {
+			out << "uptime_seconds " << uptime << "\nroutes " << routes.size() / 2 << "\nrouted " << routed << "\ndraining " << draining.size() << '\n';
+		}
+		for (uint32_t b = 0; b < backends.size(); ++b) {
+			Backend const &backend = backends[b];
+			uint64_t queued = 0;
+			for (auto const &[c, route] : routes) {
+				if (route.backend == b) queued += c->pending_send();
+			}
+			bool up = (backend.retry_at <= now);
+			if (json) {
+				out << (b ? "," : "") << "{\"port\":\"" << backend.port << "\",\"up\":" << up
+					<< ",\"connections\":" << backend.connections << ",\"groups\":" << backend.groups
+					<< ",\"bytes_up\":" << backend.bytes_up << ",\"bytes_down\":" << backend.bytes_down
+					<< ",\"queued_send_bytes\":" << queued << ",\"failures\":" << backend.failures << "}";
+			} else {
+				out << "backend " << backend.port << " up " << up
+					<< " connections " << backend.connections << " groups " << backend.groups
+					<< " bytes_up " << backend.bytes_up << " bytes_down " << backend.bytes_down
+					<< " queued_send_bytes " << queued << " failures " << backend.failures << '\n';
+			}
+		}
+		out << (json ? "]}\n" : "\n");
+		return out.str();
+	};
+
+	//answer each complete command line from an admin connection:
+	auto handle_admin = [&](Connection *c) {
+		auto &buffer = c->recv_buffer;
+		while (true) {
+			auto end = std::find(buffer.begin(), buffer.end(), '\n');
+			if (end == buffer.end()) break;
+			std::string command(buffer.begin(), end);
+			buffer.erase(buffer.begin(), end + 1);
+			if (!command.empty() && command.back() == '\r') command.pop_back();
+
+			std::string reply;
+			if (command == "stats" || command == "json") {
+				reply = report(command == "json");
+			} else {
+				reply = "unknown command '" + command + "' (try 'stats' or 'json')\n";
+			}
+			c->send_buffer.insert(c->send_buffer.end(), reply.begin(), reply.end());
+		}
+		if (buffer.size() > 256) c->close(); //not a command line
+	};
+
+	//------------ main loop ------------
+
+	while (true) {
+		server.poll([&](Connection *c, Connection::Event evt){
+			if (c->listener == admin_listener) {
+				if (evt == Connection::OnRecv) handle_admin(c);
+				return;
+			}
+			if (evt == Connection::OnOpen) {
+				if (!open_route(c)) {
+					std::cerr << "No backend available; turning a player away." << std::endl;
+					c->close();
+				}
+			} else if (evt == Connection::OnClose) {
+				draining.erase(c);
+				if (c->connecting) reroute(c);
+				else close_route(c);
+			} else { assert(evt == Connection::OnRecv);
+				auto f = routes.find(c);
+				if (f != routes.end()) splice(c, f->second);
+				else c->recv_buffer.clear(); //(draining; nobody left to hear it)
+			}
+		}, 1.0);
+
+		//close the leftovers of closed pairs once everything has been sent:
+		for (auto d = draining.begin(); d != draining.end(); /*later*/) {
+			if ((*d)->socket == InvalidSocket || (*d)->pending_send() == 0) {
+				(*d)->close();
+				d = draining.erase(d);
+			} else {
+				++d;
+			}
+		}
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -1,33 +1,23 @@
-
 #include "Connection.hpp"
+#include "Game.hpp"
+#include "ServerState.hpp"
+#include "SessionLog.hpp"
+#include "Journal.hpp"
+#include "Handoff.hpp"
+#include "Metrics.hpp"
+#include "ThreadPool.hpp"
+#include "Ratings.hpp"
 
 #include "hex_dump.hpp"
 
 #include <chrono>
+#include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
-#include <unordered_map>
-#include <time.h>
-
-void game_start(std::vector<uint8_t>& dices){
-	std::srand(time(NULL));
-	for(unsigned int i = 0; i< dices.size();i++){
-		dices[i] = 1+(std::rand()%6);
-	}
-}
-
-bool check_result(std::vector<uint8_t>& dices, uint8_t dice_num, uint8_t dice_point){
-	for(auto d: dices){
-		if (d == dice_point){
-			dice_num -= 1;
-			if (dice_num == 0){
-				return true;
-			}
-		}
-	}
-	return false;
-}
+#include <memory>
+#include <random>
+#include <algorithm>
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -37,45 +27,202 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	std::string port;
+	uint32_t seed = std::random_device()();
+	std::string record_filename;
+	std::string journal_path;
+	std::string handoff_path;
+	std::string admin_port;
+	std::string ratings_path;
+	double bot_after = 10.0;
+	float rate = 50.0f;
+	uint32_t seats = Game::DefaultSeats;
+	uint32_t workers = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--seed" && i + 1 < argc) {
+			seed = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--bots") {
+			bot_after = 0.0;
+		} else if (arg == "--bot-after" && i + 1 < argc) {
+			bot_after = std::stod(argv[++i]);
+		} else if (arg == "--record" && i + 1 < argc) {
+			record_filename = argv[++i];
+		} else if (arg == "--journal" && i + 1 < argc) {
+			journal_path = argv[++i];
+		} else if (arg == "--handoff" && i + 1 < argc) {
+			handoff_path = argv[++i];
+		} else if (arg == "--ratings" && i + 1 < argc) {
+			ratings_path = argv[++i];
+		} else if (arg == "--admin" && i + 1 < argc) {
+			admin_port = argv[++i];
+		} else if (arg == "--rate" && i + 1 < argc) {
+			rate = std::stof(argv[++i]);
+		} else if (arg == "--seats" && i + 1 < argc) {
+			seats = uint32_t(std::stoul(argv[++i]));
+			if (seats < Game::DefaultSeats || seats > Game::MaxSeats) {
+				port = "";
+				break;
+			}
+		} else if (arg == "--workers" && i + 1 < argc) {
+			workers = uint32_t(std::stoul(argv[++i]));
+		} else if (port.empty() && arg.substr(0,2) != "--") {
+			port = arg;
+		} else {
+			port = "";
+			break;
+		}
+	}
+	if (port.empty()) {
+		std::cerr << "Usage:\n\t./server <port> [--seed <seed>] [--bots | --bot-after <seconds>] [--record <session.log>] [--journal <path>] [--handoff <path>] [--ratings <path>] [--admin <port>] [--rate <messages/sec>] [--seats <2-8>] [--workers <threads>]" << std::endl;
 		return 1;
 	}
 
 	//------------ initialization ------------
 
-	Server server(argv[1]);
+	//with --handoff, a server already running at that path hands over its sockets and tables (see Handoff.hpp):
+	auto handoff_started = std::chrono::steady_clock::now();
+	Socket predecessor = InvalidSocket;
+	if (!handoff_path.empty()) predecessor = Handoff::connect(handoff_path);
+	bool taking_over = (predecessor != InvalidSocket);
+
+	Server server;
+	uint32_t admin_listener = ServerState::NoListener;
+	uint32_t handoff_listener = ServerState::NoListener;
+	if (taking_over) {
+		//(the ports are the running server's; they arrive with its connections, just before the main loop)
+		std::cout << "Taking over from the server at '" << handoff_path << "'." << std::endl;
+	} else {
+		server.listen(port);
 
+		//optionally answer load queries (see Metrics.hpp) on a second port, served by the same poll loop:
+		if (!admin_port.empty()) {
+			admin_listener = server.listen(admin_port);
+			std::cout << "Admin endpoint on port " << admin_port << "." << std::endl;
+		}
+
+		//optionally wait for a newer server to take over:
+		if (!handoff_path.empty()) {
+			handoff_listener = server.adopt_listener(Handoff::listen(handoff_path));
+			std::cout << "Handoff socket at '" << handoff_path << "'." << std::endl;
+		}
+	}
+	Metrics metrics;
+
+	//optionally run table logic on worker threads, each table an actor with its own mailbox (see Mailbox.hpp):
+	// (without --workers, tables handle their input on the poll thread as it is served)
+	std::unique_ptr< ThreadPool > pool;
+	if (workers) {
+		pool = std::make_unique< ThreadPool >(workers);
+		std::cout << "Running tables on " << pool->size() << " worker thread(s)." << std::endl;
+	}
+
+	std::cout << "Server seed is " << seed << "." << std::endl;
+
+	//optionally journal every state change so tables survive a restart (see Journal.hpp):
+	std::unique_ptr< Journal > journal;
+	if (!journal_path.empty()) {
+		journal = std::make_unique< Journal >(journal_path);
+		std::cout << "Journaling to '" << journal_path << "'." << std::endl;
+	}
+	//(tables handed over by a running server are newer than anything it journaled)
+	bool recovering = journal && !journal->recovered_snapshot.empty() && !taking_over;
+
+	//optionally record the session so it can be replayed with ./replay:
+	std::unique_ptr< SessionRecorder > recorder;
+	if (!record_filename.empty() && (recovering || taking_over)) {
+		std::cout << "Not recording: a session that starts from existing tables can't be replayed." << std::endl;
+	} else if (!record_filename.empty()) {
+		recorder = std::make_unique< SessionRecorder >(record_filename, seed);
+		std::cout << "Recording session to '" << record_filename << "'." << std::endl;
+	}
 
 	//------------ main loop ------------
 	constexpr float ServerTick = 1.0f; //TODO: set a server tick that makes sense for your game
 
-	//server state:
-	std::vector<uint8_t> dices(12,1);
-	
-	//per-client state:
-	struct PlayerInfo {
-		PlayerInfo() {
-			static uint8_t next_player_id = 0;
-			player_id = next_player_id;
-			next_player_id += 1;
+	//tables, players, sessions (see ServerState.hpp):
+	ServerState::Options options;
+	options.seed = seed;
+	options.seats = seats;
+	options.bot_after = bot_after;
+	options.rate = rate;
+	ServerState state(server, options, pool.get(), recorder.get(), journal.get());
+	state.admin_listener = admin_listener;
+	state.handoff_listener = handoff_listener;
+
+	//answer each complete command line from an admin connection:
+	auto handle_admin = [&](Connection *c) {
+		auto &buffer = c->recv_buffer;
+		while (true) {
+			auto end = std::find(buffer.begin(), buffer.end(), '\n');
+			if (end == buffer.end()) break;
+			std::string command(buffer.begin(), end);
+			buffer.erase(buffer.begin(), end + 1);
+			if (!command.empty() && command.back() == '\r') command.pop_back();
+
+			if (command == "stats" || command == "json") {
+				state.settle(); //(the figures read the tables)
+				std::string report = metrics.report(state.load(), command == "json");
+				c->send_buffer.insert(c->send_buffer.end(), report.begin(), report.end());
+			} else if (command == "top" || command.compare(0, 4, "top ") == 0 || command.compare(0, 5, "rank ") == 0) {
+				//leaderboard lines, "<rank> <rating> <games> <name>" (rank 1 is the best):
+				std::vector< Ratings::Entry > entries;
+				std::string reply;
+				if (command[0] == 't') {
+					unsigned long count = (command.size() > 4 ? std::strtoul(command.c_str() + 4, nullptr, 10) : 10);
+					state.ratings->top(0, uint32_t(std::min(count, 1000ul)), &entries);
+				} else {
+					entries.emplace_back();
+					if (!state.ratings->find(command.substr(5), &entries.back())) {
+						entries.clear();
+						reply = "unrated " + command.substr(5) + "\n";
+					}
+				}
+				for (Ratings::Entry const &entry : entries) {
+					reply += std::to_string(entry.rank + 1) + " " + std::to_string(entry.rating) + " " + std::to_string(entry.games) + " " + entry.name + "\n";
+				}
+				c->send_buffer.insert(c->send_buffer.end(), reply.begin(), reply.end());
+			} else {
+				std::string reply = "unknown command '" + command + "' (try 'stats', 'json', 'top [count]' or 'rank <name>')\n";
+				c->send_buffer.insert(c->send_buffer.end(), reply.begin(), reply.end());
+			}
 		}
-		std::string name;
-		uint8_t player_id;
+		if (buffer.size() > 256) c->close(); //not a command line
+	};
 
+	//a newer server asked to take over: give it every socket and the tables, then exit (returns false if it went away):
+	auto hand_off = [&](Connection *to) {
+		auto started = std::chrono::steady_clock::now();
+		std::vector< Socket > sockets;
+		std::vector< char > handed = state.hand_off(&sockets);
+		if (!Handoff::send(to->socket, handed, sockets)) return false;
+		std::cout << "Handed off " << state.tables.size() << " table(s) and " << sockets.size() - server.listen_sockets.size() << " connection(s) in "
+			<< std::chrono::duration< double >(std::chrono::steady_clock::now() - started).count() * 1000.0 << " ms." << std::endl;
+		return true;
 	};
 
-	uint32_t cur_player = 0;
-	uint8_t dice_num = 1;
-	uint8_t dice_point = 1;
-	std::unordered_map< Connection *, PlayerInfo > players;
-	bool waiting = false;
-	u_int8_t winner = 0;
-	u_int8_t state = 0; // inital state of waiting room
-	//0: waiting romm
-	//1: rolling dices
-	//2: playing
-	std::vector<std::string> player_name;
+	//take over the sockets and tables of the server at --handoff:
+	if (taking_over) {
+		std::vector< char > handed;
+		std::vector< Socket > sockets;
+		Handoff::receive(predecessor, &handed, &sockets);
+		uint32_t count = state.take_over(handed, sockets);
+		admin_listener = state.admin_listener;
+		handoff_listener = state.handoff_listener;
+		std::cout << "Took over " << state.tables.size() << " table(s) and " << count << " connection(s) in "
+			<< std::chrono::duration< double >(std::chrono::steady_clock::now() - handoff_started).count() * 1000.0 << " ms." << std::endl;
+	}
+
+	if (journal) {
+		if (recovering) state.recover();
+		state.close_empty_tables();
+		//start the journal over from the current state:
+		journal->snapshot(state.save_state());
+	}
+
+	//player ratings (see Ratings.hpp), which matchmaking uses as skill:
+	// (recovered games were rated before the crash, so tables only start rating from here)
+	state.open_ratings(ratings_path);
 
 	while (true) {
 		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
@@ -87,131 +234,57 @@ int main(int argc, char **argv) {
 				next_tick += std::chrono::duration< double >(ServerTick);
 				break;
 			}
+			remain = state.poll_timeout(remain, now);
+			Connection *successor = nullptr;
 			server.poll([&](Connection *c, Connection::Event evt){
+				if (c->listener == admin_listener) {
+					if (evt == Connection::OnRecv) handle_admin(c);
+					return;
+				}
+				if (c->listener == handoff_listener) {
+					if (evt != Connection::OnRecv) return;
+					std::string const request = Handoff::Request;
+					if (c->recv_buffer.size() >= request.size() && std::equal(request.begin(), request.end(), c->recv_buffer.begin())) {
+						successor = c;
+					} else if (c->recv_buffer.size() >= request.size()) {
+						c->close(); //(not a handoff request)
+					}
+					return;
+				}
 				if (evt == Connection::OnOpen) {
-					//client connected:
-
-					//create some player info for them:
-					players.emplace(c, PlayerInfo());
-
+					//client connected; they wait in the lobby until they join:
+					state.connected(c);
 
 				} else if (evt == Connection::OnClose) {
-					//client disconnected:
-
-					//remove them from the players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					players.erase(f);
-
+					//client disconnected (a player with a session may come back):
+					state.forget(c, true);
 
 				} else { assert(evt == Connection::OnRecv);
 					//got data from client:
-					std::cout << "got bytes:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-
-					//look up in players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					PlayerInfo &player = f->second;
-
-					//handle messages from client:
-					//TODO: update for the sorts of messages your clients send
-					while (c->recv_buffer.size() >= 1) {
-						//expecting five-byte messages 'b' (left count) (right count) (down count) (up count)
-						char type = c->recv_buffer[0];
-						if (type == 'j'){
-							//player first join game
-							int32_t size = (
-								(uint32_t(c->recv_buffer[1]) << 16) | (uint32_t(c->recv_buffer[2]) << 8) | (uint32_t(c->recv_buffer[3]))
-							);
-							if (c->recv_buffer.size() < 4 + size) break;
-							player.name = std::string(c->recv_buffer.begin() + 4, c->recv_buffer.begin() + 4 + size);
-							player_name.push_back(player.name);
-							c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4 + size);
-						}
-						else if (type == 's'){
-							state = 1;
-							game_start(dices);
-							c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin()+1);
-							std::cout<<" Game Start " <<std::endl;
-						}
-						else if (type == 'c'){
-							dice_num = c->recv_buffer[1];
-							dice_point = c->recv_buffer[2];
-							cur_player = (cur_player + 1) % 2;
-							c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin()+3);
-						}
-						else if (type == 'r'){
-							bool res = check_result(dices, dice_num, dice_point);
-							if (res) {
-								winner = (player.player_id+1)%2;
-							}else{
-								winner = player.player_id;
-							}
-							state = 3;
-							c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin()+1);
-						}
-						else{
-							std::cout << " message of unknown type received from client!" << std::endl;
-							//shut down client connection:
-							c->close();
-							return;
-						}
-						
-
-
-					}
+					// (only the start of it: a flooding client's unhandled input can be up to MaxBacklog long,
+					//  and formatting all of it on every read would cost everyone else more than the flood does)
+					constexpr size_t DumpBytes = 64;
+					std::cout << "got bytes:\n" << hex_dump(c->recv_buffer.data(), std::min(c->recv_buffer.size(), DumpBytes));
+					if (c->recv_buffer.size() > DumpBytes) std::cout << "(and " << c->recv_buffer.size() - DumpBytes << " more)\n";
+					std::cout.flush();
+					state.received(c);
 				}
 			}, remain);
-		}
 
-		//send updated game state to all clients
-		//TODO: update for your game state
-		int cur = 0;
-		for (auto &[c, player] : players) {
-			// (void)player; //work around "unused variable" warning on whatever g++ github actions uses
-			//send an update starting with 'm', a 24-bit size, and a blob of text:
-			if (state == 0) {
-				for (std::string name : player_name){
-					if (name != player.name){
-						c->send('n');
-						c->send(player.player_id);
-						c->send(uint8_t(name.size() >> 16));
-						c->send(uint8_t((name.size() >> 8) % 256));
-						c->send(uint8_t(name.size() % 256));
-						c->send_buffer.insert(c->send_buffer.end(), name.begin(), name.end());
-					}
-				}
-			}else if (state == 1){
-				//send inital dice states
-				c->send('d');
-				c->send_buffer.insert(c->send_buffer.end(), dices.begin()+cur, dices.begin()+cur+6);
-				cur += 6;
-			}
-			else if (state == 3){
-				//send reveal states
-				std::cout<<"send reveal state"<<std::endl;
-				c->send('r');
-				c->send(winner);
-				cur = player.player_id == 0 ? 0 : 6;
-				c->send_buffer.insert(c->send_buffer.end(), dices.begin()+cur, dices.begin()+cur+6);
-			}
-			else if(state == 2){
-				//send action requirements
-				c->send('c');
-				if (player.player_id == cur_player){
-					c->send('a');
-				}else{
-					c->send('w');
-				}
-				c->send(dice_num);
-				c->send(dice_point);
-				waiting = true;
+			if (successor) {
+				if (hand_off(successor)) return 0;
+				std::cout << "The new server went away during the handoff; carrying on." << std::endl;
+				successor->close();
 			}
-		}
-		if (state == 1){
-			state = 2;
+
+			state.serve(std::chrono::steady_clock::now());
 		}
 
+		auto tick_start = std::chrono::steady_clock::now();
+		uint64_t messages_total = state.tick(tick_start);
+		if (admin_listener != ServerState::NoListener) {
+			metrics.tick(std::chrono::duration< double >(std::chrono::steady_clock::now() - tick_start).count(), messages_total);
+		}
 	}
 
 
@@ -0,0 +1,241 @@
+#include "Game.hpp"
+#include "Bot.hpp"
+#include "DiceRng.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Headless balance testing: plays millions of games between built-in strategies,
+// using the same rules as the server (game_start, check_result, valid_claim, ...)
+// over a compact per-game state, spread across a work-stealing thread pool.
+//Usage: ./simulate [--games <count>] [--threads <count>] [--seed <seed>]
+//Results depend only on --games and --seed, not on the number of threads.
+
+//everything one game needs (no names, no buffers, no players list):
+struct Table {
+	uint8_t dices[Game::DicePerSeat * Game::DefaultSeats];
+	uint8_t cur_player = 0;
+	uint8_t dice_num = 1;
+	uint8_t dice_point = 1;
+	bool opening = true;
+};
+
+struct Strategy {
+	char const *name;
+	enum Kind : uint8_t { BotKind, RandomKind } kind;
+	Bot bot; //for BotKind
+	float reveal_chance; //for RandomKind
+};
+
+static std::vector< Strategy > const strategies = {
+	{"cautious", Strategy::BotKind, Bot{0.5f}, 0.0f},
+	{"bot", Strategy::BotKind, Bot{}, 0.0f},
+	{"bold", Strategy::BotKind, Bot{0.25f}, 0.0f},
+	{"random", Strategy::RandomKind, Bot{}, 0.3f},
+};
+
+static Bot::Move decide(Strategy const &strategy, Table const &table, DiceRng &rng) {
+	uint8_t const *own = table.dices + table.cur_player * 6;
+	if (strategy.kind == Strategy::BotKind) {
+		return strategy.bot.decide(own, 6, 6, table.opening, table.dice_num, table.dice_point);
+	}
+
+	//random: call sometimes, otherwise raise to one of the next few claims:
+	Bot::Move move;
+	uint32_t first = (table.dice_num - 1u) * 6u + (table.dice_point - 1u) + 1u; //(one 1 stands before the opening claim)
+	uint32_t last = std::min(first + 6u, uint32_t(sizeof(table.dices)) * 6u);
+	if (!table.opening && (first >= last || rng.chance(strategy.reveal_chance))) {
+		move.reveal = true;
+		return move;
+	}
+	uint32_t claim = first + rng.bounded(last - first);
+	move.dice_num = uint8_t(claim / 6 + 1);
+	move.dice_point = uint8_t(claim % 6 + 1);
+	return move;
+}
+
+struct Outcome {
+	uint8_t winner; //seat
+	uint32_t rounds; //claims made
+};
+
+//one game, seat 0 playing 'first' and seat 1 playing 'second':
+static Outcome play(Strategy const &first, Strategy const &second, DiceRng &rng) {
+	Table table;
+	game_start(table.dices, sizeof(table.dices), rng);
+
+	Outcome outcome{0, 0};
+	while (true) {
+		Strategy const &strategy = (table.cur_player == 0 ? first : second);
+		Bot::Move move = decide(strategy, table, rng);
+		if (move.reveal) {
+			bool holds = check_result(table.dices, sizeof(table.dices), table.dice_num, table.dice_point);
+			outcome.winner = reveal_winner(table.cur_player, Game::DefaultSeats, holds);
+			return outcome;
+		}
+		if (!valid_claim(sizeof(table.dices), move.dice_num, move.dice_point)
+		 || !raises(move.dice_num, move.dice_point, table.dice_num, table.dice_point)) {
+			throw std::runtime_error(std::string("Strategy '") + strategy.name + "' made an invalid claim.");
+		}
+		table.dice_num = move.dice_num;
+		table.dice_point = move.dice_point;
+		table.opening = false;
+		table.cur_player = next_player(table.cur_player, Game::DefaultSeats);
+		outcome.rounds += 1;
+	}
+}
+
+//per-matchup totals (matchup = first * strategies + second):
+struct Totals {
+	uint64_t games = 0;
+	uint64_t first_wins = 0;
+	uint64_t rounds = 0;
+};
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+	uint64_t games = 4000000;
+	uint32_t threads = 0;
+	uint32_t seed = 1;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--games" && i + 1 < argc) {
+			games = std::stoull(argv[++i]);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			threads = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = uint32_t(std::stoul(argv[++i]));
+		} else {
+			std::cerr << "Usage:\n\t./simulate [--games <count>] [--threads <count>] [--seed <seed>]" << std::endl;
+			return 1;
+		}
+	}
+
+	//every ordered pairing (including mirror matches) plays the same number of games, in fixed-size chunks:
+	constexpr uint32_t ChunkGames = 4096;
+	uint32_t const count = uint32_t(strategies.size());
+	uint32_t const matchups = count * count;
+	uint64_t const per_matchup = std::max< uint64_t >(1, games / matchups);
+	uint64_t const chunks = (per_matchup + ChunkGames - 1) / ChunkGames;
+
+	ThreadPool pool(threads);
+	//each worker keeps its own generator and totals, so the game loop never locks:
+	std::vector< DiceRng > rngs(pool.size());
+	std::vector< std::vector< Totals > > totals(pool.size(), std::vector< Totals >(matchups));
+	//an exception escaping a task would terminate the program, so tasks record the first one here instead:
+	std::atomic< bool > failed{false};
+	std::mutex failure_mutex;
+	std::string failure;
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t m = 0; m < matchups; ++m) {
+		for (uint64_t c = 0; c < chunks; ++c) {
+			pool.submit([&, m, c](uint32_t worker) {
+				//(once a chunk has failed, the results are discarded anyway)
+				if (failed.load(std::memory_order_relaxed)) return;
+				//reseed per chunk so the games played don't depend on which worker runs them:
+				DiceRng &rng = rngs[worker];
+				rng.seed((uint64_t(seed) << 32) ^ (uint64_t(m) << 24) ^ c);
+
+				Strategy const &first = strategies[m / count];
+				Strategy const &second = strategies[m % count];
+				Totals &t = totals[worker][m];
+				uint64_t end = std::min< uint64_t >(per_matchup, (c + 1) * ChunkGames);
+				try {
+					for (uint64_t g = c * ChunkGames; g < end; ++g) {
+						Outcome o = play(first, second, rng);
+						t.games += 1;
+						t.first_wins += (o.winner == 0);
+						t.rounds += o.rounds;
+					}
+				} catch (std::exception const &e) {
+					std::lock_guard< std::mutex > lock(failure_mutex);
+					if (!failed.exchange(true)) failure = e.what();
+				}
+			});
+		}
+	}
+	pool.wait();
+
+	if (failed.load()) {
+		std::cerr << "ERROR: " << failure << std::endl;
+		return 1;
+	}
+
+	auto after = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration< double >(after - before).count();
+
+	std::vector< Totals > matchup(matchups);
+	for (auto const &worker : totals) {
+		for (uint32_t m = 0; m < matchups; ++m) {
+			matchup[m].games += worker[m].games;
+			matchup[m].first_wins += worker[m].first_wins;
+			matchup[m].rounds += worker[m].rounds;
+		}
+	}
+
+	Totals all;
+	for (auto const &t : matchup) {
+		all.games += t.games;
+		all.first_wins += t.first_wins;
+		all.rounds += t.rounds;
+	}
+
+	std::cout << all.games << " games (seed " << seed << ") on " << pool.size() << " thread(s) in "
+		<< seconds * 1000.0 << " ms (" << uint64_t(all.games / seconds) << " games/sec)." << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "first player wins " << 100.0 * all.first_wins / all.games << "%, "
+		<< double(all.rounds) / all.games << " claims/game on average.\n" << std::endl;
+
+	//per strategy, over both seats and all opponents (mirror matches count once per seat):
+	std::cout << std::left << std::setw(10) << "strategy" << std::right
+		<< std::setw(12) << "games" << std::setw(10) << "win %" << std::setw(14) << "claims/game" << std::endl;
+	for (uint32_t s = 0; s < count; ++s) {
+		uint64_t played = 0, won = 0, rounds = 0;
+		for (uint32_t o = 0; o < count; ++o) {
+			Totals const &as_first = matchup[s * count + o];
+			Totals const &as_second = matchup[o * count + s];
+			played += as_first.games + as_second.games;
+			won += as_first.first_wins + (as_second.games - as_second.first_wins);
+			rounds += as_first.rounds + as_second.rounds;
+		}
+		std::cout << std::left << std::setw(10) << strategies[s].name << std::right
+			<< std::setw(12) << played << std::setw(10) << 100.0 * won / played
+			<< std::setw(14) << double(rounds) / played << std::endl;
+	}
+
+	//head to head, seat 0 (row) against seat 1 (column):
+	std::cout << "\nfirst player's win % (row moves first):\n" << std::setw(10) << "";
+	for (uint32_t s = 0; s < count; ++s) std::cout << std::setw(10) << strategies[s].name;
+	std::cout << std::endl;
+	for (uint32_t a = 0; a < count; ++a) {
+		std::cout << std::left << std::setw(10) << strategies[a].name << std::right;
+		for (uint32_t b = 0; b < count; ++b) {
+			Totals const &t = matchup[a * count + b];
+			std::cout << std::setw(10) << 100.0 * t.first_wins / t.games;
+		}
+		std::cout << std::endl;
+	}
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}